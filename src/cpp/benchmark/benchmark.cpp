@@ -0,0 +1,149 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "benchmark/benchmark.hpp"
+
+#include <map>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iomanip>
+#include <algorithm>
+
+#include "common/statistics.hpp"
+
+namespace Benchmark {
+
+namespace {
+
+struct Entry {
+  std::string description;
+  Function function;
+};
+
+std::map<std::string, Entry>& registry() {
+  static std::map<std::string, Entry> registry;
+  return registry;
+}
+
+}
+
+Registrar::Registrar(const char* name, const char* description,
+                     Function function) {
+  registry()[name] = Entry{description, function};
+}
+
+void PrintList(std::ostream& os) {
+  os << "Benchmarks:" << std::endl;
+  for (const auto& entry : registry()) {
+    os << "  " << std::left << std::setw(20) << entry.first
+       << entry.second.description << std::endl;
+  }
+  os << std::right;
+}
+
+int Run(const std::string& name, const std::vector<std::string>& args) {
+  auto iter = registry().find(name);
+  if (iter == registry().end()) {
+    std::cerr << "Unknown benchmark '" << name << "'." << std::endl;
+    PrintList(std::cerr);
+    return 1;
+  }
+
+  try {
+    return iter->second.function(args);
+  } catch (const OptionError& error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+}
+
+std::string GetOption(const std::vector<std::string>& args,
+                      const std::string& option,
+                      const std::string& fallback) {
+  for (size_t i = 0; i + 1 < args.size(); ++i) {
+    if (args[i] == option) {
+      return args[i + 1];
+    }
+  }
+  return fallback;
+}
+
+bool HasFlag(const std::vector<std::string>& args, const std::string& flag) {
+  return std::find(args.begin(), args.end(), flag) != args.end();
+}
+
+int ParseInt(const std::string& option, const std::string& value) {
+  const char* begin = value.c_str();
+  char* end;
+  errno = 0;
+  long result = std::strtol(begin, &end, 10);
+  if (end == begin || *end != '\0' || errno == ERANGE ||
+      result < INT_MIN || INT_MAX < result) {
+    throw OptionError(option, value);
+  }
+  return result;
+}
+
+double ParseDouble(const std::string& option, const std::string& value) {
+  const char* begin = value.c_str();
+  char* end;
+  errno = 0;
+  double result = std::strtod(begin, &end);
+  if (end == begin || *end != '\0' || errno == ERANGE) {
+    throw OptionError(option, value);
+  }
+  return result;
+}
+
+int GetIntOption(const std::vector<std::string>& args,
+                 const std::string& option, int fallback, int min) {
+  if (!HasFlag(args, option)) {
+    return std::max(fallback, min);
+  }
+  return std::max(ParseInt(option, GetOption(args, option)), min);
+}
+
+double GetDoubleOption(const std::vector<std::string>& args,
+                       const std::string& option, double fallback) {
+  if (!HasFlag(args, option)) {
+    return fallback;
+  }
+  return ParseDouble(option, GetOption(args, option));
+}
+
+void PrintTimesHeader(std::ostream& os) {
+  os << std::left << std::setw(28) << "(ms)" << std::right
+     << std::setw(10) << "min" << std::setw(10) << "avg"
+     << std::setw(10) << "p50" << std::setw(10) << "p95"
+     << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+}
+
+void PrintTimes(std::ostream& os, const std::string& label,
+                const std::vector<double>& samples_ms) {
+  std::vector<double> sorted = samples_ms;
+  std::sort(sorted.begin(), sorted.end());
+  if (sorted.empty()) {
+    sorted.push_back(0.0);
+  }
+
+  os << std::left << std::setw(28) << label << std::right
+     << std::fixed << std::setprecision(4)
+     << std::setw(10) << sorted.front()
+     << std::setw(10) << Statistics::Average(sorted)
+     << std::setw(10) << Statistics::PercentileOfSorted(sorted, 50)
+     << std::setw(10) << Statistics::PercentileOfSorted(sorted, 95)
+     << std::setw(10) << Statistics::PercentileOfSorted(sorted, 99)
+     << std::setw(10) << sorted.back() << std::endl;
+  os.unsetf(std::ios::floatfield);
+}
+
+void PrintThroughput(std::ostream& os, double count,
+                     const std::vector<double>& samples_ms,
+                     const std::string& things) {
+  os << "  " << std::fixed << std::setprecision(1)
+     << count / Statistics::Average(samples_ms) / 1000
+     << " million " << things << " per second" << std::endl;
+  os.unsetf(std::ios::floatfield);
+}
+
+}
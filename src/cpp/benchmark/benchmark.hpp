@@ -0,0 +1,105 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef BENCHMARK_BENCHMARK_HPP_
+#define BENCHMARK_BENCHMARK_HPP_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+// Benchmarks that run without a window, started with
+//   vkEarth --benchmark <name> [args...]
+namespace Benchmark {
+
+// Gets the arguments after the benchmark's name, returns the exit code.
+typedef int (*Function)(const std::vector<std::string>& args);
+
+// Registers a benchmark during static initialization, use it like:
+//   static Benchmark::Registrar registrar{"name", "description", &Run};
+struct Registrar {
+  Registrar(const char* name, const char* description, Function function);
+};
+
+void PrintList(std::ostream& os);
+
+// Thrown for an option with a malformed value, Run() prints it and returns 1.
+class OptionError : public std::runtime_error {
+ public:
+  OptionError(const std::string& option, const std::string& value)
+      : std::runtime_error("Invalid value '" + value + "' for " + option +
+                           ".") {}
+};
+
+// Returns the exit code of the benchmark, or 1 if there's no such benchmark,
+// or if an option is malformed.
+int Run(const std::string& name, const std::vector<std::string>& args);
+
+// Returns the value after the option (for ex. "--track path"), or the
+// fallback if the option is not present.
+std::string GetOption(const std::vector<std::string>& args,
+                      const std::string& option,
+                      const std::string& fallback = "");
+bool HasFlag(const std::vector<std::string>& args, const std::string& flag);
+// The whole value has to be a number, otherwise they throw an OptionError.
+int ParseInt(const std::string& option, const std::string& value);
+double ParseDouble(const std::string& option, const std::string& value);
+// Returns the integer after the option, but at least min.
+int GetIntOption(const std::vector<std::string>& args,
+                 const std::string& option, int fallback, int min = 1);
+double GetDoubleOption(const std::vector<std::string>& args,
+                       const std::string& option, double fallback);
+
+// Prints a line with the min/avg/p50/p95/p99/max of the samples.
+void PrintTimes(std::ostream& os, const std::string& label,
+                const std::vector<double>& samples_ms);
+void PrintTimesHeader(std::ostream& os);
+// Prints a line like "  12.3 million points per second", for count things
+// done in each of the samples.
+void PrintThroughput(std::ostream& os, double count,
+                     const std::vector<double>& samples_ms,
+                     const std::string& things);
+
+class Stopwatch {
+ public:
+  Stopwatch() : begin_(std::chrono::steady_clock::now()) {}
+
+  double ms() const {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - begin_).count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point begin_;
+};
+
+// Calls the function count times, with the index of the call, and returns
+// how many milliseconds each call took.
+template<typename Function>
+std::vector<double> TimeRuns(int count, Function function) {
+  std::vector<double> times;
+  times.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    Stopwatch stopwatch;
+    function(i);
+    times.push_back(stopwatch.ms());
+  }
+  return times;
+}
+
+// Keeps the compiler from optimizing away a computation whose result is
+// otherwise unused.
+template<typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static const void* volatile sink;
+  sink = &value;
+#endif
+}
+
+}
+
+#endif // BENCHMARK_BENCHMARK_HPP_
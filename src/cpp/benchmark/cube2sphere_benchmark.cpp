@@ -0,0 +1,166 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "benchmark/benchmark.hpp"
+#include "collision/cube2sphere.hpp"
+#include "common/settings.hpp"
+
+// Checks that Sphere2Cube gives back the face local positions that
+// Cube2Sphere mapped onto the sphere, and times them, one point at a time and
+// with the float and double batch versions.
+namespace {
+
+struct Options {
+  int count, repeats;
+};
+
+template<typename T>
+struct Points {
+  std::vector<T> x, y, z;
+  std::vector<CubeFace> faces;
+
+  explicit Points(size_t count) : x(count), y(count), z(count), faces(count) {}
+
+  PointArrays<T> arrays() { return {x.data(), y.data(), z.data()}; }
+  PointArrays<const T> arrays() const { return {x.data(), y.data(), z.data()}; }
+  glm::dvec3 operator[](size_t i) const { return {x[i], y[i], z[i]}; }
+};
+
+// Random face local positions, between the sphere and the highest mountain.
+Points<double> RandomFaceLocalPoints(int count) {
+  std::mt19937 random{42};
+  std::uniform_real_distribution<double> side{0, Settings::kFaceSize};
+  std::uniform_real_distribution<double> height{0, Settings::kMaxHeight};
+  std::uniform_int_distribution<int> face{0, 5};
+  Points<double> points(count);
+  for (int i = 0; i < count; ++i) {
+    points.x[i] = side(random);
+    points.y[i] = height(random);
+    points.z[i] = side(random);
+    points.faces[i] = static_cast<CubeFace>(face(random));
+  }
+  return points;
+}
+
+template<typename T>
+Points<T> Convert(const Points<double>& points) {
+  Points<T> converted(points.faces.size());
+  for (size_t i = 0; i < points.faces.size(); ++i) {
+    converted.x[i] = T(points.x[i]);
+    converted.y[i] = T(points.y[i]);
+    converted.z[i] = T(points.z[i]);
+  }
+  converted.faces = points.faces;
+  return converted;
+}
+
+// The largest distance of a round tripped position from the original, in
+// face local units (a face is kFaceSize units wide). The points on the edges
+// can come back on the neighbouring face, those are compared on the sphere.
+template<typename T>
+double MaxError(const Points<double>& original, const Points<T>& round_trip) {
+  double max_error = 0;
+  for (size_t i = 0; i < original.faces.size(); ++i) {
+    double error;
+    if (round_trip.faces[i] == original.faces[i]) {
+      glm::dvec3 diff = glm::abs(round_trip[i] - original[i]);
+      error = std::max(diff.x, std::max(diff.y, diff.z));
+    } else {
+      error = glm::length(
+          Cube2Sphere(round_trip[i], round_trip.faces[i], Settings::kFaceSize) -
+          Cube2Sphere(original[i], original.faces[i], Settings::kFaceSize));
+    }
+    max_error = std::max(max_error, error);
+  }
+  return max_error;
+}
+
+void PrintTimes(const Options& options, const std::string& label,
+                const std::vector<double>& times) {
+  Benchmark::PrintTimes(std::cout, label, times);
+  Benchmark::PrintThroughput(std::cout, options.count, times, "points");
+}
+
+bool PrintError(const std::string& label, double error, double max_error) {
+  std::cout << label << " round trip error: " << error << " units"
+            << (error > max_error ? " (too big)" : "") << std::endl;
+  return error <= max_error;
+}
+
+bool RunScalar(const Options& options, const Points<double>& face_local) {
+  Points<double> world(options.count), round_trip(options.count);
+
+  PrintTimes(options, "one by one, to sphere",
+             Benchmark::TimeRuns(options.repeats, [&](int) {
+    for (int i = 0; i < options.count; ++i) {
+      glm::dvec3 pos = Cube2Sphere(face_local[i], face_local.faces[i],
+                                   Settings::kFaceSize);
+      world.x[i] = pos.x;
+      world.y[i] = pos.y;
+      world.z[i] = pos.z;
+    }
+  }));
+  PrintTimes(options, "one by one, to cube",
+             Benchmark::TimeRuns(options.repeats, [&](int) {
+    for (int i = 0; i < options.count; ++i) {
+      glm::dvec3 pos = Sphere2Cube(world[i], &round_trip.faces[i],
+                                   Settings::kFaceSize);
+      round_trip.x[i] = pos.x;
+      round_trip.y[i] = pos.y;
+      round_trip.z[i] = pos.z;
+    }
+  }));
+
+  return PrintError("one by one", MaxError(face_local, round_trip), 1e-6);
+}
+
+template<typename T>
+bool RunBatch(const Options& options, const std::string& type,
+              const Points<double>& original, double max_error) {
+  Points<T> face_local = Convert<T>(original);
+  Points<T> world(options.count), round_trip(options.count);
+
+  PrintTimes(options, type + " batch, to sphere",
+             Benchmark::TimeRuns(options.repeats, [&](int) {
+    Cube2Sphere(face_local.arrays(), face_local.faces.data(), options.count,
+                Settings::kFaceSize, world.arrays());
+  }));
+  PrintTimes(options, type + " batch, to cube",
+             Benchmark::TimeRuns(options.repeats, [&](int) {
+    Sphere2Cube(world.arrays(), options.count, Settings::kFaceSize,
+                round_trip.arrays(), round_trip.faces.data());
+  }));
+
+  return PrintError(type + " batch", MaxError(original, round_trip), max_error);
+}
+
+int Run(const std::vector<std::string>& args) {
+  Options options;
+  options.count = Benchmark::GetIntOption(args, "--count", 1000000);
+  options.repeats = Benchmark::GetIntOption(args, "--repeats", 20);
+
+  Points<double> face_local = RandomFaceLocalPoints(options.count);
+
+  std::cout << options.count << " points" << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+  bool ok = RunScalar(options, face_local);
+  ok &= RunBatch<double>(options, "double", face_local, 1e-6);
+  // A float has 24 bits, and the positions are up to 2^16 units, so a float
+  // is only exact to 2^-7 units there, the trigonometry adds a few times that
+  ok &= RunBatch<float>(options, "float", face_local, 0.1);
+  return ok ? 0 : 1;
+}
+
+Benchmark::Registrar registrar{
+    "cube2sphere",
+    "round trip accuracy and speed of Cube2Sphere and Sphere2Cube, one by one "
+    "and in float and double batches [--count n] [--repeats n]",
+    &Run};
+
+}
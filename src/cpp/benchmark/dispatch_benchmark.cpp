@@ -0,0 +1,113 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "benchmark/benchmark.hpp"
+#include "engine/scene.hpp"
+
+// Times the update dispatch of a large GameObject tree, in which only a part
+// of the objects override Update(). The recursive dispatch (a try block and
+// the pending component changes on every object, and a virtual call on every
+// object) is compared with the scene's flattened dispatch list.
+namespace {
+
+class Counter : public engine::GameObject {
+ public:
+  Counter(GameObject* parent, uint64_t* count)
+      : GameObject(parent), count_(count) {}
+
+ private:
+  uint64_t* count_;
+
+  virtual void Update() override { ++*count_; }
+};
+
+class DispatchScene : public engine::Scene {
+ public:
+  DispatchScene() : Scene(nullptr, glm::ivec2{1280, 720}) {}
+
+  void UpdateRecursive() { GameObject::UpdateAll(); }
+  void UpdateFlattened() { Scene::UpdateAll(); }
+};
+
+struct Options {
+  int count, fanout, override_every, frames;
+};
+
+// The objects are added level by level, every override_every-th of them
+// overrides Update().
+void BuildTree(DispatchScene& scene, const Options& options, uint64_t* count) {
+  std::vector<engine::GameObject*> objects{&scene};
+  for (int i = 1; i <= options.count; ++i) {
+    engine::GameObject* parent = objects[(i - 1) / options.fanout];
+    if (i % options.override_every == 0) {
+      objects.push_back(parent->AddComponent<Counter>(count));
+    } else {
+      objects.push_back(parent->AddComponent<engine::GameObject>());
+    }
+  }
+}
+
+template<typename UpdateFunction>
+std::vector<double> TimeUpdates(const Options& options, UpdateFunction update) {
+  DispatchScene scene;
+  uint64_t count = 0;
+  BuildTree(scene, options, &count);
+
+  // Adds the new objects level by level, and finds out which ones don't
+  // override Update()
+  for (int i = 0; i < 32; ++i) {
+    update(scene);
+  }
+
+  std::vector<double> times = Benchmark::TimeRuns(options.frames,
+      [&](int) { update(scene); });
+  Benchmark::DoNotOptimize(count);
+  return times;
+}
+
+void PrintPerObject(const std::vector<double>& times, const Options& options) {
+  double avg_ms = 0;
+  for (double time : times) {
+    avg_ms += time / times.size();
+  }
+  std::cout << "  " << avg_ms * 1e6 / options.count << " ns per object"
+            << std::endl;
+}
+
+int Run(const std::vector<std::string>& args) {
+  using Benchmark::GetIntOption;
+
+  Options options;
+  options.count = GetIntOption(args, "--count", 100000);
+  options.fanout = GetIntOption(args, "--fanout", 8);
+  options.override_every = GetIntOption(args, "--override-every", 10);
+  options.frames = GetIntOption(args, "--frames", 100);
+
+  std::cout << "Update dispatch, " << options.count << " objects, fanout "
+            << options.fanout << ", every " << options.override_every
+            << ". overrides Update()" << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+
+  std::vector<double> recursive = TimeUpdates(options,
+      [](DispatchScene& scene) { scene.UpdateRecursive(); });
+  Benchmark::PrintTimes(std::cout, "recursive", recursive);
+  PrintPerObject(recursive, options);
+
+  std::vector<double> flattened = TimeUpdates(options,
+      [](DispatchScene& scene) { scene.UpdateFlattened(); });
+  Benchmark::PrintTimes(std::cout, "flattened", flattened);
+  PrintPerObject(flattened, options);
+
+  return 0;
+}
+
+Benchmark::Registrar registrar{
+    "dispatch",
+    "the per object overhead of the update dispatch "
+    "[--count n] [--fanout n] [--override-every n] [--frames n]",
+    &Run};
+
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "benchmark/flights.hpp"
+
+#include <cmath>
+
+#include "common/settings.hpp"
+
+namespace Flights {
+
+namespace {
+
+constexpr double kDuration = 10;  // seconds
+constexpr double kPoseInterval = 0.1;
+
+// The same as the initial camera of DemoScene.
+const glm::dvec3 kStartPos{-54483.2, 38919.9, 13576.9};
+const glm::dvec3 kTarget{10, 0, 10};
+const double kFovy = glm::radians(60.0);
+
+void Hover(double t, engine::CameraPose& pose) {
+  // A meter or so of drift, as if the user was holding the mouse.
+  pose.pos = kStartPos + glm::dvec3{std::sin(t), std::cos(0.7*t), 0};
+  pose.forward = glm::normalize(kTarget - kStartPos);
+}
+
+void Pan(double t, engine::CameraPose& pose) {
+  // Turn 30 degrees around the up axis, in place.
+  glm::dvec3 forward = glm::normalize(kTarget - kStartPos);
+  double angle = glm::radians(30.0) * t / kDuration;
+  pose.pos = kStartPos;
+  pose.forward = glm::rotate(forward, angle, glm::dvec3{0, 1, 0});
+}
+
+void Flyby(double t, engine::CameraPose& pose) {
+  // Descend to 1% of the radius above the surface, looking at the horizon.
+  glm::dvec3 dir = glm::normalize(kStartPos);
+  glm::dvec3 end_pos = dir * (Settings::kSphereRadius * 1.01);
+  double s = t / kDuration;
+  pose.pos = glm::mix(kStartPos, end_pos, s*s*(3 - 2*s));
+  glm::dvec3 tangent = glm::normalize(glm::cross(dir, glm::dvec3{0, 1, 0}));
+  pose.forward = glm::normalize(glm::mix(-dir, tangent, s));
+}
+
+}
+
+const std::vector<std::string>& names() {
+  static const std::vector<std::string> names{"hover", "pan", "flyby"};
+  return names;
+}
+
+bool Make(const std::string& name, engine::CameraTrack& track) {
+  void (*flight)(double, engine::CameraPose&) =
+      name == "hover" ? Hover :
+      name == "pan" ? Pan :
+      name == "flyby" ? Flyby : nullptr;
+  if (!flight) {
+    return false;
+  }
+
+  track.Clear();
+  for (int i = 0; i * kPoseInterval <= kDuration + 1e-9; ++i) {
+    engine::CameraPose pose;
+    pose.time = i * kPoseInterval;
+    pose.up = glm::dvec3{0, 1, 0};
+    pose.fovy = kFovy;
+    flight(pose.time, pose);
+    track.Add(pose);
+  }
+
+  return true;
+}
+
+bool MakeOrLoad(const std::string& name_or_path, engine::CameraTrack& track) {
+  return Make(name_or_path, track) || track.Load(name_or_path);
+}
+
+}
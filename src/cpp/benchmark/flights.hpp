@@ -0,0 +1,28 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef BENCHMARK_FLIGHTS_HPP_
+#define BENCHMARK_FLIGHTS_HPP_
+
+#include <string>
+#include <vector>
+
+#include "engine/camera_track.hpp"
+
+// Synthetic camera flights, so that the benchmarks and the replays have
+// something to run without a recorded track. All of them start from the
+// demo's initial camera position.
+namespace Flights {
+
+// "hover": barely moving, "pan": slowly turning in place,
+// "flyby": descending from orbit to low altitude.
+const std::vector<std::string>& names();
+
+// Fills the track, returns false if there's no flight with that name.
+bool Make(const std::string& name, engine::CameraTrack& track);
+
+// Makes a built-in flight if name is one, loads it from a file otherwise.
+bool MakeOrLoad(const std::string& name_or_path, engine::CameraTrack& track);
+
+}
+
+#endif // BENCHMARK_FLIGHTS_HPP_
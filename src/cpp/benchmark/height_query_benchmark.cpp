@@ -0,0 +1,92 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "benchmark/benchmark.hpp"
+#include "cdlod/terrain_height_query.hpp"
+#include "engine/job_system.hpp"
+
+// Times the terrain height queries of random points around the planet, one
+// by one, as a batch, and as a batch split between the threads of a job
+// system.
+namespace {
+
+struct Options {
+  int count, repeats;
+};
+
+std::vector<glm::dvec3> RandomPositions(int count) {
+  std::mt19937 random{42};
+  std::normal_distribution<double> normal;
+  std::vector<glm::dvec3> positions;
+  for (int i = 0; i < count; ++i) {
+    glm::dvec3 dir{normal(random), normal(random), normal(random)};
+    positions.push_back(glm::normalize(dir) * (Settings::kSphereRadius * 1.01));
+  }
+  return positions;
+}
+
+void PrintTimes(const Options& options, const std::string& label,
+                const std::vector<double>& times) {
+  Benchmark::PrintTimes(std::cout, label, times);
+  Benchmark::PrintThroughput(std::cout, options.count, times, "queries");
+}
+
+int Run(const std::vector<std::string>& args) {
+  Options options;
+  options.count = Benchmark::GetIntOption(args, "--count", 1000000);
+  options.repeats = Benchmark::GetIntOption(args, "--repeats", 20);
+
+  TerrainHeightQuery terrain =
+      TerrainHeightQuery::Load(Settings::kHeightmapDirectory);
+  engine::JobSystem job_system;
+  std::vector<glm::dvec3> positions = RandomPositions(options.count);
+  std::vector<double> heights(options.count), batch_heights(options.count);
+
+  std::cout << options.count << " height queries, "
+            << job_system.worker_count() + 1 << " threads" << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+
+  PrintTimes(options, "one by one",
+             Benchmark::TimeRuns(options.repeats, [&](int) {
+    for (int i = 0; i < options.count; ++i) {
+      heights[i] = terrain.HeightAt(positions[i]);
+    }
+  }));
+  PrintTimes(options, "batch",
+             Benchmark::TimeRuns(options.repeats, [&](int) {
+    terrain.HeightsAt(positions.data(), options.count, batch_heights.data());
+  }));
+  PrintTimes(options, "batch, threads",
+             Benchmark::TimeRuns(options.repeats, [&](int) {
+    terrain.HeightsAt(positions.data(), options.count, batch_heights.data(),
+                      &job_system);
+  }));
+
+  // The batch Sphere2Cube rounds differently, but the positions are off by
+  // much less than a texel
+  double max_difference = 0;
+  for (int i = 0; i < options.count; ++i) {
+    max_difference = std::max(max_difference,
+                              std::abs(heights[i] - batch_heights[i]));
+  }
+  if (max_difference > 1e-6) {
+    std::cerr << "The batch heights differ from the single ones by up to "
+              << max_difference << "." << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+Benchmark::Registrar registrar{
+    "height_query",
+    "terrain height queries one by one, batched and on threads "
+    "[--count n] [--repeats n]",
+    &Run};
+
+}
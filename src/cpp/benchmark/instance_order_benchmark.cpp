@@ -0,0 +1,111 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include "benchmark/benchmark.hpp"
+#include "benchmark/flights.hpp"
+#include "cdlod/cdlod_quad_tree.hpp"
+#include "engine/camera_track.hpp"
+
+// Times QuadGridMesh::SortRenderList on the nodes selected along the camera
+// flights, and compares the locality of the traversal and the sorted order.
+// The locality is the average distance between consecutive instances of the
+// same face, relative to their size: the lower it is, the more heightmap
+// texels the neighbouring instances share.
+namespace {
+
+constexpr double kZNear = 10, kZFar = 1000000;
+
+double AverageStep(const std::vector<glm::vec4>& render_data) {
+  double sum = 0;
+  size_t count = 0;
+  for (size_t i = 1; i < render_data.size(); ++i) {
+    const glm::vec4& prev = render_data[i-1];
+    const glm::vec4& curr = render_data[i];
+    if (prev.w != curr.w) {
+      continue;
+    }
+    double size = std::pow(2, std::max(prev.z, curr.z)) * Settings::kNodeDimension;
+    sum += glm::length(glm::dvec2{curr.x - prev.x, curr.y - prev.y}) / size;
+    ++count;
+  }
+  return count ? sum / count : 0.0;
+}
+
+int Run(const std::vector<std::string>& args) {
+  using Benchmark::GetOption;
+
+  std::vector<std::string> flights;
+  std::string flight_arg = GetOption(args, "--flight");
+  if (flight_arg.empty()) {
+    flights = Flights::names();
+  } else {
+    flights.push_back(flight_arg);
+  }
+
+  double timestep = Benchmark::GetDoubleOption(args, "--timestep", 1.0 / 60);
+  if (timestep <= 0) {
+    std::cerr << "The timestep has to be positive." << std::endl;
+    return 1;
+  }
+  glm::ivec2 size{1280, 720};
+  std::sscanf(GetOption(args, "--size", "1280x720").c_str(), "%dx%d",
+              &size.x, &size.y);
+
+  std::cout << "Instance sorting, " << size.x << "x" << size.y << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+
+  for (const std::string& flight : flights) {
+    engine::CameraTrack track;
+    if (!Flights::MakeOrLoad(flight, track)) {
+      return 1;
+    }
+
+    std::unique_ptr<CdlodQuadTree> quad_trees[6];
+    for (int face = 0; face < 6; ++face) {
+      quad_trees[face] = make_unique<CdlodQuadTree>(
+          Settings::kFaceSize, static_cast<CubeFace>(face));
+    }
+    QuadGridMesh mesh{Settings::kNodeDimension};
+
+    engine::ReplayCamera camera{nullptr, kZNear, kZFar, track, timestep};
+    camera.ScreenResized(size.x, size.y);
+
+    std::vector<double> times;
+    double traversal_step = 0, sorted_step = 0;
+    size_t frame_count = track.frame_count(timestep);
+    for (size_t frame = 0; frame < frame_count; ++frame) {
+      camera.Update();
+      mesh.ClearRenderList();
+      for (int face = 0; face < 6; ++face) {
+        quad_trees[face]->SelectNodes(camera, mesh);
+      }
+      traversal_step += AverageStep(mesh.mesh_.render_data_);
+
+      Benchmark::Stopwatch stopwatch;
+      mesh.SortRenderList();
+      times.push_back(stopwatch.ms());
+      sorted_step += AverageStep(mesh.mesh_.render_data_);
+    }
+
+    Benchmark::PrintTimes(std::cout, flight, times);
+    std::cout << "  average step between instances: "
+              << traversal_step / frame_count << " in traversal order, "
+              << sorted_step / frame_count << " in Morton order" << std::endl;
+  }
+
+  return 0;
+}
+
+Benchmark::Registrar registrar{
+    "instance_order",
+    "sorting the selected instances in Morton order "
+    "[--flight hover|pan|flyby|<track file>] [--timestep s] [--size WxH]",
+    &Run};
+
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "benchmark/benchmark.hpp"
+#include "engine/scene.hpp"
+
+// Times the update of simulation objects, that each integrate their own
+// particles in a shared gravity field, with the serial and with the parallel
+// update. Every barrier_every-th object doesn't declare its update access, so
+// it splits the update into waves.
+namespace {
+
+class Simulation : public engine::GameObject {
+ public:
+  Simulation(GameObject* parent, int particle_count, bool declared)
+      : GameObject(parent), positions_(particle_count)
+      , velocities_(particle_count) {
+    for (int i = 0; i < particle_count; ++i) {
+      positions_[i] = glm::dvec3(i % 7, i % 11, i % 13) + glm::dvec3{100};
+    }
+    if (declared) {
+      DeclareUpdateAccess(scene_->UpdateResource("gravity"), 0);
+    }
+  }
+
+  const std::vector<glm::dvec3>& positions() const { return positions_; }
+
+ private:
+  std::vector<glm::dvec3> positions_, velocities_;
+
+  virtual void Update() override {
+    const double dt = 1.0 / 60;
+    for (size_t i = 0; i < positions_.size(); ++i) {
+      double distance = glm::length(positions_[i]);
+      velocities_[i] -= positions_[i] * (dt / (distance * distance * distance));
+      positions_[i] += velocities_[i] * dt;
+    }
+  }
+};
+
+class SimulationScene : public engine::Scene {
+ public:
+  SimulationScene() : Scene(nullptr, glm::ivec2{1280, 720}) {}
+
+  void UpdateFrame() { UpdateAll(); }
+};
+
+struct Options {
+  int count, particles, barrier_every, frames;
+};
+
+std::vector<double> TimeUpdates(const Options& options, bool parallel) {
+  SimulationScene scene;
+  scene.set_parallel_update(parallel);
+  std::vector<Simulation*> simulations;
+  for (int i = 1; i <= options.count; ++i) {
+    bool declared = options.barrier_every == 0 || i % options.barrier_every;
+    simulations.push_back(scene.AddComponent<Simulation>(options.particles,
+                                                         declared));
+  }
+  // Adds the objects, and builds the dispatch list
+  scene.UpdateFrame();
+
+  std::vector<double> times = Benchmark::TimeRuns(options.frames,
+      [&](int) { scene.UpdateFrame(); });
+
+  glm::dvec3 sum;
+  for (const Simulation* simulation : simulations) {
+    sum += simulation->positions().back();
+  }
+  Benchmark::DoNotOptimize(sum);
+  return times;
+}
+
+int Run(const std::vector<std::string>& args) {
+  using Benchmark::GetIntOption;
+
+  Options options;
+  options.count = GetIntOption(args, "--count", 256);
+  options.particles = GetIntOption(args, "--particles", 2000);
+  options.barrier_every = GetIntOption(args, "--barrier-every", 0, 0);
+  options.frames = GetIntOption(args, "--frames", 100);
+
+  std::cout << "Update of " << options.count << " simulations of "
+            << options.particles << " particles, "
+            << std::thread::hardware_concurrency() << " hardware threads";
+  if (options.barrier_every) {
+    std::cout << ", every " << options.barrier_every
+              << ". one is undeclared";
+  }
+  std::cout << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+
+  Benchmark::PrintTimes(std::cout, "serial", TimeUpdates(options, false));
+  Benchmark::PrintTimes(std::cout, "parallel", TimeUpdates(options, true));
+
+  return 0;
+}
+
+Benchmark::Registrar registrar{
+    "parallel_update",
+    "the serial and the parallel update of independent simulations "
+    "[--count n] [--particles n] [--barrier-every n] [--frames n]",
+    &Run};
+
+}
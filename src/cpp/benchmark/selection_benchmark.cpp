@@ -0,0 +1,162 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include "benchmark/benchmark.hpp"
+#include "benchmark/flights.hpp"
+#include "cdlod/cdlod_quad_tree.hpp"
+#include "cdlod/cdlod_linear_quad_tree.hpp"
+#include "engine/camera_track.hpp"
+
+// Times the CDLOD node selection of all six cube faces along camera flights,
+// with the same fixed timestep replay that the renderer uses. The full and the
+// incremental selection of the pointer tree, and the selection of the linear
+// tree are timed by default, they should all select the same number of nodes.
+// With --pixel-error, the lod ranges come from the screen space error metric
+// (see CdlodLodTable::ScreenSpaceErrorRange), so the node counts of different
+// --size and --pixel-error values can be compared.
+namespace {
+
+constexpr double kZNear = 10, kZFar = 1000000;
+
+enum class Mode { kFull, kIncremental, kLinear };
+
+struct Options {
+  double timestep;
+  int repeat;
+  glm::ivec2 size;
+  double pixel_error;  // zero means the distance metric
+};
+
+void Configure(CdlodQuadTree& tree, Mode mode) {
+  tree.set_incremental(mode == Mode::kIncremental);
+}
+
+void Configure(CdlodLinearQuadTree&, Mode) {}
+
+template<typename QuadTree>
+void TimeFlight(const engine::CameraTrack& track, const Options& options,
+                Mode mode, std::vector<double>& times, size_t& node_count) {
+  for (int run = 0; run < options.repeat; ++run) {
+    // Start every run from a cold tree
+    CdlodLodTable lod_table = CdlodLodTable::Default();
+    std::unique_ptr<QuadTree> quad_trees[6];
+    for (int face = 0; face < 6; ++face) {
+      quad_trees[face] = make_unique<QuadTree>(
+          Settings::kFaceSize, static_cast<CubeFace>(face), lod_table);
+      Configure(*quad_trees[face], mode);
+    }
+    QuadGridMesh mesh{Settings::kNodeDimension};
+
+    engine::ReplayCamera camera{nullptr, kZNear, kZFar, track, options.timestep};
+    camera.ScreenResized(options.size.x, options.size.y);
+
+    size_t frame_count = track.frame_count(options.timestep);
+    for (size_t frame = 0; frame < frame_count; ++frame) {
+      camera.Update();
+      if (options.pixel_error > 0) {
+        lod_table.set_smallest_range(CdlodLodTable::ScreenSpaceErrorRange(
+            Settings::kLodGeometricError, options.pixel_error,
+            camera.projectionMatrix(), options.size.y));
+      }
+
+      Benchmark::Stopwatch stopwatch;
+      mesh.ClearRenderList();
+      for (int face = 0; face < 6; ++face) {
+        quad_trees[face]->SelectNodes(camera, mesh);
+      }
+      times.push_back(stopwatch.ms());
+      node_count += mesh.node_count();
+    }
+  }
+}
+
+int Run(const std::vector<std::string>& args) {
+  using Benchmark::GetOption;
+
+  std::vector<std::string> flights;
+  std::string flight_arg = GetOption(args, "--flight");
+  if (flight_arg.empty()) {
+    flights = Flights::names();
+  } else {
+    flights.push_back(flight_arg);
+  }
+
+  Options options;
+  options.timestep = Benchmark::GetDoubleOption(args, "--timestep", 1.0 / 60);
+  if (options.timestep <= 0) {
+    std::cerr << "The timestep has to be positive." << std::endl;
+    return 1;
+  }
+  options.repeat = Benchmark::GetIntOption(args, "--repeat", 3);
+  options.size = glm::ivec2{1280, 720};
+  std::sscanf(GetOption(args, "--size", "1280x720").c_str(), "%dx%d",
+              &options.size.x, &options.size.y);
+  options.pixel_error = Benchmark::GetDoubleOption(args, "--pixel-error", 0);
+
+  std::vector<Mode> modes;
+  std::string mode_arg = GetOption(args, "--mode", "all");
+  if (mode_arg == "full" || mode_arg == "all") {
+    modes.push_back(Mode::kFull);
+  }
+  if (mode_arg == "incremental" || mode_arg == "all") {
+    modes.push_back(Mode::kIncremental);
+  }
+  if (mode_arg == "linear" || mode_arg == "all") {
+    modes.push_back(Mode::kLinear);
+  }
+  if (modes.empty()) {
+    std::cerr << "Unknown selection mode: " << mode_arg << std::endl;
+    return 1;
+  }
+
+  std::cout << "CDLOD selection, " << options.size.x << "x" << options.size.y
+            << ", " << options.repeat << " runs per flight";
+  if (options.pixel_error > 0) {
+    std::cout << ", " << options.pixel_error << " pixel error";
+  }
+  std::cout << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+
+  for (const std::string& flight : flights) {
+    engine::CameraTrack track;
+    if (!Flights::MakeOrLoad(flight, track)) {
+      return 1;
+    }
+
+    for (Mode mode : modes) {
+      std::vector<double> times;
+      size_t node_count = 0;
+      std::string name = flight;
+      if (mode == Mode::kLinear) {
+        TimeFlight<CdlodLinearQuadTree>(track, options, mode, times, node_count);
+        name += " (linear)";
+      } else {
+        TimeFlight<CdlodQuadTree>(track, options, mode, times, node_count);
+        name += mode == Mode::kFull ? " (full)" : " (incremental)";
+      }
+
+      Benchmark::PrintTimes(std::cout, name, times);
+      if (!times.empty()) {
+        std::cout << "  " << node_count / times.size() << " nodes per frame "
+                  << "on average, over " << times.size() << " frames"
+                  << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
+
+Benchmark::Registrar registrar{
+    "selection",
+    "CDLOD node selection along camera flights "
+    "[--flight hover|pan|flyby|<track file>] [--timestep s] [--repeat n] "
+    "[--size WxH] [--mode full|incremental|linear|all] [--pixel-error p]",
+    &Run};
+
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "benchmark/benchmark.hpp"
+#include "engine/transform.hpp"
+
+// Times the world space reads of deep transform hierarchies, when the root
+// moves every frame. Every node is read several times per frame, like the
+// camera and the scene objects do. The cached reads are compared with
+// recomputing the parent chain on every read, as Transformation used to do.
+namespace {
+
+using engine::Transform;
+
+glm::dmat4 LocalMatrix(const Transform& transform) {
+  glm::dmat4 local = glm::scale(glm::mat4_cast(transform.local_rot()),
+                                transform.local_scale());
+  local[3] = glm::dvec4(transform.local_pos(), 1);
+  return local;
+}
+
+glm::dmat4 UncachedLocalToWorld(const Transform& transform) {
+  if (transform.parent()) {
+    return UncachedLocalToWorld(*transform.parent()) * LocalMatrix(transform);
+  } else {
+    return LocalMatrix(transform);
+  }
+}
+
+struct Options {
+  int depth, chains, frames, reads;
+};
+
+// Every chain hangs from the same root, each node is rotated a bit relative to
+// its parent.
+std::vector<std::unique_ptr<Transform>> MakeHierarchy(const Options& options) {
+  std::vector<std::unique_ptr<Transform>> nodes;
+  nodes.push_back(make_unique<Transform>());
+  for (int chain = 0; chain < options.chains; ++chain) {
+    Transform* parent = nodes.front().get();
+    for (int level = 0; level < options.depth; ++level) {
+      nodes.push_back(make_unique<Transform>(parent));
+      Transform& node = *nodes.back();
+      node.set_local_pos(glm::dvec3{1.0, 0.5 * chain, 0.25 * level});
+      node.set_local_rot(glm::angleAxis(0.01 * (level + 1),
+                                        glm::dvec3{0, 1, 0}));
+      parent = &node;
+    }
+  }
+  return nodes;
+}
+
+template<typename ReadFunction>
+std::vector<double> TimeReads(const Options& options, ReadFunction read) {
+  std::vector<std::unique_ptr<Transform>> nodes = MakeHierarchy(options);
+  return Benchmark::TimeRuns(options.frames, [&](int frame) {
+    nodes.front()->set_local_pos(glm::dvec3{double(frame), 0, 0});
+
+    glm::dvec3 sum;
+    for (int i = 0; i < options.reads; ++i) {
+      for (const auto& node : nodes) {
+        sum += read(*node);
+      }
+    }
+    Benchmark::DoNotOptimize(sum);
+  });
+}
+
+int Run(const std::vector<std::string>& args) {
+  using Benchmark::GetIntOption;
+
+  Options options;
+  options.depth = GetIntOption(args, "--depth", 16);
+  options.chains = GetIntOption(args, "--chains", 1000);
+  options.frames = GetIntOption(args, "--frames", 100);
+  options.reads = GetIntOption(args, "--reads", 4);
+
+  std::cout << "Transform reads, " << options.chains << " chains of "
+            << options.depth << " nodes, " << options.reads
+            << " reads per node per frame" << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+
+  Benchmark::PrintTimes(std::cout, "cached", TimeReads(options,
+      [](const Transform& t) { return t.pos(); }));
+  Benchmark::PrintTimes(std::cout, "uncached", TimeReads(options,
+      [](const Transform& t) {
+        return glm::dvec3{UncachedLocalToWorld(t)[3]};
+      }));
+
+  return 0;
+}
+
+Benchmark::Registrar registrar{
+    "transform",
+    "world space reads of deep transform hierarchies "
+    "[--depth n] [--chains n] [--frames n] [--reads n]",
+    &Run};
+
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "benchmark/benchmark.hpp"
+#include "engine/transform.hpp"
+#include "engine/transform_system.hpp"
+
+// Times computing the world matrices of a lot of markers on the globe, with
+// one Transform object per marker, and with the packed TransformSystem. The
+// markers are grouped into regions under the rotating planet, and every
+// marker has a label under it. Every frame the planet turns, so every world
+// matrix changes, and a part of the markers move.
+namespace {
+
+constexpr int kRegionCount = 64;
+
+struct Options {
+  int frames;
+  double moving;  // the fraction of the markers that move every frame
+};
+
+glm::dquat PlanetRotation(int frame) {
+  return glm::angleAxis(0.001 * frame, glm::dvec3{0, 1, 0});
+}
+
+glm::dvec3 MarkerPos(int marker, int frame) {
+  return glm::dvec3(marker % 97, marker % 89, frame + marker % 83);
+}
+
+std::vector<double> TimeObjects(int count, const Options& options) {
+  using engine::Transform;
+
+  std::vector<std::unique_ptr<Transform>> transforms;
+  transforms.push_back(make_unique<Transform>());
+  Transform* planet = transforms.back().get();
+  std::vector<Transform*> regions, markers;
+  for (int i = 0; i < kRegionCount; ++i) {
+    transforms.push_back(make_unique<Transform>(planet));
+    regions.push_back(transforms.back().get());
+  }
+  for (int i = 0; i < count; ++i) {
+    transforms.push_back(make_unique<Transform>(regions[i % kRegionCount]));
+    markers.push_back(transforms.back().get());
+    transforms.push_back(make_unique<Transform>(markers.back()));
+  }
+
+  int moving = count * options.moving;
+  return Benchmark::TimeRuns(options.frames, [&](int frame) {
+    planet->set_local_rot(PlanetRotation(frame));
+    for (int i = 0; i < moving; ++i) {
+      markers[i]->set_local_pos(MarkerPos(i, frame));
+    }
+    glm::dvec4 sum;
+    for (const auto& transform : transforms) {
+      sum += transform->localToWorldMatrix()[3];
+    }
+    Benchmark::DoNotOptimize(sum);
+  });
+}
+
+std::vector<double> TimePacked(int count, const Options& options) {
+  using engine::TransformSystem;
+
+  TransformSystem system;
+  TransformSystem::Handle planet = system.Create();
+  std::vector<TransformSystem::Handle> regions, markers;
+  for (int i = 0; i < kRegionCount; ++i) {
+    regions.push_back(system.Create(planet));
+  }
+  for (int i = 0; i < count; ++i) {
+    markers.push_back(system.Create(regions[i % kRegionCount]));
+    system.Create(markers.back());
+  }
+
+  int moving = count * options.moving;
+  return Benchmark::TimeRuns(options.frames, [&](int frame) {
+    system.set_local_rot(planet, PlanetRotation(frame));
+    for (int i = 0; i < moving; ++i) {
+      system.set_local_pos(markers[i], MarkerPos(i, frame));
+    }
+    system.Update();
+    glm::dvec4 sum;
+    for (const glm::dmat4& matrix : system.world_matrices()) {
+      sum += matrix[3];
+    }
+    Benchmark::DoNotOptimize(sum);
+  });
+}
+
+int Run(const std::vector<std::string>& args) {
+  using Benchmark::GetOption;
+
+  std::vector<int> counts;
+  std::stringstream counts_arg{GetOption(args, "--counts", "10000,100000")};
+  std::string count;
+  while (std::getline(counts_arg, count, ',')) {
+    counts.push_back(std::max(Benchmark::ParseInt("--counts", count), 1));
+  }
+
+  Options options;
+  options.frames = Benchmark::GetIntOption(args, "--frames", 100);
+  options.moving = Benchmark::GetDoubleOption(args, "--moving", 0.1);
+  options.moving = std::min(std::max(options.moving, 0.0), 1.0);
+
+  std::cout << "Marker transforms, " << options.frames << " frames, "
+            << options.moving * 100 << "% of the markers move" << std::endl;
+  Benchmark::PrintTimesHeader(std::cout);
+
+  for (int count : counts) {
+    std::string label = std::to_string(count) + " markers";
+    Benchmark::PrintTimes(std::cout, label + " (objects)",
+                          TimeObjects(count, options));
+    Benchmark::PrintTimes(std::cout, label + " (packed)",
+                          TimePacked(count, options));
+  }
+
+  return 0;
+}
+
+Benchmark::Registrar registrar{
+    "transform_system",
+    "world matrices of markers as Transform objects and packed "
+    "[--counts n,n,...] [--frames n] [--moving fraction]",
+    &Run};
+
+}
@@ -0,0 +1,150 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include <cassert>
+#include <algorithm>
+#include "cdlod/cdlod_linear_quad_tree.hpp"
+#include "engine/cpu_profiler.hpp"
+
+// The low two bits of the children's Morton codes, in the order of the
+// QuadGridMesh subquads (tl, tr, bl, br). The x index is in the even bits,
+// the z index is in the odd bits.
+static const uint64_t kChildMortonBits[4] = {2, 3, 0, 1};
+
+static uint32_t CompactBits(uint64_t x) {
+  x &= 0x5555555555555555;
+  x = (x | (x >> 1)) & 0x3333333333333333;
+  x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0F;
+  x = (x | (x >> 4)) & 0x00FF00FF00FF00FF;
+  x = (x | (x >> 8)) & 0x0000FFFF0000FFFF;
+  x = (x | (x >> 16)) & 0x00000000FFFFFFFF;
+  return static_cast<uint32_t>(x);
+}
+
+constexpr uint64_t CdlodLinearQuadTree::kPageSize;
+
+CdlodLinearQuadTree::CdlodLinearQuadTree(size_t kFaceSize, CubeFace face,
+                                         const CdlodLodTable& lod_table,
+                                         const TerrainHeightQuery* terrain)
+  : max_node_level_(log2(kFaceSize) - Settings::kNodeDimensionExp)
+  , face_(face), lod_table_(lod_table), terrain_(terrain) {
+  assert(max_node_level_ < lod_table_.level_count());
+}
+
+size_t CdlodLinearQuadTree::resident_node_count() const {
+  size_t count = 0;
+  for (const auto& page : pages_) {
+    count += page.second->nodes.size();
+  }
+  return count;
+}
+
+glm::dvec2 CdlodLinearQuadTree::NodeCenter(int level, uint64_t morton) const {
+  double size = lod_table_[level].node_size;
+  return glm::dvec2{(CompactBits(morton) + 0.5) * size,
+                    (CompactBits(morton >> 1) + 0.5) * size};
+}
+
+CdlodLinearQuadTree::Page& CdlodLinearQuadTree::GetPage(int level,
+                                                        uint64_t morton) {
+  std::unique_ptr<Page>& page = pages_[PageKey(level, morton)];
+  if (!page) {
+    uint64_t level_node_count = uint64_t(1) << 2*(max_node_level_ - level);
+    page = make_unique<Page>();
+    page->nodes.resize(std::min(kPageSize, level_node_count));
+  }
+  page->last_used = frame_;
+  return *page;
+}
+
+CdlodLinearQuadTree::Node& CdlodLinearQuadTree::GetNode(Page& page, int level,
+                                                        uint64_t morton) {
+  Node& node = page.nodes[morton & (kPageSize - 1)];
+  if (!node.bbox) {
+    glm::dvec2 center = NodeCenter(level, morton);
+    page.boxes.push_back(CdlodNodeBox(center.x, center.y,
+                                      lod_table_[level].node_size,
+                                      face_, terrain_));
+    node.bbox = &page.boxes.back();
+  }
+
+  return node;
+}
+
+void CdlodLinearQuadTree::SelectNodes(const engine::Camera& cam,
+                                      QuadGridMesh& mesh) {
+  PROFILE_SCOPE("CdlodLinearQuadTree::SelectNodes");
+  const glm::dvec3& cam_pos = cam.pos();
+  const Frustum& frustum = cam.frustum();
+  ++frame_;
+
+  // Visits the nodes in the same order as the recursion of CdlodQuadTreeNode:
+  // a node is expanded on its way down, and renders the subquads that its
+  // children didn't, after all of its children are done.
+  stack_.clear();
+  Page& root_page = GetPage(max_node_level_, 0);
+  stack_.push_back(StackEntry{&GetNode(root_page, max_node_level_, 0), 0,
+                              max_node_level_, false, {}});
+  while (!stack_.empty()) {
+    StackEntry& entry = stack_.back();
+    glm::dvec2 center = NodeCenter(entry.level, entry.morton);
+
+    if (entry.expanded) {
+      if (entry.node->bbox->CollidesWithFrustum(frustum)) {
+        mesh.AddToRenderList(center.x, center.y, entry.level, int(face_),
+                             !entry.cc[0], !entry.cc[1],
+                             !entry.cc[2], !entry.cc[3],
+                             entry.node->bbox->DistanceFrom(cam_pos));
+      }
+      stack_.pop_back();
+      continue;
+    }
+
+    // If we can cover the whole area or if we are a leaf
+    Sphere sphere{cam_pos, lod_table_[entry.level].range};
+    if (entry.level <= Settings::kLevelOffset - Settings::kGeomDiv ||
+        !entry.node->bbox->CollidesWithSphere(sphere)) {
+      if (entry.node->bbox->CollidesWithFrustum(frustum)) {
+        mesh.AddToRenderList(center.x, center.y, entry.level, int(face_),
+                             entry.node->bbox->DistanceFrom(cam_pos));
+      }
+      stack_.pop_back();
+      continue;
+    }
+
+    entry.expanded = true;
+    int child_level = entry.level - 1;
+    uint64_t first_child = entry.morton << 2;
+    // The four children are always in the same page
+    Page& page = GetPage(child_level, first_child);
+    Node* children[4];
+    bool cc[4];
+    for (int i = 0; i < 4; ++i) {
+      children[i] = &GetNode(page, child_level,
+                             first_child | kChildMortonBits[i]);
+      cc[i] = children[i]->bbox->CollidesWithSphere(sphere);
+    }
+    std::copy(cc, cc + 4, entry.cc);
+
+    // Push in reverse, so the first child is processed first. This
+    // invalidates 'entry'.
+    for (int i = 3; i >= 0; --i) {
+      if (cc[i]) {
+        stack_.push_back(StackEntry{children[i],
+                                    first_child | kChildMortonBits[i],
+                                    child_level, false, {}});
+      }
+    }
+  }
+
+  FreeUnusedPages();
+}
+
+void CdlodLinearQuadTree::FreeUnusedPages() {
+  for (auto iter = pages_.begin(); iter != pages_.end();) {
+    if (frame_ - iter->second->last_used > kTimeToLiveInMemory) {
+      iter = pages_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
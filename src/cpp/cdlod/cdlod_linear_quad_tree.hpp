@@ -0,0 +1,85 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef CDLOD_LINEAR_QUAD_TREE_H_
+#define CDLOD_LINEAR_QUAD_TREE_H_
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "cdlod/quad_grid_mesh.hpp"
+#include "collision/spherized_aabb.hpp"
+#include "cdlod/cdlod_lod_table.hpp"
+#include "cdlod/cdlod_quad_tree_node.hpp"
+#include "engine/camera.hpp"
+
+// The same selection as CdlodQuadTree, but without node pointers or recursion.
+//
+// A node is addressed by its level and the Morton code of its position in the
+// grid of that level, so the children of node m are 4m..4m+3 on the level
+// below. The nodes are stored in pages of kPageSize nodes with consecutive
+// Morton codes, so the four children are always next to each other, and most
+// of a subtree is in the same page. The pages are created when the selection
+// first reaches them, and freed when none of their nodes were used for
+// kTimeToLiveInMemory frames. A node's bounding box (about 2 KB) is only made
+// when the selection reaches the node, and kept beside the page's node array,
+// so a page only pays for the nodes that were used. The traversal uses an
+// explicit stack.
+class CdlodLinearQuadTree {
+ public:
+  // The nodes' bounding boxes follow the terrain's heights, if it's given.
+  CdlodLinearQuadTree(size_t kFaceSize, CubeFace face,
+                      const CdlodLodTable& lod_table = CdlodLodTable::Default(),
+                      const TerrainHeightQuery* terrain = nullptr);
+  void SelectNodes(const engine::Camera& cam, QuadGridMesh& mesh);
+  size_t max_node_level() const { return max_node_level_; }
+
+  // The number of nodes in the allocated pages.
+  size_t resident_node_count() const;
+
+ private:
+  static constexpr int kPageSizeExp = 8;
+  static constexpr uint64_t kPageSize = 1 << kPageSizeExp;
+  static const int kTimeToLiveInMemory = 1 << 6;
+
+  struct Node {
+    const SpherizedAABBDivided* bbox = nullptr;  // in the page's boxes
+  };
+
+  struct Page {
+    std::vector<Node> nodes;
+    // The boxes of the initialized nodes, a deque doesn't move them.
+    std::deque<SpherizedAABBDivided> boxes;
+    uint64_t last_used = 0;  // frame index
+  };
+
+  struct StackEntry {
+    Node* node;
+    uint64_t morton;
+    int level;
+    bool expanded;
+    bool cc[4];  // children collision
+  };
+
+  int max_node_level_;
+  CubeFace face_;
+  const CdlodLodTable& lod_table_;
+  const TerrainHeightQuery* terrain_;
+  uint64_t frame_ = 0;
+
+  std::unordered_map<uint64_t, std::unique_ptr<Page>> pages_;
+  std::vector<StackEntry> stack_;
+
+  static uint64_t PageKey(int level, uint64_t morton) {
+    return (uint64_t(level) << 56) | (morton >> kPageSizeExp);
+  }
+
+  Page& GetPage(int level, uint64_t morton);
+  Node& GetNode(Page& page, int level, uint64_t morton);
+  glm::dvec2 NodeCenter(int level, uint64_t morton) const;
+  void FreeUnusedPages();
+};
+
+#endif
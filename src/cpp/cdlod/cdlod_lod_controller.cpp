@@ -0,0 +1,68 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "cdlod/cdlod_lod_controller.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+constexpr double CdlodLodController::kSmoothing;
+constexpr double CdlodLodController::kMaxStep;
+constexpr size_t CdlodLodController::kTelemetryWindow;
+
+CdlodLodController::CdlodLodController(double budget, double hysteresis,
+                                       double min_multiplier,
+                                       double max_multiplier)
+    : budget_(budget), hysteresis_(hysteresis)
+    , min_multiplier_(min_multiplier), max_multiplier_(max_multiplier) {
+  assert(budget > 0);
+  assert(0 < hysteresis && hysteresis < 1);
+  assert(0 < min_multiplier && min_multiplier <= 1 && 1 <= max_multiplier);
+}
+
+double CdlodLodController::Update(double measured) {
+  if (sample_count_ == 0) {
+    smoothed_ = measured;
+  } else {
+    smoothed_ += kSmoothing * (measured - smoothed_);
+  }
+
+  // Aim for the middle of the band, with a limited step
+  double low = budget_ * (1 - hysteresis_);
+  if (smoothed_ > budget_ || (smoothed_ < low && smoothed_ > 0)) {
+    double target = budget_ * (1 - hysteresis_/2);
+    double step = std::sqrt(target / std::max(smoothed_, 1e-6));
+    step = std::min(std::max(step, 1 / (1 + kMaxStep)), 1 + kMaxStep);
+    multiplier_ = std::min(std::max(multiplier_ * step, min_multiplier_),
+                           max_multiplier_);
+  }
+
+  Sample sample{measured, smoothed_, multiplier_};
+  if (telemetry_.size() < kTelemetryWindow) {
+    telemetry_.push_back(sample);
+  } else {
+    telemetry_[sample_count_ % kTelemetryWindow] = sample;
+  }
+  sample_count_++;
+  return multiplier_;
+}
+
+bool CdlodLodController::WriteTelemetry(const std::string& path) const {
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open '" << path << "' for writing." << std::endl;
+    return false;
+  }
+
+  file << "sample,measured,smoothed,multiplier" << std::endl;
+  // Oldest first, numbered from the start of the session
+  for (size_t i = sample_count_ - telemetry_.size(); i < sample_count_; ++i) {
+    const Sample& sample = telemetry_[i % kTelemetryWindow];
+    file << i << ',' << sample.measured << ',' << sample.smoothed << ','
+         << sample.multiplier << '\n';
+  }
+
+  return true;
+}
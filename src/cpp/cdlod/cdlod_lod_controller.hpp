@@ -0,0 +1,54 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef CDLOD_LOD_CONTROLLER_H_
+#define CDLOD_LOD_CONTROLLER_H_
+
+#include <string>
+#include <vector>
+
+// A feedback controller of the lod ranges' multiplier, that keeps a measured
+// cost of the frames (the frame time, or the number of instances) under a
+// budget.
+//
+// The cost is assumed to grow with the square of the multiplier (the area
+// inside the ranges), and is smoothed over a few frames. The multiplier is
+// only changed if the smoothed cost is over the budget, or under the budget by
+// more than the hysteresis, and by at most kMaxStep per frame, so the lod
+// doesn't oscillate around the budget, and the ranges don't change (and the
+// incremental selection doesn't have to retest) while the cost is inside the
+// band.
+class CdlodLodController {
+ public:
+  struct Sample {
+    double measured, smoothed, multiplier;
+  };
+
+  CdlodLodController(double budget, double hysteresis,
+                     double min_multiplier, double max_multiplier);
+
+  // Adds the cost of the last frame, and returns the multiplier of the next.
+  double Update(double measured);
+
+  double multiplier() const { return multiplier_; }
+  double budget() const { return budget_; }
+
+  // The number of Update()s since the start
+  size_t sample_count() const { return sample_count_; }
+  // Every Update()'s input and result, of the last kTelemetryWindow ones
+  bool WriteTelemetry(const std::string& path) const;
+
+ private:
+  static constexpr double kSmoothing = 0.1;
+  static constexpr double kMaxStep = 0.02;
+  // About 18 minutes at 60 FPS, in 1.5 MB
+  static constexpr size_t kTelemetryWindow = 1 << 16;
+
+  double budget_, hysteresis_, min_multiplier_, max_multiplier_;
+  double multiplier_ = 1.0;
+  double smoothed_ = 0.0;
+  // A ring buffer, the sample i is at i % kTelemetryWindow
+  std::vector<Sample> telemetry_;
+  size_t sample_count_ = 0;
+};
+
+#endif
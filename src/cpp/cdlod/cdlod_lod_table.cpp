@@ -0,0 +1,84 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "cdlod/cdlod_lod_table.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include "common/settings.hpp"
+
+constexpr double CdlodLodTable::kMinRangePerNodeSize;
+
+CdlodLodTable::CdlodLodTable(int max_level, double smallest_range,
+                             double range_ratio, double morph_start_ratio,
+                             double morph_end_ratio)
+    : levels_(max_level + 1), smallest_range_(smallest_range)
+    , range_ratio_(range_ratio), morph_start_ratio_(morph_start_ratio)
+    , morph_end_ratio_(morph_end_ratio) {
+  assert(0 <= max_level && max_level < kMaxLevelCount);
+  assert(range_ratio > 1.0);
+  assert(0.0 <= morph_start_ratio && morph_start_ratio < morph_end_ratio &&
+         morph_end_ratio <= 1.0);
+
+  Build();
+}
+
+const CdlodLodTable& CdlodLodTable::Default() {
+  static const CdlodLodTable table{
+      static_cast<int>(std::log2(Settings::kFaceSize)) - Settings::kNodeDimensionExp,
+      Settings::kSmallestGeometryLodDistance, Settings::kLodRangeRatio,
+      Settings::kLodMorphStartRatio, Settings::kLodMorphEndRatio};
+  return table;
+}
+
+double CdlodLodTable::ScreenSpaceErrorRange(double geometric_error,
+                                            double pixel_error,
+                                            const glm::dmat4& projection,
+                                            double viewport_height) {
+  // An error of e at distance d is e * projection[1][1] / d in NDC, which
+  // is half of the viewport's height.
+  double pixels_per_unit_at_unit_distance =
+      projection[1][1] * viewport_height / 2;
+  return geometric_error * pixels_per_unit_at_unit_distance / pixel_error;
+}
+
+void CdlodLodTable::set_smallest_range(double value) {
+  value = ClampedRange(0, value);
+  if (value != smallest_range_) {
+    smallest_range_ = value;
+    Build();
+    ++version_;
+  }
+}
+
+// Clamps a range to kMinRangePerNodeSize times the size of the level's nodes.
+double CdlodLodTable::ClampedRange(int level, double range) {
+  double node_size = Settings::kNodeDimension * std::ldexp(1.0, level);
+  return std::max(range, kMinRangePerNodeSize * node_size);
+}
+
+void CdlodLodTable::Build() {
+  double range = ClampedRange(0, smallest_range_);
+  for (int level = 0; level < level_count(); ++level) {
+    Level& current = levels_[level];
+    double next_range = ClampedRange(level + 1, range * range_ratio_);
+    current.range = range;
+    current.morph_start = range + morph_start_ratio_ * (next_range - range);
+    current.morph_end = range + morph_end_ratio_ * (next_range - range);
+    current.scale = std::ldexp(1.0, level);
+    current.node_size = Settings::kNodeDimension * current.scale;
+    range = next_range;
+  }
+}
+
+void CdlodLodTable::GetShaderTable(glm::vec4 (&table)[kMaxLevelCount]) const {
+  for (int level = 0; level < kMaxLevelCount; ++level) {
+    if (level < level_count()) {
+      const Level& current = levels_[level];
+      table[level] = glm::vec4(current.morph_start, current.morph_end,
+                               current.scale, 0);
+    } else {
+      table[level] = glm::vec4();
+    }
+  }
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef CDLOD_LOD_TABLE_H_
+#define CDLOD_LOD_TABLE_H_
+
+#include <vector>
+#include <cstdint>
+#include "common/glm.hpp"
+
+// The per level constants of the node selection and the vertex morphing,
+// computed once, instead of on every node visit and every vertex.
+//
+// A node is subdivided if the camera is closer to it than its level's range,
+// so the geometry of a level is used between its own range and the range of
+// the level above. The ranges grow by range_ratio per level, which doesn't
+// have to be two: a smaller ratio pulls the far ranges closer, which means
+// fewer fine level nodes and less detail. The vertices of a level morph into
+// the grid of the level above between the morph start and end, that are at the
+// given fractions of the way between the two ranges. For the morphing to work,
+// a level's range has to stay wider than the size of its nodes, so below a
+// ratio of two the ranges of the deeper levels are clamped to that.
+class CdlodLodTable {
+ public:
+  // The shader's table has this many entries.
+  static constexpr int kMaxLevelCount = 16;
+
+  // Every level's range is clamped to this times the size of its nodes, so
+  // the range of a node always covers more than its diagonal.
+  static constexpr double kMinRangePerNodeSize = 1.5;
+
+  struct Level {
+    double range;
+    double morph_start, morph_end;
+    double scale;      // 2^level, the size of a grid cell
+    double node_size;  // the size of a node
+  };
+
+  CdlodLodTable(int max_level, double smallest_range, double range_ratio,
+                double morph_start_ratio, double morph_end_ratio);
+
+  // The table made from the terrain settings
+  static const CdlodLodTable& Default();
+
+  // The smallest range, at which the level 0 geometry error, that grows with
+  // the level's scale, projects to pixel_error pixels on a screen that is
+  // viewport_height pixels tall.
+  static double ScreenSpaceErrorRange(double geometric_error, double pixel_error,
+                                      const glm::dmat4& projection,
+                                      double viewport_height);
+
+  const Level& operator[](int level) const { return levels_[level]; }
+  int level_count() const { return levels_.size(); }
+
+  // Changing the ranges rebuilds the table, and increments its version.
+  double smallest_range() const { return smallest_range_; }
+  void set_smallest_range(double value);
+
+  // Test results made with another version of the table are stale.
+  uint64_t version() const { return version_; }
+
+  // The shader's table, x: morph start, y: morph end, z: scale
+  void GetShaderTable(glm::vec4 (&table)[kMaxLevelCount]) const;
+
+ private:
+  std::vector<Level> levels_;
+  double smallest_range_, range_ratio_, morph_start_ratio_, morph_end_ratio_;
+  uint64_t version_ = 0;
+
+  static double ClampedRange(int level, double range);
+  void Build();
+};
+
+#endif
@@ -1,13 +1,58 @@
 // Copyright (c) 2016, Tamas Csala
 
+#include <cassert>
+#include <algorithm>
 #include "cdlod/cdlod_quad_tree.hpp"
+#include "engine/cpu_profiler.hpp"
 
-CdlodQuadTree::CdlodQuadTree(size_t kFaceSize, CubeFace face)
+CdlodQuadTree::CdlodQuadTree(size_t kFaceSize, CubeFace face,
+                             const CdlodLodTable& lod_table,
+                             const TerrainHeightQuery* terrain)
   : max_node_level_(log2(kFaceSize) - Settings::kNodeDimensionExp)
-  , root_(kFaceSize/2, kFaceSize/2, face, max_node_level_) {}
+  , root_(kFaceSize/2, kFaceSize/2, face, max_node_level_, lod_table,
+          terrain) {
+  assert(int(max_node_level_) < lod_table.level_count());
+  selection_state_.lod_table = &lod_table;
+  selection_state_.terrain = terrain;
+}
+
+// The bounding spheres of the nodes are centered on the planet's surface.
+static constexpr double kMaxBoundingSphereCenterDistance =
+    Settings::kSphereRadius + Settings::kMaxHeight;
 
 void CdlodQuadTree::SelectNodes(const engine::Camera& cam, QuadGridMesh& mesh) {
-  root_.SelectNodes(cam.transform().pos(), cam.frustum(), mesh);
+  PROFILE_SCOPE("CdlodQuadTree::SelectNodes");
+  CdlodSelectionState& state = selection_state_;
+  const glm::dvec3& cam_pos = cam.pos();
+  const Frustum& frustum = cam.frustum();
+
+  state.incremental = false;
+  if (has_selected_) {
+    // A plane's distance to a point (p) changes by at most
+    // |normal change| * |p| + |dist change|
+    double max_normal_change = 0, max_dist_change = 0;
+    for (int i = 0; i < 6; ++i) {
+      const Plane& plane = frustum.planes[i];
+      const Plane& prev_plane = state.frustum.planes[i];
+      max_normal_change = std::max(max_normal_change,
+                                   glm::length(plane.normal - prev_plane.normal));
+      max_dist_change = std::max(max_dist_change,
+                                 std::abs(plane.dist - prev_plane.dist));
+    }
+    double frustum_change = max_normal_change * kMaxBoundingSphereCenterDistance
+                            + max_dist_change;
+
+    // The drift has to include every frame, even the ones that retest
+    // everything, as the nodes outside the cut keep their older results.
+    state.frustum_drift += frustum_change;
+    state.incremental = incremental_ &&
+        glm::length(cam_pos - state.cam_pos) < Settings::kIncrementalSelectionMaxJump &&
+        frustum_change < Settings::kIncrementalSelectionMaxJump;
+  }
+  state.cam_pos = cam_pos;
+  state.frustum = frustum;
+  has_selected_ = true;
+
+  root_.SelectNodes(state, mesh);
   root_.Age();
 }
-
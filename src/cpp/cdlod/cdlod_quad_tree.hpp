@@ -10,11 +10,21 @@
 class CdlodQuadTree {
   size_t max_node_level_;
   CdlodQuadTreeNode root_;
+  CdlodSelectionState selection_state_;
+  bool incremental_ = Settings::kIncrementalSelection;
+  bool has_selected_ = false;
 
  public:
-  CdlodQuadTree(size_t kFaceSize, CubeFace face);
+  // The nodes' bounding boxes follow the terrain's heights, if it's given.
+  CdlodQuadTree(size_t kFaceSize, CubeFace face,
+                const CdlodLodTable& lod_table = CdlodLodTable::Default(),
+                const TerrainHeightQuery* terrain = nullptr);
   void SelectNodes(const engine::Camera& cam, QuadGridMesh& mesh);
   size_t max_node_level() const { return max_node_level_; }
+
+  // Whether the selection reuses the previous frames' test results.
+  bool incremental() const { return incremental_; }
+  void set_incremental(bool value) { incremental_ = value; }
 };
 
 #endif
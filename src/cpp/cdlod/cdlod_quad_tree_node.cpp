@@ -2,20 +2,32 @@
 
 #include <algorithm>
 #include "cdlod/cdlod_quad_tree_node.hpp"
+#include "cdlod/terrain_height_query.hpp"
 #include "collision/cube2sphere.hpp"
 
+SpherizedAABBDivided CdlodNodeBox(double x, double z, double size,
+                                  CubeFace face,
+                                  const TerrainHeightQuery* terrain) {
+  glm::dvec2 min_pos{x - size/2, z - size/2}, max_pos{x + size/2, z + size/2};
+  glm::dvec2 heights = terrain ?
+      terrain->HeightRange(face, min_pos, max_pos) : glm::dvec2();
+  return SpherizedAABBDivided{glm::dvec3{min_pos.x, heights.x, min_pos.y},
+                              glm::dvec3{max_pos.x, heights.y, max_pos.y},
+                              face, Settings::kFaceSize};
+}
+
 CdlodQuadTreeNode::CdlodQuadTreeNode(double x, double z, CubeFace face,
-                                     int level, CdlodQuadTreeNode* parent)
+                                     int level, const CdlodLodTable& lod_table,
+                                     const TerrainHeightQuery* terrain,
+                                     CdlodQuadTreeNode* parent)
     : x_(x), z_(z), face_(face), level_(level)
-    , bbox_{glm::vec3{x - size()/2, 0, z - size()/2},
-            glm::vec3{x + size()/2, 0, z + size()/2},
-            face, Settings::kFaceSize}
+    , bbox_(CdlodNodeBox(x, z, lod_table[level].node_size, face, terrain))
 { }
 
-void CdlodQuadTreeNode::InitChild(int i) {
+void CdlodQuadTreeNode::InitChild(int i, const CdlodSelectionState& state) {
   assert (0 <= i && i <= 3);
 
-  double s4 = size()/4, x, z;
+  double s4 = (*state.lod_table)[level_].node_size/4, x, z;
   if (i == 0) {
     x = x_-s4; z = z_+s4;
   } else if (i == 1) {
@@ -26,11 +38,12 @@ void CdlodQuadTreeNode::InitChild(int i) {
     x = x_+s4; z = z_-s4;
   }
 
-  children_[i] = make_unique<CdlodQuadTreeNode>(x, z, face_, level_-1, this);
+  children_[i] = make_unique<CdlodQuadTreeNode>(x, z, face_, level_-1,
+                                                *state.lod_table,
+                                                state.terrain, this);
 }
 
-void CdlodQuadTreeNode::SelectNodes(const glm::vec3& cam_pos,
-                                    const Frustum& frustum,
+void CdlodQuadTreeNode::SelectNodes(const CdlodSelectionState& state,
                                     QuadGridMesh& grid_mesh) {
   last_used_ = 0;
 
@@ -39,30 +52,33 @@ void CdlodQuadTreeNode::SelectNodes(const glm::vec3& cam_pos,
   // if (!bbox_.CollidesWithFrustum(frustum)) { return; }
 
   // If we can cover the whole area or if we are a leaf
-  Sphere sphere{cam_pos, Settings::kSmallestGeometryLodDistance * scale()};
-  if (!bbox_.CollidesWithSphere(sphere) ||
-      level_ <= Settings::kLevelOffset - Settings::kGeomDiv) {
-    if (bbox_.CollidesWithFrustum(frustum)) {
-      grid_mesh.AddToRenderList(x_, z_, level_, int(face_));
+  Sphere sphere{state.cam_pos, (*state.lod_table)[level_].range};
+  if (level_ <= Settings::kLevelOffset - Settings::kGeomDiv ||
+      !CollidesWithSphere(sphere, state, lod_test_)) {
+    if (CollidesWithFrustum(state)) {
+      grid_mesh.AddToRenderList(x_, z_, level_, int(face_),
+                                bbox_.DistanceFrom(state.cam_pos));
     }
   } else {
     bool cc[4]{}; // children collision
 
     for (int i = 0; i < 4; ++i) {
       if (!children_[i])
-        InitChild(i);
+        InitChild(i, state);
 
-      cc[i] = children_[i]->CollidesWithSphere(sphere);
+      CdlodQuadTreeNode& child = *children_[i];
+      cc[i] = child.CollidesWithSphere(sphere, state, child.parent_lod_test_);
       if (cc[i]) {
         // Ask child to render what we can't
-        children_[i]->SelectNodes(cam_pos, frustum, grid_mesh);
+        child.SelectNodes(state, grid_mesh);
       }
     }
 
-    if (bbox_.CollidesWithFrustum(frustum)) {
+    if (CollidesWithFrustum(state)) {
       // Render what the children didn't do
       grid_mesh.AddToRenderList(x_, z_, level_, int(face_),
-                                !cc[0], !cc[1], !cc[2], !cc[3]);
+                                !cc[0], !cc[1], !cc[2], !cc[3],
+                                bbox_.DistanceFrom(state.cam_pos));
     }
   }
 }
@@ -82,6 +98,24 @@ void CdlodQuadTreeNode::Age() {
   }
 }
 
-bool CdlodQuadTreeNode::CollidesWithSphere(const Sphere& sphere) const {
-  return bbox_.CollidesWithSphere(sphere);
+bool CdlodQuadTreeNode::CollidesWithSphere(const Sphere& sphere,
+                                           const CdlodSelectionState& state,
+                                           CachedSphereTest& cache) {
+  if (!state.incremental || cache.lod_version != state.lod_table->version() ||
+      glm::length(state.cam_pos - cache.cam_pos) >= cache.slack) {
+    cache.result = bbox_.CollidesWithSphere(sphere, cache.slack);
+    cache.cam_pos = state.cam_pos;
+    cache.lod_version = state.lod_table->version();
+  }
+  return cache.result;
+}
+
+bool CdlodQuadTreeNode::CollidesWithFrustum(const CdlodSelectionState& state) {
+  CachedFrustumTest& cache = frustum_test_;
+  if (!state.incremental ||
+      state.frustum_drift - cache.frustum_drift >= cache.slack) {
+    cache.result = bbox_.CollidesWithFrustum(state.frustum, cache.slack);
+    cache.frustum_drift = state.frustum_drift;
+  }
+  return cache.result;
 }
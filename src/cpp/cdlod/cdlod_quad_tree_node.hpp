@@ -6,16 +6,42 @@
 #include <memory>
 #include "cdlod/quad_grid_mesh.hpp"
 #include "collision/spherized_aabb.hpp"
+#include "cdlod/cdlod_lod_table.hpp"
+
+class TerrainHeightQuery;
+
+// The bounding box of a node, centered at x, z, between the lowest and the
+// highest terrain in it, so the lod ranges are measured from the terrain that
+// is really there. Without the terrain, the box is flat on the sphere.
+SpherizedAABBDivided CdlodNodeBox(double x, double z, double size,
+                                  CubeFace face,
+                                  const TerrainHeightQuery* terrain);
+
+// The camera and the lod ranges of a node selection.
+struct CdlodSelectionState {
+  const CdlodLodTable* lod_table = nullptr;
+  const TerrainHeightQuery* terrain = nullptr;
+  glm::dvec3 cam_pos;
+  Frustum frustum;
+
+  // An upper bound of how much the distance of any bounding sphere to any
+  // frustum plane could have changed since the first selection. Only grows.
+  double frustum_drift = 0;
+
+  // If set, the nodes reuse their earlier test results, that the camera's
+  // movement since then couldn't have changed.
+  bool incremental = false;
+};
 
 class CdlodQuadTreeNode {
  public:
   CdlodQuadTreeNode(double x, double z, CubeFace face, int level,
+                    const CdlodLodTable& lod_table,
+                    const TerrainHeightQuery* terrain = nullptr,
                     CdlodQuadTreeNode* parent = nullptr);
 
   void Age();
-  void SelectNodes(const glm::vec3& cam_pos,
-                   const Frustum& frustum,
-                   QuadGridMesh& grid_mesh);
+  void SelectNodes(const CdlodSelectionState& state, QuadGridMesh& grid_mesh);
 
  private:
   double x_, z_;
@@ -25,13 +51,33 @@ class CdlodQuadTreeNode {
   std::unique_ptr<CdlodQuadTreeNode> children_[4];
   int last_used_ = 0;
 
+  // A test result is valid while the camera is closer than slack to where it
+  // was at the test (or while the frustum drifted less than slack), and the
+  // lod ranges didn't change since.
+  struct CachedSphereTest {
+    glm::dvec3 cam_pos;
+    uint64_t lod_version = 0;
+    double slack = -1;
+    bool result = false;
+  };
+  struct CachedFrustumTest {
+    double frustum_drift = 0;
+    double slack = -1;
+    bool result = false;
+  };
+
+  // The tests against this node's and the parent's lod spheres, and the
+  // frustum.
+  CachedSphereTest lod_test_, parent_lod_test_;
+  CachedFrustumTest frustum_test_;
+
   // If a node is not used for this much time (frames), it will be unloaded.
   static const int kTimeToLiveInMemory = 1 << 6;
 
-  double scale() const { return pow(2, level_); }
-  double size() { return Settings::kNodeDimension * scale(); }
-  bool CollidesWithSphere(const Sphere& sphere) const;
-  void InitChild(int i);
+  bool CollidesWithSphere(const Sphere& sphere, const CdlodSelectionState& state,
+                          CachedSphereTest& cache);
+  bool CollidesWithFrustum(const CdlodSelectionState& state);
+  void InitChild(int i, const CdlodSelectionState& state);
 };
 
 #endif
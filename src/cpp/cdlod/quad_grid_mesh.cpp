@@ -2,6 +2,10 @@
 
 #include "cdlod/quad_grid_mesh.hpp"
 
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
 QuadGridMesh::QuadGridMesh(int dimension) : mesh_(dimension/2) {
   assert(2 <= dimension && dimension <= 256);
 }
@@ -10,32 +14,38 @@ QuadGridMesh::QuadGridMesh(int dimension) : mesh_(dimension/2) {
 // tl = top left, br = bottom right
 void QuadGridMesh::AddToRenderList(float offset_x, float offset_y,
                                    int level, int face,
-                                   bool tl, bool tr, bool bl, bool br) {
+                                   bool tl, bool tr, bool bl, bool br,
+                                   float distance) {
   glm::vec4 render_data(offset_x, offset_y, level, face);
   float dim4 = pow(2, level) * mesh_.dimension()/2; // our dimension / 4
   if (tl) {
     mesh_.AddToRenderList(render_data + glm::vec4(-dim4, dim4, 0, 0));
+    distances_.push_back(distance);
   }
   if (tr) {
     mesh_.AddToRenderList(render_data + glm::vec4(dim4, dim4, 0, 0));
+    distances_.push_back(distance);
   }
   if (bl) {
     mesh_.AddToRenderList(render_data + glm::vec4(-dim4, -dim4, 0, 0));
+    distances_.push_back(distance);
   }
   if (br) {
     mesh_.AddToRenderList(render_data + glm::vec4(dim4, -dim4, 0, 0));
+    distances_.push_back(distance);
   }
 }
 
 // Adds all four subquads
 void QuadGridMesh::AddToRenderList(float offset_x, float offset_y,
-                                   int level, int face) {
+                                   int level, int face, float distance) {
   AddToRenderList(offset_x, offset_y, level, face,
-                  true, true, true, true);
+                  true, true, true, true, distance);
 }
 
 void QuadGridMesh::ClearRenderList() {
   mesh_.ClearRenderList();
+  distances_.clear();
 }
 
 // void QuadGridMesh::render() {
@@ -45,3 +55,93 @@ void QuadGridMesh::ClearRenderList() {
 size_t QuadGridMesh::node_count() const {
   return mesh_.node_count();
 }
+
+// Interleaves the low 32 bits with zeros: 0b1011 -> 0b1000101
+static uint64_t SpreadBits(uint64_t x) {
+  x &= 0x00000000FFFFFFFF;
+  x = (x | (x << 16)) & 0x0000FFFF0000FFFF;
+  x = (x | (x << 8)) & 0x00FF00FF00FF00FF;
+  x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0F;
+  x = (x | (x << 2)) & 0x3333333333333333;
+  x = (x | (x << 1)) & 0x5555555555555555;
+  return x;
+}
+
+// The bucket of a distance is the number of edges at or below it.
+static uint64_t DistanceBucket(const std::vector<float>& edges,
+                               float distance) {
+  return std::upper_bound(edges.begin(), edges.end(), distance) -
+         edges.begin();
+}
+
+void QuadGridMesh::SortRenderList(const CdlodLodTable* lod_table) {
+  std::vector<glm::vec4>& render_data = mesh_.render_data_;
+
+  // Four buckets between every two ranges, at most 4 * kMaxLevelCount + 1,
+  // so a bucket fits into a byte of the key
+  const bool front_to_back = lod_table != nullptr;
+  bucket_edges_.clear();
+  if (front_to_back) {
+    const CdlodLodTable& table = *lod_table;
+    for (int level = 0; level + 1 < table.level_count(); ++level) {
+      double range = table[level].range;
+      double next_range = table[level + 1].range;
+      for (int i = 0; i < 4; ++i) {
+        bucket_edges_.push_back(range + i * (next_range - range) / 4);
+      }
+    }
+    bucket_edges_.push_back(table[table.level_count() - 1].range);
+  }
+
+  std::vector<KeyedInstance>& src = sort_buffers_[0];
+  std::vector<KeyedInstance>& dst = sort_buffers_[1];
+  src.resize(render_data.size());
+  dst.resize(render_data.size());
+
+  // The size of the smallest subquad is the unit of the grid, so a Morton code
+  // fits into 40 bits on any sensible face size. The distance bucket goes
+  // above that, and the face to the top.
+  uint64_t all_bits = 0, common_bits = ~uint64_t(0);
+  for (size_t i = 0; i < render_data.size(); ++i) {
+    const glm::vec4& data = render_data[i];
+    double size = std::pow(2, data.z) * mesh_.dimension();
+    uint64_t x = static_cast<uint64_t>((data.x - size/2) / mesh_.dimension());
+    uint64_t y = static_cast<uint64_t>((data.y - size/2) / mesh_.dimension());
+    uint64_t key = (uint64_t(data.w) << 61) |
+                   (SpreadBits(x) | (SpreadBits(y) << 1));
+    if (front_to_back) {
+      key |= DistanceBucket(bucket_edges_, distances_[i]) << 40;
+    }
+    src[i] = KeyedInstance{key, data, distances_[i]};
+    all_bits |= key;
+    common_bits &= key;
+  }
+
+  // LSD radix sort, one byte per pass. The passes over a byte, that is the
+  // same in every key, can be skipped.
+  for (int shift = 0; shift < 64; shift += 8) {
+    if ((((all_bits ^ common_bits) >> shift) & 0xFF) == 0) {
+      continue;
+    }
+
+    size_t offsets[256] = {};
+    for (const KeyedInstance& instance : src) {
+      offsets[(instance.key >> shift) & 0xFF]++;
+    }
+    size_t sum = 0;
+    for (size_t& offset : offsets) {
+      size_t count = offset;
+      offset = sum;
+      sum += count;
+    }
+    for (const KeyedInstance& instance : src) {
+      dst[offsets[(instance.key >> shift) & 0xFF]++] = instance;
+    }
+    std::swap(src, dst);
+  }
+
+  for (size_t i = 0; i < render_data.size(); ++i) {
+    render_data[i] = src[i].render_data;
+    distances_[i] = src[i].distance;
+  }
+}
@@ -5,6 +5,7 @@
 
 #include "common/settings.hpp"
 #include "cdlod/grid_mesh.hpp"
+#include "cdlod/cdlod_lod_table.hpp"
 
 // Makes up four, separately renderable GridMeshes.
 class QuadGridMesh {
@@ -16,13 +17,42 @@ class QuadGridMesh {
   QuadGridMesh(int dimension = Settings::kNodeDimension);
 
   // Adds a subquad to the render list. tl = top left, br = bottom right
+  // The distance of the node from the camera is only used for sorting.
   void AddToRenderList(float offset_x, float offset_y, int level, int face,
-                       bool tl, bool tr, bool bl, bool br);
+                       bool tl, bool tr, bool bl, bool br,
+                       float distance = 0.0f);
   // Adds all four subquads
-  void AddToRenderList(float offset_x, float offset_y, int level, int face);
+  void AddToRenderList(float offset_x, float offset_y, int level, int face,
+                       float distance = 0.0f);
   void ClearRenderList();
   // void render();
   size_t node_count() const;
+
+  // The distances of the instances in the render list.
+  const std::vector<float>& distances() const { return distances_; }
+
+  // Sorts the render list by face, then by the Morton order of the subquads,
+  // so the consecutive instances are close to each other on the heightmap.
+  // The subquads of a face don't overlap, so their Morton codes of the
+  // corners on the finest grid give a valid Z-order across levels.
+  //
+  // If a lod table is given, the instances of a face are first sorted into
+  // coarse distance buckets, nearest first, so the nearer terrain can occlude
+  // the farther before it's shaded. The buckets split the space between every
+  // two lod ranges of the table into four. The Morton order is kept inside a
+  // bucket.
+  void SortRenderList(const CdlodLodTable* lod_table = nullptr);
+
+ private:
+  std::vector<float> distances_;
+  std::vector<float> bucket_edges_;
+
+  struct KeyedInstance {
+    uint64_t key;
+    glm::vec4 render_data;
+    float distance;
+  };
+  std::vector<KeyedInstance> sort_buffers_[2];
 };
 
 #endif
@@ -0,0 +1,262 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "cdlod/terrain_height_query.hpp"
+
+#include <cmath>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <lodepng.h>
+
+#include "engine/job_system.hpp"
+
+TerrainHeightQuery::TerrainHeightQuery(int texture_size,
+                                       std::vector<uint16_t> faces[6],
+                                       double face_size, double max_height)
+    : texture_size_(texture_size), face_size_(face_size)
+    , max_height_(max_height) {
+  for (int i = 0; i < 6; ++i) {
+    if (faces[i].size() != size_t(texture_size) * texture_size) {
+      throw std::invalid_argument("The heightmaps have to be the same size.");
+    }
+    faces_[i] = std::move(faces[i]);
+    BuildPyramid(i);
+  }
+}
+
+void TerrainHeightQuery::BuildPyramid(int face) {
+  std::vector<std::vector<TexelRange>>& pyramid = pyramids_[face];
+  int below_size = texture_size_;
+  while (below_size > 1) {
+    // The last cell of an odd sized level only covers one cell below
+    const int size = (below_size + 1) / 2;
+    std::vector<TexelRange> level(size_t(size) * size);
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        TexelRange range{UINT16_MAX, 0};
+        for (int by = 2*y; by < std::min(2*y + 2, below_size); ++by) {
+          for (int bx = 2*x; bx < std::min(2*x + 2, below_size); ++bx) {
+            TexelRange below;
+            if (pyramid.empty()) {
+              below.min = below.max = faces_[face][by*below_size + bx];
+            } else {
+              below = pyramid.back()[by*below_size + bx];
+            }
+            range.min = std::min(range.min, below.min);
+            range.max = std::max(range.max, below.max);
+          }
+        }
+        level[y*size + x] = range;
+      }
+    }
+    pyramid.push_back(std::move(level));
+    below_size = size;
+  }
+}
+
+TerrainHeightQuery TerrainHeightQuery::Load(const std::string& directory,
+                                            double face_size,
+                                            double max_height) {
+  std::vector<uint16_t> faces[6];
+  unsigned texture_size = 0;
+  for (int i = 0; i < 6; ++i) {
+    std::string path = directory + "/" + std::to_string(i) + ".png";
+    std::vector<unsigned char> image;
+    unsigned width, height;
+    unsigned error = lodepng::decode(image, width, height, path, LCT_GREY, 16);
+    if (error) {
+      throw std::runtime_error("Couldn't load '" + path + "': " +
+                               lodepng_error_text(error));
+    }
+    if (width != height || (i > 0 && width != texture_size)) {
+      throw std::runtime_error("The heightmaps have to be the same size.");
+    }
+    texture_size = width;
+
+    // lodepng gives the 16 bit values in big endian
+    faces[i].resize(image.size() / 2);
+    for (size_t j = 0; j < faces[i].size(); ++j) {
+      faces[i][j] = (image[2*j] << 8) | image[2*j + 1];
+    }
+  }
+
+  return TerrainHeightQuery(texture_size, faces, face_size, max_height);
+}
+
+// GetTexcoord of simple.vert in texels, relative to the texel centers
+glm::dvec2 TerrainHeightQuery::TexelPosition(const glm::dvec2& face_pos) const {
+  const int size = texture_size_;
+  glm::dvec2 texel = (face_pos / face_size_ + 3.0 / size) * (size - 6.0) - 0.5;
+  return glm::clamp(texel, glm::dvec2(0.0), glm::dvec2(size - 1));
+}
+
+TerrainHeightQuery::TexelQuad TerrainHeightQuery::TexelsAround(
+    const glm::dvec2& face_pos) const {
+  const int size = texture_size_;
+  const glm::dvec2 texel = TexelPosition(face_pos);
+
+  TexelQuad quad;
+  quad.x0 = int(texel.x);
+  quad.y0 = int(texel.y);
+  quad.x1 = std::min(quad.x0 + 1, size - 1);
+  quad.y1 = std::min(quad.y0 + 1, size - 1);
+  quad.fx = texel.x - quad.x0;
+  quad.fy = texel.y - quad.y0;
+  return quad;
+}
+
+double TerrainHeightQuery::HeightAt(CubeFace face,
+                                    const glm::dvec2& face_pos) const {
+  const int size = texture_size_;
+  const TexelQuad q = TexelsAround(face_pos);
+
+  const uint16_t* texels = faces_[int(face)].data();
+  double top = glm::mix(double(texels[q.y0*size + q.x0]),
+                        double(texels[q.y0*size + q.x1]), q.fx);
+  double bottom = glm::mix(double(texels[q.y1*size + q.x0]),
+                           double(texels[q.y1*size + q.x1]), q.fx);
+  return glm::mix(top, bottom, q.fy) * (max_height_ / 65535.0);
+}
+
+double TerrainHeightQuery::MaxHeightAt(CubeFace face,
+                                       const glm::dvec2& face_pos) const {
+  const int size = texture_size_;
+  const TexelQuad q = TexelsAround(face_pos);
+
+  const uint16_t* texels = faces_[int(face)].data();
+  uint16_t highest = std::max(
+      std::max(texels[q.y0*size + q.x0], texels[q.y0*size + q.x1]),
+      std::max(texels[q.y1*size + q.x0], texels[q.y1*size + q.x1]));
+  return highest * (max_height_ / 65535.0);
+}
+
+glm::dvec2 TerrainHeightQuery::HeightRange(CubeFace face,
+                                           const glm::dvec2& min_pos,
+                                           const glm::dvec2& max_pos) const {
+  const int size = texture_size_;
+  const glm::dvec2 min_texel = TexelPosition(min_pos);
+  const glm::dvec2 max_texel = TexelPosition(max_pos);
+  // The texels of the bilinear interpolation, that the nearest ones are in
+  int x0 = int(min_texel.x), y0 = int(min_texel.y);
+  int x1 = std::min(int(max_texel.x) + 1, size - 1);
+  int y1 = std::min(int(max_texel.y) + 1, size - 1);
+
+  // The first level where the rectangle is at most 2x2 cells
+  int level = 0;
+  while ((x1 >> level) - (x0 >> level) > 1 ||
+         (y1 >> level) - (y0 >> level) > 1) {
+    ++level;
+  }
+
+  TexelRange range{UINT16_MAX, 0};
+  const int level_size = level == 0 ? size : (size - 1) / (1 << level) + 1;
+  for (int y = y0 >> level; y <= y1 >> level; ++y) {
+    for (int x = x0 >> level; x <= x1 >> level; ++x) {
+      TexelRange cell;
+      if (level == 0) {
+        cell.min = cell.max = faces_[int(face)][y*size + x];
+      } else {
+        cell = pyramids_[int(face)][level - 1][y*level_size + x];
+      }
+      range.min = std::min(range.min, cell.min);
+      range.max = std::max(range.max, cell.max);
+    }
+  }
+
+  return glm::dvec2(range.min, range.max) * (max_height_ / 65535.0);
+}
+
+double TerrainHeightQuery::MaxHeightAt(const glm::dvec3& world_pos) const {
+  CubeFace face;
+  glm::dvec3 face_pos = Sphere2Cube(world_pos, &face, face_size_);
+  return MaxHeightAt(face, glm::dvec2(face_pos.x, face_pos.z));
+}
+
+double TerrainHeightQuery::HeightAt(const glm::dvec3& world_pos) const {
+  CubeFace face;
+  glm::dvec3 face_pos = Sphere2Cube(world_pos, &face, face_size_);
+  return HeightAt(face, glm::dvec2(face_pos.x, face_pos.z));
+}
+
+double TerrainHeightQuery::HeightAt(double latitude, double longitude) const {
+  return HeightAt(glm::dvec3(cos(latitude) * cos(longitude),
+                             sin(latitude),
+                             cos(latitude) * sin(longitude)));
+}
+
+glm::dvec3 TerrainHeightQuery::ClampAboveGround(const glm::dvec3& world_pos,
+                                                double clearance) const {
+  double radius = glm::length(world_pos);
+  double min_radius =
+      Settings::kSphereRadius + MaxHeightAt(world_pos) + clearance;
+  return radius < min_radius ? world_pos * (min_radius / radius) : world_pos;
+}
+
+// Calls function(i, face, face_pos) for the world positions from begin to
+// end. They are converted to face local positions in blocks small enough to
+// stay in the cache, with the batch Sphere2Cube, that the compiler vectorizes.
+template<typename Function>
+static void ForEachFacePos(const glm::dvec3* world_positions, size_t begin,
+                           size_t end, double face_size, Function function) {
+  constexpr size_t kBlockSize = 256;
+  double world_x[kBlockSize], world_y[kBlockSize], world_z[kBlockSize];
+  double local_x[kBlockSize], local_y[kBlockSize], local_z[kBlockSize];
+  CubeFace faces[kBlockSize];
+
+  for (size_t block = begin; block < end; block += kBlockSize) {
+    size_t count = std::min(kBlockSize, end - block);
+    for (size_t i = 0; i < count; ++i) {
+      world_x[i] = world_positions[block + i].x;
+      world_y[i] = world_positions[block + i].y;
+      world_z[i] = world_positions[block + i].z;
+    }
+    Sphere2Cube(PointArrays<const double>{world_x, world_y, world_z}, count,
+                face_size, PointArrays<double>{local_x, local_y, local_z},
+                faces);
+    for (size_t i = 0; i < count; ++i) {
+      function(block + i, faces[i], glm::dvec2(local_x[i], local_z[i]));
+    }
+  }
+}
+
+void TerrainHeightQuery::HeightsAt(const glm::dvec3* world_positions,
+                                   size_t count, double* heights,
+                                   engine::JobSystem* job_system) const {
+  ForEachChunk(count, job_system, [&](size_t begin, size_t end) {
+    ForEachFacePos(world_positions, begin, end, face_size_,
+                   [&](size_t i, CubeFace face, const glm::dvec2& face_pos) {
+      heights[i] = HeightAt(face, face_pos);
+    });
+  });
+}
+
+void TerrainHeightQuery::ClampAboveGround(glm::dvec3* world_positions,
+                                          size_t count, double clearance,
+                                          engine::JobSystem* job_system) const {
+  ForEachChunk(count, job_system, [&](size_t begin, size_t end) {
+    ForEachFacePos(world_positions, begin, end, face_size_,
+                   [&](size_t i, CubeFace face, const glm::dvec2& face_pos) {
+      glm::dvec3& world_pos = world_positions[i];
+      double radius = glm::length(world_pos);
+      double min_radius = Settings::kSphereRadius +
+                          MaxHeightAt(face, face_pos) + clearance;
+      if (radius < min_radius) {
+        world_pos *= min_radius / radius;
+      }
+    });
+  });
+}
+
+void TerrainHeightQuery::ForEachChunk(
+    size_t count, engine::JobSystem* job_system,
+    const std::function<void(size_t, size_t)>& function) const {
+  if (!job_system || count <= kChunkSize) {
+    function(0, count);
+    return;
+  }
+
+  size_t chunk_count = (count + kChunkSize - 1) / kChunkSize;
+  job_system->ParallelFor(chunk_count, [&](size_t chunk) {
+    function(chunk * kChunkSize, std::min(count, (chunk + 1) * kChunkSize));
+  });
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef CDLOD_TERRAIN_HEIGHT_QUERY_H_
+#define CDLOD_TERRAIN_HEIGHT_QUERY_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "common/glm.hpp"
+#include "common/settings.hpp"
+#include "collision/cube2sphere.hpp"
+
+namespace engine {
+class JobSystem;
+}
+
+// Answers the terrain height queries on the CPU, from a copy of the heightmaps
+// that the vertex shader samples (for ex. to keep the camera above the ground,
+// or to put objects on it).
+//
+// The texture coordinates are the same as simple.vert's GetTexcoord, but the
+// heights are interpolated bilinearly, while the shader's sampler is nearest,
+// so the drawn terrain can be off by the height difference of two texels.
+// MaxHeightAt() is the highest of the texels around the position instead, that
+// the shader's sample is one of, so nothing is drawn above it.
+//
+// Every query is const, so any number of threads can query at the same time.
+class TerrainHeightQuery {
+ public:
+  // The batches are split between the threads in chunks of this many queries.
+  static constexpr size_t kChunkSize = 4096;
+
+  // The faces are moved from. Their heightmaps have to be texture_size square,
+  // and their 16 bit texels are scaled to [0, max_height].
+  TerrainHeightQuery(int texture_size, std::vector<uint16_t> faces[6],
+                     double face_size = Settings::kFaceSize,
+                     double max_height = Settings::kMaxHeight);
+
+  // Loads the 16 bit grayscale heightmaps from "<directory>/<face>.png".
+  // Throws std::runtime_error if one can't be loaded.
+  static TerrainHeightQuery Load(const std::string& directory,
+                                 double face_size = Settings::kFaceSize,
+                                 double max_height = Settings::kMaxHeight);
+
+  int texture_size() const { return texture_size_; }
+
+  // The height above the sphere, at the face local position (the xz of the
+  // quadtree's coordinates).
+  double HeightAt(CubeFace face, const glm::dvec2& face_pos) const;
+
+  // The height of the terrain below (or above) the world position.
+  double HeightAt(const glm::dvec3& world_pos) const;
+
+  // The latitude is positive towards +y, and the longitude is measured from
+  // +x towards +z, both in radians.
+  double HeightAt(double latitude, double longitude) const;
+
+  // The highest of the 2x2 texels that HeightAt() interpolates between.
+  double MaxHeightAt(CubeFace face, const glm::dvec2& face_pos) const;
+  double MaxHeightAt(const glm::dvec3& world_pos) const;
+
+  // The lowest (x) and the highest (y) height of the texels that the heights
+  // in the face local rectangle are interpolated from. It's looked up in a
+  // min-max pyramid of the heightmap, so it's about as fast for any size, but
+  // the bigger rectangles can get a wider range than their texels have.
+  glm::dvec2 HeightRange(CubeFace face, const glm::dvec2& min_pos,
+                         const glm::dvec2& max_pos) const;
+
+  // The 16 bit heightmap of the face, row by row.
+  const std::vector<uint16_t>& heightmap(CubeFace face) const {
+    return faces_[int(face)];
+  }
+
+  // The pos if it's at least clearance above the terrain (its MaxHeightAt),
+  // otherwise the point clearance above the terrain, in the same direction
+  // from the center.
+  glm::dvec3 ClampAboveGround(const glm::dvec3& world_pos,
+                              double clearance = 0) const;
+
+  // The batch versions, that map the positions onto the cube with the batch
+  // Sphere2Cube, so their heights can differ from the single queries' in the
+  // last bits. With a job system, the batches bigger than kChunkSize are split
+  // between its threads. It can't be called from a job of the same job system.
+  void HeightsAt(const glm::dvec3* world_positions, size_t count,
+                 double* heights, engine::JobSystem* job_system = nullptr) const;
+  void ClampAboveGround(glm::dvec3* world_positions, size_t count,
+                        double clearance = 0,
+                        engine::JobSystem* job_system = nullptr) const;
+
+ private:
+  struct TexelRange {
+    uint16_t min, max;
+  };
+
+  int texture_size_;
+  std::vector<uint16_t> faces_[6];
+  // Level k's cells are the ranges of 2^k x 2^k texels, row by row, from
+  // level 1 up to a single cell.
+  std::vector<std::vector<TexelRange>> pyramids_[6];
+  double face_size_, max_height_;
+
+  void BuildPyramid(int face);
+
+  // The texels around the face position, and its place between them.
+  struct TexelQuad {
+    int x0, y0, x1, y1;
+    double fx, fy;
+  };
+  TexelQuad TexelsAround(const glm::dvec2& face_pos) const;
+  glm::dvec2 TexelPosition(const glm::dvec2& face_pos) const;
+
+  void ForEachChunk(size_t count, engine::JobSystem* job_system,
+                    const std::function<void(size_t, size_t)>& function) const;
+};
+
+#endif
@@ -1,6 +1,9 @@
 // Copyright (c) 2016, Tamas Csala
 
 #include "collision/cube2sphere.hpp"
+
+#include <cmath>
+#include <algorithm>
 #include "common/settings.hpp"
 
 static glm::dvec3 Cubify(const glm::dvec3& p) {
@@ -33,3 +36,162 @@ glm::dvec3 Cube2Sphere(const glm::dvec3& pos,
   return (Settings::kSphereRadius + pos.y) * Cubify(posOnCube);
 }
 
+
+// On the face where the point's other coordinate is +-1, Cubify maps the
+// (a, b) of the face to
+//   a' = a * sqrt(1/2 - b^2/6), b' = b * sqrt(1/2 - a^2/6)
+// Subtracting the squares gives a^2 - b^2 = 2*(a'^2 - b'^2), and putting that
+// back gives a quadratic for each of a^2 and b^2, whose smaller root is the
+// one in [0, 1]. It's written in the form that doesn't cancel near zero.
+static glm::dvec2 Decubify(double a, double b) {
+  double a2 = Sqr(a), b2 = Sqr(b), d = a2 - b2;
+  double root = sqrt(std::max(Sqr(3 + 2*d) - 24*a2, 0.0));
+  return {
+    std::copysign(sqrt(12*a2 / (3 + 2*d + root)), a),
+    std::copysign(sqrt(12*b2 / (3 - 2*d + root)), b)
+  };
+}
+
+static glm::dvec3 UnitCubeToFaceLocal(const glm::dvec3& p, double height,
+                                      CubeFace* face, double kFaceSize) {
+  // The inverse of the swizzles of FaceLocalToUnitCube, where n.y is -1
+  glm::dvec2 n;
+  glm::dvec3 a = glm::abs(p);
+  if (a.x >= a.y && a.x >= a.z) {
+    *face = p.x > 0 ? CubeFace::kPosX : CubeFace::kNegX;
+    n = p.x > 0 ? glm::dvec2(-p.z, -p.y) : glm::dvec2(+p.z, -p.y);
+  } else if (a.y >= a.z) {
+    *face = p.y > 0 ? CubeFace::kPosY : CubeFace::kNegY;
+    n = p.y > 0 ? glm::dvec2(+p.z, -p.x) : glm::dvec2(+p.z, +p.x);
+  } else {
+    *face = p.z < 0 ? CubeFace::kPosZ : CubeFace::kNegZ;
+    n = p.z < 0 ? glm::dvec2(-p.x, -p.y) : glm::dvec2(+p.x, -p.y);
+  }
+  return {(n.x + 1) * (kFaceSize/2), height, (n.y + 1) * (kFaceSize/2)};
+}
+
+glm::dvec3 Sphere2Cube(const glm::dvec3& pos,
+                       CubeFace* face,
+                       double kFaceSize) {
+  double radius = glm::length(pos);
+  glm::dvec3 dir = pos / radius;
+  glm::dvec3 a = glm::abs(dir);
+
+  // Cubify keeps the largest coordinate the largest, so that is the face
+  glm::dvec3 posOnCube;
+  if (a.x >= a.y && a.x >= a.z) {
+    glm::dvec2 yz = Decubify(dir.y, dir.z);
+    posOnCube = {std::copysign(1.0, dir.x), yz.x, yz.y};
+  } else if (a.y >= a.z) {
+    glm::dvec2 zx = Decubify(dir.z, dir.x);
+    posOnCube = {zx.y, std::copysign(1.0, dir.y), zx.x};
+  } else {
+    glm::dvec2 xy = Decubify(dir.x, dir.y);
+    posOnCube = {xy.x, xy.y, std::copysign(1.0, dir.z)};
+  }
+
+  return UnitCubeToFaceLocal(posOnCube, radius - Settings::kSphereRadius,
+                             face, kFaceSize);
+}
+
+// The batch loops can't switch on the face, that would keep them from being
+// vectorized, so they select the swizzles' components by the face's axis (its
+// index / 2) and sign (its index % 2). The pointers are restrict, otherwise
+// the compiler would have to test the overlap of seven arrays at run time, and
+// it gives up on vectorizing over ten such tests.
+template<typename T>
+static void Cube2SphereBatch(const T* __restrict in_x, const T* __restrict in_y,
+                             const T* __restrict in_z,
+                             const CubeFace* __restrict faces, size_t count,
+                             double kFaceSize, T* __restrict out_x,
+                             T* __restrict out_y, T* __restrict out_z) {
+  const T half_size = T(kFaceSize / 2);
+  const T sphere_radius = T(Settings::kSphereRadius);
+  for (size_t i = 0; i < count; ++i) {
+    T nx = in_x[i] / half_size - 1, nz = in_z[i] / half_size - 1;
+    T radius = sphere_radius + in_y[i];
+
+    // Cubify of (nx, -1, nz), with the 1 - y^2/2 = 1/2 simplifications
+    T cx = radius * nx * std::sqrt(T(0.5) - Sqr(nz)/6);
+    T cy = -radius * std::sqrt(1 - Sqr(nx)/2 - Sqr(nz)/2 + Sqr(nx*nz)/3);
+    T cz = radius * nz * std::sqrt(T(0.5) - Sqr(nx)/6);
+
+    int face = static_cast<int>(faces[i]);
+    bool x_axis = face < 2, y_axis = (face >> 1) == 1;
+    T sign = (face & 1) ? T(1) : T(-1);
+    out_x[i] = sign * (x_axis ? cy : y_axis ? cz : cx);
+    out_y[i] = y_axis ? sign * cy : -cz;
+    out_z[i] = x_axis ? sign * cx : y_axis ? cx : -sign * cy;
+  }
+}
+
+// The index of the largest coordinate, with the ties broken like Sphere2Cube.
+// It's a T, as mixing it with 64 bit lanes would keep the double loop from
+// being vectorized without AVX.
+template<typename T>
+static T MajorAxis(T x, T y, T z) {
+  T ax = std::abs(x), ay = std::abs(y), az = std::abs(z);
+  return ((ax >= ay) & (ax >= az)) ? T(0) : (ay >= az ? T(1) : T(2));
+}
+
+template<typename T>
+static void Sphere2CubeBatch(const T* __restrict in_x, const T* __restrict in_y,
+                             const T* __restrict in_z, size_t count,
+                             double kFaceSize, T* __restrict out_x,
+                             T* __restrict out_y, T* __restrict out_z,
+                             CubeFace* __restrict faces) {
+  const T half_size = T(kFaceSize / 2);
+  const T sphere_radius = T(Settings::kSphereRadius);
+  for (size_t i = 0; i < count; ++i) {
+    T x = in_x[i], y = in_y[i], z = in_z[i];
+    T radius = std::sqrt(x*x + y*y + z*z);
+    T axis = MajorAxis(x, y, z);
+    T major = axis == 0 ? x : axis == 1 ? y : z;
+    T sign = major > 0 ? T(1) : T(-1);
+
+    // The face local direction. The swizzles only swap and negate the
+    // coordinates, and so does Decubify, so it can be undone after it.
+    T a = (axis == 0 ? -sign * z : axis == 1 ? z : sign * x) / radius;
+    T b = (axis == 1 ? -sign * x : -y) / radius;
+
+    // Decubify
+    T a2 = Sqr(a), b2 = Sqr(b), d = a2 - b2;
+    T root = std::sqrt(std::max(Sqr(3 + 2*d) - 24*a2, T(0)));
+    T u = std::copysign(std::sqrt(12*a2 / (3 + 2*d + root)), a);
+    T v = std::copysign(std::sqrt(12*b2 / (3 - 2*d + root)), b);
+
+    out_x[i] = (u + 1) * half_size;
+    out_y[i] = radius - sphere_radius;
+    out_z[i] = (v + 1) * half_size;
+
+    // The positive z face is at z = -1
+    T facing = axis == 2 ? -major : major;
+    faces[i] = static_cast<CubeFace>(2*axis + (facing > 0 ? T(0) : T(1)));
+  }
+}
+
+void Cube2Sphere(PointArrays<const float> face_local, const CubeFace* faces,
+                 size_t count, double kFaceSize, PointArrays<float> world) {
+  Cube2SphereBatch(face_local.x, face_local.y, face_local.z, faces, count,
+                   kFaceSize, world.x, world.y, world.z);
+}
+
+void Cube2Sphere(PointArrays<const double> face_local, const CubeFace* faces,
+                 size_t count, double kFaceSize, PointArrays<double> world) {
+  Cube2SphereBatch(face_local.x, face_local.y, face_local.z, faces, count,
+                   kFaceSize, world.x, world.y, world.z);
+}
+
+void Sphere2Cube(PointArrays<const float> world, size_t count,
+                 double kFaceSize, PointArrays<float> face_local,
+                 CubeFace* faces) {
+  Sphere2CubeBatch(world.x, world.y, world.z, count, kFaceSize,
+                   face_local.x, face_local.y, face_local.z, faces);
+}
+
+void Sphere2Cube(PointArrays<const double> world, size_t count,
+                 double kFaceSize, PointArrays<double> face_local,
+                 CubeFace* faces) {
+  Sphere2CubeBatch(world.x, world.y, world.z, count, kFaceSize,
+                   face_local.x, face_local.y, face_local.z, faces);
+}
@@ -3,6 +3,7 @@
 #ifndef COLLISION_CUBE2SPHERE_H_
 #define COLLISION_CUBE2SPHERE_H_
 
+#include <cstddef>
 #include "common/glm.hpp"
 
 enum class CubeFace {
@@ -11,5 +12,34 @@ enum class CubeFace {
 
 glm::dvec3 Cube2Sphere(const glm::dvec3& pos, CubeFace face, double kFaceSize);
 
+// The inverse of Cube2Sphere: returns the face local position (with the height
+// above the sphere in y) of pos, and the face it's on. The pos can't be the
+// center of the sphere.
+glm::dvec3 Sphere2Cube(const glm::dvec3& pos, CubeFace* face, double kFaceSize);
+
+// The x, y and z coordinates of points, in separate arrays.
+template<typename T>
+struct PointArrays {
+  T* x;
+  T* y;
+  T* z;
+
+  operator PointArrays<const T>() const { return {x, y, z}; }
+};
+
+// The batch versions of Cube2Sphere and Sphere2Cube, for count points. The
+// loops are written so that the compiler can vectorize them, the float
+// versions process twice as many points at a time. The output arrays can't
+// overlap the input ones.
+void Cube2Sphere(PointArrays<const float> face_local, const CubeFace* faces,
+                 size_t count, double kFaceSize, PointArrays<float> world);
+void Cube2Sphere(PointArrays<const double> face_local, const CubeFace* faces,
+                 size_t count, double kFaceSize, PointArrays<double> world);
+void Sphere2Cube(PointArrays<const float> world, size_t count,
+                 double kFaceSize, PointArrays<float> face_local,
+                 CubeFace* faces);
+void Sphere2Cube(PointArrays<const double> world, size_t count,
+                 double kFaceSize, PointArrays<double> face_local,
+                 CubeFace* faces);
 
 #endif
@@ -1,5 +1,7 @@
 // Copyright (c) 2016, Tamas Csala
 
+#include <limits>
+#include <algorithm>
 #include "collision/sphere.hpp"
 
 bool Sphere::CollidesWithSphere(const Sphere& sphere) const {
@@ -28,3 +30,29 @@ bool Sphere::CollidesWithFrustum(const Frustum& frustum) const {
   // otherwise we are fully in view
   return true;
 }
+
+bool Sphere::CollidesWithSphere(const Sphere& sphere, double& slack) const {
+  double dist = glm::length(center_ - sphere.center_);
+  slack = std::abs(dist - (radius_ + sphere.radius_));
+  return dist < radius_ + sphere.radius_;
+}
+
+// The same as above, the result only changes if one of the tested distances
+// crosses -radius or +radius.
+bool Sphere::CollidesWithFrustum(const Frustum& frustum, double& slack) const {
+  slack = std::numeric_limits<double>::max();
+  for (int i = 0; i < 6; ++i) {
+    const Plane& plane = frustum.planes[i];
+    double dist = glm::dot(plane.normal, center_) + plane.dist;
+    slack = std::min(slack, std::min(std::abs(dist + radius_),
+                                     std::abs(dist - radius_)));
+
+    if (dist < -radius_)
+      return false;
+
+    if (std::abs(dist) < radius_)
+      return true;
+  }
+
+  return true;
+}
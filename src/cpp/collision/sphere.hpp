@@ -21,6 +21,11 @@ class Sphere {
 
   virtual bool CollidesWithSphere(const Sphere& sphere) const;
   virtual bool CollidesWithFrustum(const Frustum& frustum) const;
+
+  // These also return the slack of the result: how far the other sphere's
+  // center (or any frustum plane) can move before the result could change.
+  bool CollidesWithSphere(const Sphere& sphere, double& slack) const;
+  bool CollidesWithFrustum(const Frustum& frustum, double& slack) const;
 };
 
 
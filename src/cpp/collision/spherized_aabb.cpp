@@ -1,5 +1,7 @@
 // Copyright (c) 2016, Tamas Csala
 
+#include <limits>
+#include <algorithm>
 #include "collision/spherized_aabb.hpp"
 
 SpherizedAABB::SpherizedAABB(const glm::dvec3& mins, const glm::dvec3& maxes,
@@ -101,8 +103,19 @@ glm::dvec3 SpherizedAABB::GetNormal(glm::dvec3 vertices[], int a, int b, int c,
   return normalize(cross(ba, dc));
 }
 
-inline bool SpherizedAABB::HasIntersection(const Interval& a, const Interval& b) {
-  return a.min - Settings::kEpsilon < b.max && b.min - Settings::kEpsilon < a.max;
+// The intervals can move by 'slack' relative to each other, before the result
+// could change.
+inline bool SpherizedAABB::HasIntersection(const Interval& a, const Interval& b,
+                                           double& slack) {
+  double margin_a = b.max - (a.min - Settings::kEpsilon);
+  double margin_b = a.max - (b.min - Settings::kEpsilon);
+  if (margin_a > 0 && margin_b > 0) {
+    slack = std::min(margin_a, margin_b);
+    return true;
+  } else {
+    slack = std::max(-margin_a, -margin_b);
+    return false;
+  }
 }
 
 SpherizedAABB::Interval SpherizedAABB::GetExtent(const glm::dvec3& normal,
@@ -127,27 +140,39 @@ SpherizedAABB::Interval SpherizedAABB::GetExtent(const glm::dvec3& normal,
 }
 
 bool SpherizedAABB::CollidesWithSphere(const Sphere& sphere) const {
-  if (!bsphere_.CollidesWithSphere(sphere)) {
+  double slack;
+  return CollidesWithSphere(sphere, slack);
+}
+
+// All the tests have to pass for a collision, so a collision is as stable as
+// its least stable test, while a miss is as stable as the test that failed.
+bool SpherizedAABB::CollidesWithSphere(const Sphere& sphere,
+                                       double& slack) const {
+  if (!bsphere_.CollidesWithSphere(sphere, slack)) {
     return false;
   }
+  double min_slack = slack;
 
   double radial_interval_center = length(sphere.center());
   Interval radial_extent = {radial_interval_center - sphere.radius(),
                             radial_interval_center + sphere.radius()};
-  if (!HasIntersection(radial_extent_, radial_extent)) {
+  if (!HasIntersection(radial_extent_, radial_extent, slack)) {
     return false;
   }
+  min_slack = std::min(min_slack, slack);
 
   for (size_t i = 0; i < 4; ++i) {
     double interval_center = dot(sphere.center(), normals_[i]);
     Interval projection_extent = {interval_center - sphere.radius(),
                                   interval_center + sphere.radius()};
 
-    if (!HasIntersection(extents_[i], projection_extent)) {
+    if (!HasIntersection(extents_[i], projection_extent, slack)) {
       return false;
     }
+    min_slack = std::min(min_slack, slack);
   }
 
+  slack = min_slack;
   return true;
 }
 
@@ -155,6 +180,16 @@ bool SpherizedAABB::CollidesWithFrustum(const Frustum& frustum) const {
   return bsphere_.CollidesWithFrustum(frustum);
 }
 
+bool SpherizedAABB::CollidesWithFrustum(const Frustum& frustum,
+                                        double& slack) const {
+  return bsphere_.CollidesWithFrustum(frustum, slack);
+}
+
+double SpherizedAABB::DistanceFrom(const glm::dvec3& point) const {
+  return std::max(glm::length(point - bsphere_.center()) - bsphere_.radius(),
+                  0.0);
+}
+
 SpherizedAABBDivided::SpherizedAABBDivided(const glm::dvec3& mins,
                                            const glm::dvec3& maxes,
                                            CubeFace face, double face_size)
@@ -173,30 +208,53 @@ SpherizedAABBDivided::SpherizedAABBDivided(const glm::dvec3& mins,
 }
 
 bool SpherizedAABBDivided::CollidesWithSphere(const Sphere& sphere) const {
-  if (!main_.CollidesWithSphere(sphere)) {
+  double slack;
+  return CollidesWithSphere(sphere, slack);
+}
+
+bool SpherizedAABBDivided::CollidesWithFrustum(const Frustum& frustum) const {
+  double slack;
+  return CollidesWithFrustum(frustum, slack);
+}
+
+// A collision stays as long as both the main box and the colliding sub box
+// collide, a miss stays as long as the main box or all the sub boxes miss.
+bool SpherizedAABBDivided::CollidesWithSphere(const Sphere& sphere,
+                                              double& slack) const {
+  if (!main_.CollidesWithSphere(sphere, slack)) {
     return false;
   }
+  double main_slack = slack;
 
+  double min_sub_slack = std::numeric_limits<double>::max();
   for (const SpherizedAABB& sub : subs_) {
-    if (sub.CollidesWithSphere(sphere)) {
+    if (sub.CollidesWithSphere(sphere, slack)) {
+      slack = std::min(main_slack, slack);
       return true;
     }
+    min_sub_slack = std::min(min_sub_slack, slack);
   }
 
+  slack = min_sub_slack;
   return false;
 }
 
-bool SpherizedAABBDivided::CollidesWithFrustum(const Frustum& frustum) const {
-  if (!main_.CollidesWithFrustum(frustum)) {
+bool SpherizedAABBDivided::CollidesWithFrustum(const Frustum& frustum,
+                                               double& slack) const {
+  if (!main_.CollidesWithFrustum(frustum, slack)) {
     return false;
   }
+  double main_slack = slack;
 
+  double min_sub_slack = std::numeric_limits<double>::max();
   for (const SpherizedAABB& sub : subs_) {
-    if (sub.CollidesWithFrustum(frustum)) {
+    if (sub.CollidesWithFrustum(frustum, slack)) {
+      slack = std::min(main_slack, slack);
       return true;
     }
+    min_sub_slack = std::min(min_sub_slack, slack);
   }
 
+  slack = min_sub_slack;
   return false;
 }
-
@@ -16,6 +16,13 @@ class SpherizedAABB {
   bool CollidesWithSphere(const Sphere& sphere) const;
   bool CollidesWithFrustum(const Frustum& frustum) const;
 
+  // See Sphere for the meaning of the slack.
+  bool CollidesWithSphere(const Sphere& sphere, double& slack) const;
+  bool CollidesWithFrustum(const Frustum& frustum, double& slack) const;
+
+  // A lower bound of the distance between the point and the box.
+  double DistanceFrom(const glm::dvec3& point) const;
+
  private:
   struct Interval {
     double min;
@@ -28,7 +35,8 @@ class SpherizedAABB {
   Interval radial_extent_;
 
   static glm::dvec3 GetNormal(glm::dvec3 vertices[], int a, int b, int c, int d);
-  static bool HasIntersection(const Interval& a, const Interval& b);
+  static bool HasIntersection(const Interval& a, const Interval& b,
+                              double& slack);
   static Interval GetExtent(const glm::dvec3& normal,
                             const glm::dvec3& m_space_min,
                             const glm::dvec3& m_space_max,
@@ -45,6 +53,13 @@ class SpherizedAABBDivided {
   bool CollidesWithSphere(const Sphere& sphere) const;
   bool CollidesWithFrustum(const Frustum& frustum) const;
 
+  bool CollidesWithSphere(const Sphere& sphere, double& slack) const;
+  bool CollidesWithFrustum(const Frustum& frustum, double& slack) const;
+
+  double DistanceFrom(const glm::dvec3& point) const {
+    return main_.DistanceFrom(point);
+  }
+
  private:
   static constexpr int kAabbSubdivisionRate = 2;
 
@@ -3,9 +3,11 @@
 #ifndef FILE_UTILS_HPP_
 #define FILE_UTILS_HPP_
 
+#include <ctime>
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <sys/stat.h>
 
 namespace FileUtils {
 
@@ -26,6 +28,15 @@ inline std::string ReadFileToString(const std::string& path) {
     return src;
 }
 
+// The last modification of the file, or -1 if it doesn't exist.
+inline std::time_t ModificationTime(const std::string& path) {
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+      return -1;
+    }
+    return status.st_mtime;
+}
+
 }
 
 #endif //FILE_UTILS_HPP_
@@ -12,7 +12,12 @@
     #define VK_VALIDATE 0
   #endif
 #endif
-#define VK_VSYNC 0
+
+// The CPU profiler's scope markers (see engine/cpu_profiler.hpp) are compiled
+// out if this is zero.
+#ifndef VK_PROFILING
+  #define VK_PROFILING 1
+#endif
 
 namespace Settings {
 
@@ -29,6 +34,13 @@ static constexpr long kFaceSize = 65536;
 // The radius of the sphere made of the heightmap
 static constexpr double kSphereRadius = kFaceSize / 2;
 
+// The heightmaps of the six faces, as "<face>.png" files
+static constexpr const char* kHeightmapDirectory = "src/resources/gmted2010";
+
+// The free fly camera is kept at least this high above the terrain (see
+// cdlod/terrain_height_query.hpp), twice its near plane's distance.
+static constexpr double kCameraGroundClearance = 20;
+
 static constexpr double kMtEverestHeight = 8848 * (kSphereRadius / 6371000);
 static constexpr double kScaleOfRealisticHeight = 128;
 static constexpr double kMaxHeight = kScaleOfRealisticHeight * kMtEverestHeight;
@@ -41,8 +53,130 @@ static constexpr long kGeomDiv = 0;
 static constexpr int kLevelOffset = 0;
 static constexpr double kSmallestGeometryLodDistance = 2*kNodeDimension;
 
+// The lod ranges grow by this ratio per level, and the vertices morph between
+// these fractions of the way to the next range (see cdlod/cdlod_lod_table.hpp).
+static constexpr double kLodRangeRatio = 2.0;
+static constexpr double kLodMorphStartRatio = 0.3;
+static constexpr double kLodMorphEndRatio = 0.9;
+
+// Choose the smallest lod range from the projected geometric error instead of
+// kSmallestGeometryLodDistance, so the detail follows the resolution and the
+// field of view. A level's grid can be off by kLodGeometricError times its
+// scale (the terrain's slope bound, in the heightmap's units), and the ranges
+// are set so that this error is at most kLodPixelError pixels on the screen.
+// The error bound is the same for every node, but the distances are measured
+// to the lowest and highest terrain of each node (see CdlodNodeBox). The
+// defaults give about the distance ranges on a 720p screen. F4 toggles it.
+static constexpr bool kScreenSpaceErrorLod = false;
+static constexpr double kLodGeometricError = 0.05;
+static constexpr double kLodPixelError = 1.0;
+
+// Scale the lod ranges every frame (see cdlod/cdlod_lod_controller.hpp), to
+// keep the frame time under its budget, or if the instance budget isn't zero,
+// the number of instances under that. The frame time is the update and render
+// work of the main thread, without the present wait, so vsync doesn't count as
+// cost. The multipliers of the last frames are written to the csv file on
+// exit. F5 toggles it.
+static constexpr bool kAdaptiveLod = false;
+static constexpr double kAdaptiveLodFrameTimeBudgetMs = 12.0;
+static constexpr int kAdaptiveLodInstanceBudget = 0;
+static constexpr double kAdaptiveLodHysteresis = 0.2;
+static constexpr double kAdaptiveLodMinMultiplier = 0.25;
+static constexpr double kAdaptiveLodMaxMultiplier = 4.0;
+static constexpr const char* kAdaptiveLodCsvPath = "lod_multiplier.csv";
+
+// Reuse the sphere and frustum tests of the previous frames in the node
+// selection, while the camera couldn't have moved enough to change them. If the
+// camera jumps farther than this in a frame, everything is retested.
+static constexpr bool kIncrementalSelection = true;
+static constexpr double kIncrementalSelectionMaxJump = 16*kSmallestGeometryLodDistance;
+
+// Use CdlodLinearQuadTree instead of CdlodQuadTree. It doesn't support the
+// incremental selection.
+static constexpr bool kLinearQuadTree = false;
+
+// Sort the selected instances by face, then in Morton order (see
+// QuadGridMesh::SortRenderList) for the locality of the heightmap fetches.
+static constexpr bool kMortonOrderedInstances = true;
+
+// Sort the instances of a face front to back in coarse distance buckets (and
+// in Morton order inside a bucket), so the near terrain fails the depth test
+// of the far terrain behind it, before it's shaded. F3 toggles it.
+static constexpr bool kFrontToBackInstances = true;
+
 static constexpr bool kWireframe = false;
 
+// If the camera didn't change since the last frame, skip the node selection
+// and the uploads, and submit the already recorded draw command again.
+static constexpr bool kReuseUnchangedFrames = true;
+
+// Use a separate pipeline for every cube face, so the vertex shader doesn't
+// have to switch on the face of the instance.
+static constexpr bool kPerFacePipelines = true;
+
+// The number of offscreen images rendered to in headless mode.
+static constexpr uint32_t kHeadlessImageCount = 2;
+
+// Measure the GPU time of the draw commands with timestamp queries, and write
+// the results of every frame to this file (see engine/gpu_profiler.hpp).
+static constexpr bool kGpuProfiling = true;
+static constexpr const char* kGpuProfileCsvPath = "gpu_profile.csv";
+
+// Record the CPU time of the profiled scopes, and write them to this file in
+// the Chrome trace event format on exit (see engine/cpu_profiler.hpp).
+static constexpr bool kCpuProfiling = true;
+static constexpr const char* kCpuTraceJsonPath = "cpu_trace.json";
+
+// Update the objects that declared their update access (see
+// GameObject::DeclareUpdateAccess) at the same time, on this many worker
+// threads plus the main thread. Zero means one less than the hardware threads.
+// F6 toggles it. The demo itself gains nothing from it: the free fly camera
+// reads the input, so it doesn't declare its access, and the replay camera
+// writes the camera that the track recorder reads, so each of them is a wave
+// of its own. The "parallel_update" benchmark has objects that run together.
+static constexpr bool kParallelUpdate = false;
+static constexpr size_t kUpdateWorkerCount = 0;
+
+// The updates run in fixed steps of this many seconds, independently of the
+// frame rate (see Scene::Turn), at most kMaxUpdatesPerTurn of them per frame.
+// The camera is rendered between the poses of the last two steps, unless
+// kInterpolateCamera is false.
+static constexpr double kSimulationTimestep = 1.0 / 60;
+static constexpr int kMaxUpdatesPerTurn = 5;
+static constexpr bool kInterpolateCamera = true;
+
+// The frames per second are limited to this, zero means no limit (see
+// engine/frame_limiter.hpp). It can be changed with --max-fps. The default
+// fifo present mode already paces the frames to the display, the limit is for
+// the immediate and the mailbox modes.
+static constexpr double kFrameRateLimit = 0;
+
+// Record, submit and present the frames on a render thread, with at most this
+// many frames in flight, zero means on the main thread (see
+// engine/render_thread.hpp). It can be changed with --render-queue.
+static constexpr size_t kRenderQueueDepth = 0;
+
+// The swapchain's present mode: "immediate", "mailbox", "fifo" (vsync) or
+// "fifo_relaxed". It can be changed with --present-mode, and F7 cycles it.
+// Fifo is the default, so without a frame rate limit an idle camera doesn't
+// keep a core busy redrawing. Use immediate to measure the highest frame rate.
+static constexpr const char* kPresentMode = "fifo";
+
+// The buffers and the images are sub-allocated from device memory blocks of
+// this many bytes (see engine/device_allocator.hpp).
+static constexpr uint64_t kDeviceMemoryBlockSize = 64 * 1024 * 1024;
+
+// The allocator only puts new blocks into a memory heap over this fraction of
+// its size if no other memory type fits.
+static constexpr double kMemoryHeapBudget = 0.8;
+
+// The frame time statistics printed with F2 are of this many frames. The
+// session's percentiles come from histograms with this bin size, and the
+// histogram of the total frame times is written on exit.
+static constexpr size_t kFrameStatisticsWindow = 600;
+static constexpr const char* kFrameTimeHistogramPath = "frame_times.csv";
+static constexpr double kFrameTimeHistogramBinMs = 0.5;
+
 }
 
 template<typename T, typename... Args>
@@ -0,0 +1,46 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef COMMON_STATISTICS_HPP_
+#define COMMON_STATISTICS_HPP_
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace Statistics {
+
+// Returns the p-th percentile (0 <= p <= 100) of the sorted samples, with
+// linear interpolation between the closest ranks.
+inline double PercentileOfSorted(const std::vector<double>& sorted_samples,
+                                 double p) {
+  if (sorted_samples.empty()) {
+    return 0.0;
+  }
+
+  double rank = p / 100.0 * (sorted_samples.size() - 1);
+  size_t lower = static_cast<size_t>(std::floor(rank));
+  size_t upper = std::min(lower + 1, sorted_samples.size() - 1);
+  double t = rank - lower;
+  return sorted_samples[lower] * (1 - t) + sorted_samples[upper] * t;
+}
+
+inline double Percentile(std::vector<double> samples, double p) {
+  std::sort(samples.begin(), samples.end());
+  return PercentileOfSorted(samples, p);
+}
+
+inline double Average(const std::vector<double>& samples) {
+  if (samples.empty()) {
+    return 0.0;
+  }
+
+  double sum = 0.0;
+  for (double sample : samples) {
+    sum += sample;
+  }
+  return sum / samples.size();
+}
+
+}
+
+#endif // COMMON_STATISTICS_HPP_
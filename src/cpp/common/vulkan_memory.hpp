@@ -3,26 +3,138 @@
 #ifndef VULKAN_MEMORY_HPP_
 #define VULKAN_MEMORY_HPP_
 
+#include <string>
+#include <stdexcept>
 #include <vulkan/vk_cpp.h>
 
-inline void MemoryTypeFromProperties(const vk::PhysicalDeviceMemoryProperties& memory_properties,
-                                     uint32_t typeBits,
-                                     vk::MemoryPropertyFlags requirements_mask,
-                                     vk::MemoryAllocateInfo& mem_alloc) {
-    // Search memtypes to find first index with those properties
-    for (uint32_t i = 0; i < 32; i++) {
-        if ((typeBits & 1) == 1) {
-            // Type is available, does it match user properties?
-            if ((memory_properties.memoryTypes()[i].propertyFlags() & requirements_mask)
-                == requirements_mask) {
-              mem_alloc.memoryTypeIndex(i);
-              return;
-            }
+// How the host and the device access a resource's memory.
+enum class MemoryUsage {
+    // Only the device, for ex. the optimal textures and the render targets.
+    kGpuOnly,
+    // Written once by the host, and copied from by the device (staging).
+    kUpload,
+    // Written by the host, and read by the device many times, like every
+    // frame's uniforms and instances, or the meshes written in place. It's in
+    // device local host visible memory, if the device has such.
+    kStreaming,
+    // Written by the device, and read by the host.
+    kReadback
+};
+
+// The memory type has to have the required flags and can't have the
+// forbidden ones. Among those, the more preferred flags it has, and the less
+// avoided flags, the better.
+struct MemoryTypeRequest {
+    vk::MemoryPropertyFlags required, preferred, avoided, forbidden;
+};
+
+inline MemoryTypeRequest MemoryTypeRequestFor(MemoryUsage usage) {
+    using Bits = vk::MemoryPropertyFlagBits;
+    MemoryTypeRequest request;
+    // Only for transient attachments, that none of the usages are
+    request.forbidden = Bits::eLazilyAllocated;
+
+    switch (usage) {
+      case MemoryUsage::kGpuOnly:
+        request.preferred = Bits::eDeviceLocal;
+        // The device local host visible memory is small, leave it for
+        // kStreaming
+        request.avoided = Bits::eHostVisible;
+        break;
+      case MemoryUsage::kUpload:
+        request.required = Bits::eHostVisible;
+        request.preferred = Bits::eHostCoherent;
+        request.avoided = Bits::eDeviceLocal | Bits::eHostCached;
+        break;
+      case MemoryUsage::kStreaming:
+        request.required = Bits::eHostVisible;
+        request.preferred = Bits::eDeviceLocal | Bits::eHostCoherent;
+        // The host only writes it, the cache wouldn't help
+        request.avoided = Bits::eHostCached;
+        break;
+      case MemoryUsage::kReadback:
+        request.required = Bits::eHostVisible;
+        // The uncached reads are very slow, it's worth an Invalidate()
+        request.preferred = Bits::eHostCached;
+        break;
+    }
+    return request;
+}
+
+static const vk::MemoryPropertyFlagBits kMemoryPropertyBits[] = {
+    vk::MemoryPropertyFlagBits::eDeviceLocal,
+    vk::MemoryPropertyFlagBits::eHostVisible,
+    vk::MemoryPropertyFlagBits::eHostCoherent,
+    vk::MemoryPropertyFlagBits::eHostCached,
+    vk::MemoryPropertyFlagBits::eLazilyAllocated};
+
+inline int CountMemoryProperties(vk::MemoryPropertyFlags flags) {
+    int count = 0;
+    for (vk::MemoryPropertyFlagBits bit : kMemoryPropertyBits) {
+        if (flags & bit) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// For ex. "device_local|host_visible"
+inline std::string MemoryPropertyNames(vk::MemoryPropertyFlags flags) {
+    static const char* const kNames[] = {"device_local", "host_visible",
+                                         "host_coherent", "host_cached",
+                                         "lazily_allocated"};
+    std::string names;
+    for (size_t i = 0; i < 5; i++) {
+        if (flags & kMemoryPropertyBits[i]) {
+            names += (names.empty() ? "" : "|") + std::string(kNames[i]);
         }
-        typeBits >>= 1;
     }
+    return names.empty() ? "none" : names;
+}
+
+// Returns the best memory type of the ones allowed by typeBits (see
+// MemoryTypeRequest). If heap_budgets is given (the bytes left in each heap's
+// budget), and new_bytes (the bytes each memory type would newly allocate
+// from its heap for the resource), a type whose heap doesn't have that many
+// bytes left is only chosen if no other type fits the request.
+inline uint32_t ChooseMemoryType(const vk::PhysicalDeviceMemoryProperties& memory_properties,
+                                 uint32_t typeBits,
+                                 const MemoryTypeRequest& request,
+                                 const vk::DeviceSize* heap_budgets = nullptr,
+                                 const vk::DeviceSize* new_bytes = nullptr) {
+    const int kOverBudgetCost = 100;
+    uint32_t best_type = 0;
+    int best_cost = -1;
+
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount(); i++) {
+        if (((typeBits >> i) & 1) == 0) {
+            continue;
+        }
+
+        const vk::MemoryType& type = memory_properties.memoryTypes()[i];
+        vk::MemoryPropertyFlags flags = type.propertyFlags();
+        if ((flags & request.required) != request.required ||
+            (flags & request.forbidden)) {
+            continue;
+        }
 
-    throw std::runtime_error("Couldn't find request memory type.");
+        int cost = CountMemoryProperties(request.preferred) -
+                   CountMemoryProperties(flags & request.preferred) +
+                   CountMemoryProperties(flags & request.avoided);
+        if (heap_budgets && new_bytes &&
+            heap_budgets[type.heapIndex()] < new_bytes[i]) {
+            cost += kOverBudgetCost;
+        }
+        if (best_cost == -1 || cost < best_cost) {
+            best_type = i;
+            best_cost = cost;
+        }
+    }
+
+    if (best_cost == -1) {
+        throw std::runtime_error("Couldn't find request memory type.");
+    }
+    return best_type;
 }
 
 #endif // VULKAN_MEMORY_HPP_
@@ -10,21 +10,24 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <chrono>
+#include <limits>
+#include <algorithm>
 
 #include <vulkan/vk_cpp.h>
 #include <GLFW/glfw3.h>
-#include <lodepng.h>
 
 #include "engine/scene.hpp"
+#include "engine/cpu_profiler.hpp"
 #include "common/error_checking.hpp"
-#include "common/vulkan_memory.hpp"
-#include "common/file_utils.hpp"
-#include "shader/glsl2spv.hpp"
+#include "common/statistics.hpp"
+#include "shader/shader_cache.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define INSTANCE_BUFFER_BIND_ID 1
 
-void DemoScene::BuildDrawCmd() {
+void DemoScene::BuildDrawCmd(const FramePacket& packet) {
+  PROFILE_SCOPE("DemoScene::BuildDrawCmd");
   const vk::CommandBufferInheritanceInfo cmd_buf_hinfo;
   const vk::CommandBufferBeginInfo cmd_buf_info =
       vk::CommandBufferBeginInfo().pInheritanceInfo(&cmd_buf_hinfo);
@@ -42,11 +45,35 @@ void DemoScene::BuildDrawCmd() {
       .pClearValues(clear_values);
 
   vk::chk(vk_draw_cmd().begin(&cmd_buf_info));
+  gpu_profiler().BeginFrame(vk_draw_cmd(), vk_current_buffer());
+
+  // The image was presented before, so it has to be moved back to
+  // COLOR_ATTACHMENT_OPTIMAL. This is recorded here rather than into the setup
+  // command, so a recorded draw command needs nothing else to be reused.
+  // It is in the color attachment output stage, that the submit waits for the
+  // image to be acquired in, so the transition happens after the acquire, and
+  // before the render pass writes the image.
+  vk::ImageMemoryBarrier post_present_barrier = vk::ImageMemoryBarrier()
+      .srcAccessMask(vk::AccessFlags{})
+      .dstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+      .oldLayout(vk_present_layout())
+      .newLayout(vk::ImageLayout::eColorAttachmentOptimal)
+      .srcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .dstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .image(vk_buffers()[vk_current_buffer()].image)
+      .subresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+  vk_draw_cmd().pipelineBarrier(
+      vk::PipelineStageFlagBits::eColorAttachmentOutput,
+      vk::PipelineStageFlagBits::eColorAttachmentOutput,
+      vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &post_present_barrier);
 
+  gpu_profiler().BeginScope(vk_draw_cmd(), "terrain draw");
+  gpu_profiler().BeginStatistics(vk_draw_cmd());
   vk_draw_cmd().beginRenderPass(&rp_begin, vk::SubpassContents::eInline);
-  vk_draw_cmd().bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline_);
+  const uint32_t uniform_offset =
+      uniform_data_.stride * vk_current_buffer();
   vk_draw_cmd().bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-      pipeline_layout_, 0, 1, &desc_set_, 0, nullptr);
+      pipeline_layout_, 0, 1, &desc_set_, 1, &uniform_offset);
 
   vk::Viewport viewport = vk::Viewport()
     .width(framebuffer_size().x)
@@ -61,8 +88,10 @@ void DemoScene::BuildDrawCmd() {
   vk::DeviceSize offsets[1] = {0};
   vk_draw_cmd().bindVertexBuffers(VERTEX_BUFFER_BIND_ID, 1,
                                 &vertex_attribs_.buf, offsets);
+  vk::DeviceSize instance_offsets[1] = {
+      sizeof(glm::vec4) * Settings::kMaxInstanceCount * vk_current_buffer()};
   vk_draw_cmd().bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, 1,
-                                &instance_attribs_.buf, offsets);
+                                &instance_attribs_.buf, instance_offsets);
   vk_draw_cmd().bindIndexBuffer(indices_.buf,
                               vk::DeviceSize{},
                               vk::IndexType::eUint16);
@@ -71,92 +100,138 @@ void DemoScene::BuildDrawCmd() {
     vk_draw_cmd().setLineWidth(2.0f);
   }
 
-  vk_draw_cmd().drawIndexed(grid_mesh_.mesh_.index_count_,
-                          grid_mesh_.mesh_.render_data_.size(), 0, 0, 0);
+  if (Settings::kPerFacePipelines) {
+    for (int face : packet.face_order) {
+      if (packet.face_instances[face].count == 0) {
+        continue;
+      }
+      vk_draw_cmd().bindPipeline(vk::PipelineBindPoint::eGraphics,
+                                 pipelines_[face]);
+      vk_draw_cmd().drawIndexed(grid_mesh_.mesh_.index_count_,
+                                packet.face_instances[face].count, 0, 0,
+                                packet.face_instances[face].first);
+    }
+  } else {
+    vk_draw_cmd().bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines_[0]);
+    vk_draw_cmd().drawIndexed(grid_mesh_.mesh_.index_count_,
+                              packet.instance_count, 0, 0, 0);
+  }
   vk_draw_cmd().endRenderPass();
+  gpu_profiler().EndStatistics(vk_draw_cmd());
+  gpu_profiler().EndScope(vk_draw_cmd());
 
   vk::ImageMemoryBarrier pre_present_barrier = vk::ImageMemoryBarrier()
       .srcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
       .dstAccessMask(vk::AccessFlagBits::eMemoryRead)
       .oldLayout(vk::ImageLayout::eColorAttachmentOptimal)
-      .newLayout(vk::ImageLayout::ePresentSrcKHR)
+      .newLayout(vk_present_layout())
       .srcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
       .dstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
       .subresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
 
   pre_present_barrier.image(vk_buffers()[vk_current_buffer()].image);
+  gpu_profiler().BeginScope(vk_draw_cmd(), "present barrier");
   vk_draw_cmd().pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
                               vk::PipelineStageFlagBits::eBottomOfPipe,
                               vk::DependencyFlags(), 0, nullptr, 0,
                               nullptr, 1, &pre_present_barrier);
+  gpu_profiler().EndScope(vk_draw_cmd());
 
   vk::chk(vk_draw_cmd().end());
 }
 
-void DemoScene::Draw() {
-  vk::Semaphore present_complete_semaphore;
-  vk::SemaphoreCreateInfo present_complete_semaphore_create_info;
+void DemoScene::Draw(const FramePacket& packet) {
+  PROFILE_SCOPE("DemoScene::Draw");
+
+  // The waits for the GPU and the present are counted as the present wait.
+  // The frame statistics belong to the main thread, with a render thread the
+  // main thread's wait for the queue is counted instead (see Render()).
+  std::unique_ptr<engine::FrameStatistics::PhaseTimer> present_timer;
+  auto start_present_timer = [&] {
+    if (!render_thread()) {
+      present_timer = make_unique<engine::FrameStatistics::PhaseTimer>(
+          frame_statistics(), engine::FrameStatistics::kPresentWait);
+    }
+  };
+  start_present_timer();
 
-  vk::chk(vk_device().createSemaphore(&present_complete_semaphore_create_info,
-                                     nullptr, &present_complete_semaphore));
+  // The semaphores and the fence of this frame are free once the GPU
+  // finished the last frame that used them.
+  FrameSync& frame = frames_[next_frame_];
+  {
+    PROFILE_SCOPE("wait for frame");
+    FinishFrame(frame, true);
+  }
 
   // Get the index of the next available swapchain image:
-  VkResult vkErr = vk_app().entry_points.AcquireNextImageKHR(
-      vk_device(), vk_swapchain(), UINT64_MAX, present_complete_semaphore,
-      (vk::Fence)nullptr, &vk_current_buffer());
+  VkResult vkErr;
+  {
+    PROFILE_SCOPE("acquire image");
+    vkErr = AcquireNextImage(frame.image_acquired);
+  }
   if (vkErr == VK_ERROR_OUT_OF_DATE_KHR) {
       // vk_swapchain() is out of date (e.g. the window was resized) and
       // must be recreated:
       //demo_resize(demo, scene);
       throw std::runtime_error("Should resize swapchain");
-      Draw();
-      vk_device().destroySemaphore(present_complete_semaphore, nullptr);
-      return;
   } else if (vkErr == VK_SUBOPTIMAL_KHR) {
       // vk_swapchain() is not as optimal as it could be, but the platform's
       // presentation engine will still present the image correctly.
   } else {
       assert(vkErr == VK_SUCCESS);
   }
+  const uint32_t image = vk_current_buffer();
 
-  // Assume the command buffer has been run on current_buffer before so
-  // we need to set the image layout back to COLOR_ATTACHMENT_OPTIMAL
-  SetImageLayout(vk_buffers()[vk_current_buffer()].image,
-                 vk::ImageAspectFlagBits::eColor,
-                 vk::ImageLayout::ePresentSrcKHR,
-                 vk::ImageLayout::eColorAttachmentOptimal,
-                 vk::AccessFlags{});
+  // The image's buffers and draw command can't be changed while an earlier
+  // frame is still drawing from them.
+  if (image_frames_[image] >= 0) {
+    PROFILE_SCOPE("wait for image");
+    FinishFrame(frames_[image_frames_[image]], true);
+  }
+  image_frames_[image] = next_frame_;
+  present_timer.reset();
+
+  // Submit the pending setup commands (if any) before the draw command
   FlushInitCommand();
 
-  // Wait for the present complete semaphore to be signaled to ensure
-  // that the image won't be rendered to until the presentation
-  // engine has fully released ownership to the application, and it is
-  // okay to render to the image.
+  // The command buffer of this image is still valid, if it was recorded with
+  // the current instance data.
+  if (recorded_instance_versions_[image] != packet.instance_version) {
+    Upload(packet, image);
+    BuildDrawCmd(packet);
+    recorded_instance_versions_[image] = packet.instance_version;
+  }
 
-  // FIXME/TODO: DEAL WITH vk::ImageLayout::ePresentSrcKHR
-  BuildDrawCmd();
-  vk::Fence null_fence;
+  // The color attachment can't be written until the presentation engine
+  // released the image. Headless, nothing signals the semaphore.
   vk::PipelineStageFlags pipe_stage_flags =
-      vk::PipelineStageFlagBits::eBottomOfPipe;
+      vk::PipelineStageFlagBits::eColorAttachmentOutput;
   vk::SubmitInfo submit_info = vk::SubmitInfo()
-      .waitSemaphoreCount(1)
-      .pWaitSemaphores(&present_complete_semaphore)
+      .waitSemaphoreCount(headless() ? 0 : 1)
+      .pWaitSemaphores(&frame.image_acquired)
       .pWaitDstStageMask(&pipe_stage_flags)
       .commandBufferCount(1)
-      .pCommandBuffers(&vk_draw_cmd());
+      .pCommandBuffers(&vk_draw_cmd())
+      .signalSemaphoreCount(headless() ? 0 : 1)
+      .pSignalSemaphores(&frame.render_finished);
 
-  vk::chk(vk_queue().submit(1, &submit_info, null_fence));
-
-  vk::PresentInfoKHR present = vk::PresentInfoKHR()
-      .swapchainCount(1)
-      .pSwapchains(&vk_swapchain())
-      .pImageIndices(&vk_current_buffer());
-  VkPresentInfoKHR& vkPresent =
-    const_cast<VkPresentInfoKHR&>(
-      static_cast<const VkPresentInfoKHR&>(present));
+  vk::chk(vk_device().resetFences(1, &frame.fence));
+  {
+    PROFILE_SCOPE("submit");
+    vk::chk(vk_queue().submit(1, &submit_info, frame.fence));
+  }
+  gpu_profiler().FrameSubmitted(image);
+  frame.in_flight = true;
+  frame.image = image;
+  frame.input_ns = packet.input_ns;
+  next_frame_ = (next_frame_ + 1) % frames_.size();
 
-  // TBD/TODO: SHOULD THE "present" PARAMETER BE "const" IN THE HEADER?
-  vkErr = vk_app().entry_points.QueuePresentKHR(vk_queue(), &vkPresent);
+  start_present_timer();
+  {
+    PROFILE_SCOPE("present");
+    vkErr = PresentImage(frame.render_finished);
+  }
+  present_timer.reset();
   if (vkErr == VK_ERROR_OUT_OF_DATE_KHR) {
       // vk_swapchain() is out of date (e.g. the window was resized) and
       // must be recreated:
@@ -169,17 +244,98 @@ void DemoScene::Draw() {
       assert(vkErr == VK_SUCCESS);
   }
 
-  vk::chk(vk_queue().waitIdle());
+  // Finish the frames that are already done, oldest first, so their latency
+  // is measured close to when they were done.
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    if (!FinishFrame(frames_[(next_frame_ + i) % frames_.size()], false)) {
+      break;
+    }
+  }
+}
+
+// The latency is only measured when the fence is seen to be signaled, that
+// is at most a frame later than the GPU finished it.
+bool DemoScene::FinishFrame(FrameSync& frame, bool wait) {
+  if (!frame.in_flight) {
+    return true;
+  }
+  if (wait) {
+    vk::chk(vk_device().waitForFences(1, &frame.fence, VK_TRUE, UINT64_MAX));
+  } else if (vk_device().getFenceStatus(frame.fence) != vk::Result::eSuccess) {
+    return false;
+  }
+  frame.in_flight = false;
+
+  gpu_profiler().CollectResults(frame.image);
 
-  vk_device().destroySemaphore(present_complete_semaphore, nullptr);
+  // The image is on its way to the screen
+  last_present_ns_ = std::max(last_present_ns_, engine::CpuProfiler::Now());
+  if (input_latencies_ms_.empty()) {
+    first_present_ns_ = last_present_ns_;
+  }
+  input_latencies_ms_.push_back((last_present_ns_ - frame.input_ns) / 1e6);
+  return true;
+}
+
+void DemoScene::WaitForFrames() {
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    FinishFrame(frames_[(next_frame_ + i) % frames_.size()], true);
+  }
 }
 
-void DemoScene::PrepareTextureImage(const unsigned char *tex_colors,
+void DemoScene::PrepareFrames() {
+  const vk::SemaphoreCreateInfo semaphore_info;
+  const vk::FenceCreateInfo fence_info;
+  frames_.resize(vk_swapchain_image_count());
+  for (FrameSync& frame : frames_) {
+    vk::chk(vk_device().createSemaphore(&semaphore_info, nullptr,
+                                        &frame.image_acquired));
+    vk::chk(vk_device().createSemaphore(&semaphore_info, nullptr,
+                                        &frame.render_finished));
+    vk::chk(vk_device().createFence(&fence_info, nullptr, &frame.fence));
+    frame.in_flight = false;
+  }
+  next_frame_ = 0;
+  image_frames_.assign(vk_swapchain_image_count(), -1);
+}
+
+void DemoScene::DestroyFrames() {
+  WaitForFrames();
+  for (FrameSync& frame : frames_) {
+    vk_device().destroySemaphore(frame.image_acquired, nullptr);
+    vk_device().destroySemaphore(frame.render_finished, nullptr);
+    vk_device().destroyFence(frame.fence, nullptr);
+  }
+  frames_.clear();
+}
+
+void DemoScene::Upload(const FramePacket& packet, uint32_t image) {
+  {
+    PROFILE_SCOPE("upload uniforms");
+    std::memcpy(static_cast<char*>(uniform_data_.mem.mapped) +
+                    uniform_data_.stride * image,
+                &packet.uniforms, sizeof(UniformData));
+  }
+
+  {
+    PROFILE_SCOPE("upload instances");
+    std::copy(packet.instances->begin(), packet.instances->end(),
+              static_cast<glm::vec4*>(instance_attribs_.mem.mapped) +
+                  Settings::kMaxInstanceCount * image);
+  }
+
+  // The whole buffers, this is rare enough not to track the ranges
+  device_allocator().Flush(uniform_data_.mem);
+  device_allocator().Flush(instance_attribs_.mem);
+}
+
+void DemoScene::PrepareTextureImage(const uint16_t *tex_colors,
                                     int tex_width, int tex_height,
                                     TextureObject *tex_obj, vk::ImageTiling tiling,
                                     vk::ImageUsageFlags usage,
-                                    vk::MemoryPropertyFlags required_props,
-                                    vk::Format tex_format) {
+                                    MemoryUsage memory_usage,
+                                    vk::Format tex_format,
+                                    engine::DeviceAllocator::Strategy strategy) {
   tex_obj->tex_width = tex_width;
   tex_obj->tex_height = tex_height;
 
@@ -194,47 +350,26 @@ void DemoScene::PrepareTextureImage(const unsigned char *tex_colors,
       .usage(usage)
       .initialLayout(vk::ImageLayout::ePreinitialized);
 
-  vk::MemoryAllocateInfo mem_alloc;
-  vk::MemoryRequirements mem_reqs;
-
   vk::chk(vk_device().createImage(&image_create_info, nullptr, &tex_obj->image));
 
-  vk_device().getImageMemoryRequirements(tex_obj->image, &mem_reqs);
-
-  mem_alloc.allocationSize(mem_reqs.size());
-  MemoryTypeFromProperties(vk_gpu_memory_properties(),
-                           mem_reqs.memoryTypeBits(),
-                           required_props, mem_alloc);
+  /* allocate and bind memory */
+  tex_obj->mem = device_allocator().AllocateImage(tex_obj->image, tiling,
+                                                  memory_usage, strategy);
 
-  /* allocate memory */
-  vk::chk(vk_device().allocateMemory(&mem_alloc, nullptr, &tex_obj->mem));
-
-  /* bind memory */
-  vk::chk(vk_device().bindImageMemory(tex_obj->image, tex_obj->mem, 0));
-
-  if (required_props & vk::MemoryPropertyFlagBits::eHostVisible) {
+  if (tiling == vk::ImageTiling::eLinear) {
       const vk::ImageSubresource subres =
         vk::ImageSubresource().aspectMask(vk::ImageAspectFlagBits::eColor);
       vk::SubresourceLayout layout;
-      void *data;
+      void *data = tex_obj->mem.mapped;
 
       vk_device().getImageSubresourceLayout(tex_obj->image, &subres, &layout);
 
-      vk::chk(vk_device().mapMemory(tex_obj->mem, 0, mem_alloc.allocationSize(),
-                                   vk::MemoryMapFlags{}, &data));
-
       for (int y = 0; y < tex_height; y++) {
           char *row = ((char *)data + layout.rowPitch() * y);
-          for (int x = 0; x < tex_width; x++) {
-            for (int i = 0; i < 4; ++i) {
-              // todo
-              row[x*8 + 2*i] = tex_colors[(y*tex_width+x)*8 + 2*i+1];
-              row[x*8 + 2*i+1] = tex_colors[(y*tex_width+x)*8 + 2*i];
-            }
-          }
+          std::memcpy(row, tex_colors + y*tex_width*4,
+                      tex_width * 4 * sizeof(uint16_t));
       }
-
-      vk_device().unmapMemory(tex_obj->mem);
+      device_allocator().Flush(tex_obj->mem);
   }
 
   tex_obj->imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
@@ -250,14 +385,16 @@ void DemoScene::PrepareTextures() {
   const vk::Format tex_format = vk::Format::eR16G16B16A16Unorm;
   vk_gpu().getFormatProperties(tex_format, &props);
 
+  // The heightmaps were decoded once, for the height queries. The shader
+  // only reads the red channel.
+  const unsigned width = height_query_.texture_size();
+  const unsigned height = width;
   for (int i = 0; i < DEMO_TEXTURE_COUNT; i++) {
-    std::vector<unsigned char> image; //the raw pixels
-    unsigned width, height;
-    unsigned error = lodepng::decode(image, width, height,
-        "src/resources/gmted2010/" + std::to_string(i) + ".png", LCT_RGBA, 16);
-    if (error) {
-      std::cerr << "image decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
-      std::terminate();
+    const std::vector<uint16_t>& heightmap =
+        height_query_.heightmap(static_cast<CubeFace>(i));
+    std::vector<uint16_t> image(heightmap.size() * 4);
+    for (size_t j = 0; j < heightmap.size(); ++j) {
+      std::fill_n(image.begin() + 4*j, 4, heightmap[j]);
     }
 
     if ((props.linearTilingFeatures() &
@@ -268,7 +405,7 @@ void DemoScene::PrepareTextures() {
                           width, height, &textures_[i],
                           vk::ImageTiling::eLinear,
                           vk::ImageUsageFlagBits::eSampled,
-                          vk::MemoryPropertyFlagBits::eHostVisible,
+                          MemoryUsage::kStreaming,
                           tex_format);
     } else if (props.optimalTilingFeatures() &
                vk::FormatFeatureFlagBits::eSampledImage) {
@@ -279,14 +416,15 @@ void DemoScene::PrepareTextures() {
                            width, height, &staging_texture,
                            vk::ImageTiling::eLinear,
                            vk::ImageUsageFlagBits::eTransferSrc,
-                           vk::MemoryPropertyFlagBits::eHostVisible,
-                           tex_format);
+                           MemoryUsage::kUpload,
+                           tex_format,
+                           engine::DeviceAllocator::Strategy::kLinear);
 
       PrepareTextureImage(image.data(),
           width, height, &textures_[i],
           vk::ImageTiling::eOptimal,
           (vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled),
-          vk::MemoryPropertyFlagBits::eDeviceLocal,
+          MemoryUsage::kGpuOnly,
           tex_format);
 
       SetImageLayout(staging_texture.image,
@@ -319,7 +457,7 @@ void DemoScene::PrepareTextures() {
       FlushInitCommand();
 
       vk_device().destroyImage(staging_texture.image, nullptr);
-      vk_device().freeMemory(staging_texture.mem, nullptr);
+      device_allocator().Free(staging_texture.mem);
     } else {
       /* Can't support vk::Format::eB8G8R8A8Unorm !? */
       assert(!"No support for B8G8R8A8_UNORM as texture image format");
@@ -367,36 +505,17 @@ void DemoScene::PrepareIndices() {
       .size(sizeof(uint16_t) * indices.size())
       .usage(vk::BufferUsageFlagBits::eIndexBuffer);
 
-  vk::MemoryAllocateInfo mem_alloc;
-  vk::MemoryRequirements mem_reqs;
-  void *data;
-
   vk::chk(vk_device().createBuffer(&buf_info, nullptr, &indices_.buf));
 
-  vk_device().getBufferMemoryRequirements(indices_.buf, &mem_reqs);
-
-  mem_alloc.allocationSize(mem_reqs.size());
-  MemoryTypeFromProperties(vk_gpu_memory_properties(),
-                           mem_reqs.memoryTypeBits(),
-                           vk::MemoryPropertyFlagBits::eHostVisible,
-                           mem_alloc);
-
-  vk::chk(vk_device().allocateMemory(&mem_alloc, nullptr, &indices_.mem));
-
-  vk::chk(vk_device().mapMemory(indices_.mem, 0, mem_alloc.allocationSize(),
-                               vk::MemoryMapFlags{}, &data));
+  indices_.mem = device_allocator().AllocateBuffer(
+      indices_.buf, MemoryUsage::kStreaming);
 
-  std::memcpy(data, indices.data(), sizeof(uint16_t) * indices.size());
-
-  vk_device().unmapMemory(indices_.mem);
-
-  vk::chk(vk_device().bindBufferMemory(indices_.buf, indices_.mem, 0));
+  std::memcpy(indices_.mem.mapped, indices.data(),
+              sizeof(uint16_t) * indices.size());
+  device_allocator().Flush(indices_.mem);
 }
 
 void DemoScene::PrepareVertices() {
-  vk::MemoryAllocateInfo mem_alloc;
-  vk::MemoryRequirements mem_reqs;
-
   { // vertexAttribs
     const vk::BufferCreateInfo buf_info = vk::BufferCreateInfo()
       .size(sizeof(svec2) * grid_mesh_.mesh_.positions_.size())
@@ -404,44 +523,24 @@ void DemoScene::PrepareVertices() {
 
     vk::chk(vk_device().createBuffer(&buf_info, nullptr, &vertex_attribs_.buf));
 
-    vk_device().getBufferMemoryRequirements(vertex_attribs_.buf, &mem_reqs);
-
-    mem_alloc.allocationSize(mem_reqs.size());
-    MemoryTypeFromProperties(vk_gpu_memory_properties(),
-                             mem_reqs.memoryTypeBits(),
-                             vk::MemoryPropertyFlagBits::eHostVisible,
-                             mem_alloc);
+    vertex_attribs_.mem = device_allocator().AllocateBuffer(
+        vertex_attribs_.buf, MemoryUsage::kStreaming);
 
-    vk::chk(vk_device().allocateMemory(&mem_alloc, nullptr, &vertex_attribs_.mem));
-    vk::chk(vk_device().bindBufferMemory(vertex_attribs_.buf, vertex_attribs_.mem, 0));
-
-    void *data;
-    vk::chk(vk_device().mapMemory(vertex_attribs_.mem, 0, mem_alloc.allocationSize(),
-                                 vk::MemoryMapFlags{}, &data));
-
-    std::memcpy(data, grid_mesh_.mesh_.positions_.data(),
+    std::memcpy(vertex_attribs_.mem.mapped, grid_mesh_.mesh_.positions_.data(),
                 sizeof(svec2) * grid_mesh_.mesh_.positions_.size());
-
-    vk_device().unmapMemory(vertex_attribs_.mem);
+    device_allocator().Flush(vertex_attribs_.mem);
   }
 
   { // instanceAttribs
     const vk::BufferCreateInfo buf_info = vk::BufferCreateInfo()
-      .size(sizeof(glm::vec4) * Settings::kMaxInstanceCount)
+      .size(sizeof(glm::vec4) * Settings::kMaxInstanceCount *
+            vk_swapchain_image_count())
       .usage(vk::BufferUsageFlagBits::eVertexBuffer);
 
     vk::chk(vk_device().createBuffer(&buf_info, nullptr, &instance_attribs_.buf));
 
-    vk_device().getBufferMemoryRequirements(instance_attribs_.buf, &mem_reqs);
-
-    mem_alloc.allocationSize(mem_reqs.size());
-    MemoryTypeFromProperties(vk_gpu_memory_properties(),
-                             mem_reqs.memoryTypeBits(),
-                             vk::MemoryPropertyFlagBits::eHostVisible,
-                             mem_alloc);
-
-    vk::chk(vk_device().allocateMemory(&mem_alloc, nullptr, &instance_attribs_.mem));
-    vk::chk(vk_device().bindBufferMemory(instance_attribs_.buf, instance_attribs_.mem, 0));
+    instance_attribs_.mem = device_allocator().AllocateBuffer(
+        instance_attribs_.buf, MemoryUsage::kStreaming);
   }
 
   vertex_input_.vertexBindingDescriptionCount(2);
@@ -477,7 +576,7 @@ void DemoScene::PrepareDescriptorLayout() {
       .stageFlags(vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eVertex),
     vk::DescriptorSetLayoutBinding()
       .binding(1)
-      .descriptorType(vk::DescriptorType::eUniformBuffer)
+      .descriptorType(vk::DescriptorType::eUniformBufferDynamic)
       .descriptorCount(1)
       .stageFlags(vk::ShaderStageFlagBits::eVertex)
   };
@@ -546,7 +645,7 @@ void DemoScene::PrepareDescriptorPool() {
       .type(vk::DescriptorType::eCombinedImageSampler)
       .descriptorCount(DEMO_TEXTURE_COUNT),
     vk::DescriptorPoolSize()
-      .type(vk::DescriptorType::eUniformBuffer)
+      .type(vk::DescriptorType::eUniformBufferDynamic)
       .descriptorCount(1)
   };
 
@@ -561,31 +660,30 @@ void DemoScene::PrepareDescriptorPool() {
 }
 
 void DemoScene::PrepareUniformBuffer() {
+  vk::PhysicalDeviceProperties props;
+  vk_gpu().getProperties(&props);
+  const vk::DeviceSize alignment =
+      std::max<vk::DeviceSize>(props.limits().minUniformBufferOffsetAlignment(), 1);
+  uniform_data_.stride =
+      (sizeof(UniformData) + alignment - 1) / alignment * alignment;
+
   vk::BufferCreateInfo buf_info = vk::BufferCreateInfo{}
       .usage(vk::BufferUsageFlagBits::eUniformBuffer)
-      .size(sizeof(UniformData))
+      .size(uniform_data_.stride * vk_swapchain_image_count())
       .sharingMode(vk::SharingMode::eExclusive);
   vk::chk(vk_device().createBuffer(&buf_info, NULL, &uniform_data_.buf));
 
-  vk::MemoryRequirements mem_reqs;
-  vk_device().getBufferMemoryRequirements(uniform_data_.buf, &mem_reqs);
-
-  vk::MemoryAllocateInfo alloc_info;
-  alloc_info.allocationSize(mem_reqs.size());
-  MemoryTypeFromProperties(vk_gpu_memory_properties(),
-                           mem_reqs.memoryTypeBits(),
-                           vk::MemoryPropertyFlagBits::eHostVisible,
-                           alloc_info);
-
-  vk::chk(vk_device().allocateMemory(&alloc_info, NULL,
-                                     &uniform_data_.mem));
-
-  vk::chk(vk_device().bindBufferMemory(uniform_data_.buf,
-                                       uniform_data_.mem, 0));
+  uniform_data_.mem = device_allocator().AllocateBuffer(
+      uniform_data_.buf, MemoryUsage::kStreaming);
 
+  // The draw commands add the offset of their image's uniforms
   uniform_data_.buffer_info.buffer(uniform_data_.buf);
   uniform_data_.buffer_info.offset(0);
   uniform_data_.buffer_info.range(sizeof(UniformData));
+
+  // UpdateInstances() only gets the lod table again if it changes
+  lod_table_.GetShaderTable(uniforms_.lod_levels);
+  uploaded_lod_version_ = lod_table_.version();
 }
 
 void DemoScene::PrepareDescriptorSet() {
@@ -614,48 +712,19 @@ void DemoScene::PrepareDescriptorSet() {
   writes[1].dstBinding(1);
   writes[1].dstSet(desc_set_);
   writes[1].descriptorCount(1);
-  writes[1].descriptorType(vk::DescriptorType::eUniformBuffer);
+  writes[1].descriptorType(vk::DescriptorType::eUniformBufferDynamic);
   writes[1].pBufferInfo(&uniform_data_.buffer_info);
 
   vk_device().updateDescriptorSets(2, writes, 0, nullptr);
 }
 
-static vk::ShaderModule PrepareShaderModule(const vk::Device& device,
-                                            const void *code,
-                                            size_t size) {
-  vk::ShaderModuleCreateInfo module_create_info;
-  vk::ShaderModule module;
-
-  module_create_info.codeSize(size);
-  module_create_info.pCode(static_cast<const uint32_t*>(code));
-  vk::chk(device.createShaderModule(&module_create_info, nullptr, &module));
-
-  return module;
-}
-
-static vk::ShaderModule PrepareVs(const vk::Device& device) {
-  std::vector<unsigned int> vert_shader =
-    Shader::GLSLtoSPV(vk::ShaderStageFlagBits::eVertex,
-                      FileUtils::ReadFileToString("src/glsl/simple.vert"));
-
-  return PrepareShaderModule(device, (const void*)vert_shader.data(),
-                             vert_shader.size() * sizeof(vert_shader[0]));
-}
-
-static vk::ShaderModule PrepareFs(const vk::Device& device) {
-  std::vector<unsigned int> frag_shader =
-    Shader::GLSLtoSPV(vk::ShaderStageFlagBits::eFragment,
-                      FileUtils::ReadFileToString("src/glsl/simple.frag"));
-
-  return PrepareShaderModule(device, (const void*)frag_shader.data(),
-                             frag_shader.size() * sizeof(frag_shader[0]));
-}
-
 static vk::Pipeline PreparePipeline(
           const vk::Device& device,
           const vk::PipelineVertexInputStateCreateInfo& vertexState,
           const vk::PipelineLayout& pipelineLayout,
-          const vk::RenderPass& renderPass) {
+          const vk::RenderPass& renderPass,
+          const vk::PipelineCache& pipelineCache,
+          const vk::PipelineShaderStageCreateInfo shader_stages[2]) {
   vk::GraphicsPipelineCreateInfo pipeline_create_info;
 
   vk::PipelineInputAssemblyStateCreateInfo ia;
@@ -726,17 +795,6 @@ static vk::Pipeline PreparePipeline(
 
   // Two stages: vs and fs
   pipeline_create_info.stageCount(2);
-  vk::PipelineShaderStageCreateInfo shader_stages[2];
-
-  Shader::InitializeGlslang();
-  shader_stages[0].stage(vk::ShaderStageFlagBits::eVertex);
-  shader_stages[0].module(PrepareVs(device));
-  shader_stages[0].pName("main");
-
-  shader_stages[1].stage(vk::ShaderStageFlagBits::eFragment);
-  shader_stages[1].module(PrepareFs(device));
-  shader_stages[1].pName("main");
-  Shader::FinalizeGlslang();
 
   pipeline_create_info.pVertexInputState(&vertexState);
   pipeline_create_info.pInputAssemblyState(&ia);
@@ -749,21 +807,55 @@ static vk::Pipeline PreparePipeline(
   pipeline_create_info.renderPass(renderPass);
   pipeline_create_info.pDynamicState(&dynamic_state);
 
+  vk::Pipeline pipeline;
+  vk::chk(device.createGraphicsPipelines(pipelineCache, 1, &pipeline_create_info,
+                                         nullptr, &pipeline));
+
+  return pipeline;
+}
+
+void DemoScene::PreparePipelines() {
+  auto shader_load_start = std::chrono::steady_clock::now();
+
   vk::PipelineCache pipeline_cache;
   vk::PipelineCacheCreateInfo pipeline_cache_create_info;
-  vk::chk(device.createPipelineCache(&pipeline_cache_create_info, nullptr,
-                                     &pipeline_cache));
+  vk::chk(vk_device().createPipelineCache(&pipeline_cache_create_info, nullptr,
+                                          &pipeline_cache));
 
-  vk::Pipeline pipeline;
-  vk::chk(device.createGraphicsPipelines(pipeline_cache, 1, &pipeline_create_info,
-                                         nullptr, &pipeline));
+  // -1 means the pipeline can draw any face
+  std::vector<int> faces;
+  if (Settings::kPerFacePipelines) {
+    faces = {0, 1, 2, 3, 4, 5};
+  } else {
+    faces = {-1};
+  }
 
-  device.destroyPipelineCache(pipeline_cache, nullptr);
+  for (int face : faces) {
+    Shader::SpecializationConstants constants = Shader::SpecializationConstants{}
+        .Add(1, float(Settings::kSphereRadius))
+        .Add(2, float(Settings::kFaceSize))
+        .Add(3, float(Settings::kMaxHeight))
+        .Add(4, int32_t(quad_trees_[0].max_node_level()))
+        .Add(5, int32_t(face));
+
+    const vk::PipelineShaderStageCreateInfo shader_stages[2] = {
+      shader_permutations_.GetStage(vk::ShaderStageFlagBits::eVertex,
+                                    "src/glsl/simple.vert", constants),
+      shader_permutations_.GetStage(vk::ShaderStageFlagBits::eFragment,
+                                    "src/glsl/simple.frag")
+    };
+
+    pipelines_.push_back(PreparePipeline(vk_device(), vertex_input_,
+                                         pipeline_layout_, render_pass_,
+                                         pipeline_cache, shader_stages));
+  }
 
-  device.destroyShaderModule(shader_stages[0].module(), nullptr);
-  device.destroyShaderModule(shader_stages[1].module(), nullptr);
+  vk_device().destroyPipelineCache(pipeline_cache, nullptr);
 
-  return pipeline;
+  std::chrono::duration<double, std::milli> shader_load_time =
+      std::chrono::steady_clock::now() - shader_load_start;
+  std::cout << "Pipelines created in " << shader_load_time.count() << " ms"
+            << std::endl;
 }
 
 void DemoScene::PrepareFramebuffers() {
@@ -800,98 +892,170 @@ void DemoScene::Prepare() {
     PrepareDescriptorSet();
 
     PrepareRenderPass();
-    pipeline_ = PreparePipeline(vk_device(), vertex_input_,
-                                pipeline_layout_, render_pass_);
+    PreparePipelines();
 
     PrepareFramebuffers();
+    PrepareFrames();
+
+    // Everything has to be uploaded and recorded again
+    instances_dirty_ = true;
+    recorded_instance_versions_.assign(vk_swapchain_image_count(), 0);
 }
 
 void DemoScene::Cleanup() {
+    DestroyFrames();
     for (uint32_t i = 0; i < vk_swapchain_image_count(); i++) {
         vk_device().destroyFramebuffer(framebuffers_.get()[i], nullptr);
     }
     vk_device().destroyDescriptorPool(desc_pool_, nullptr);
 
-    vk_device().destroyPipeline(pipeline_, nullptr);
+    for (vk::Pipeline pipeline : pipelines_) {
+      vk_device().destroyPipeline(pipeline, nullptr);
+    }
+    pipelines_.clear();
     vk_device().destroyRenderPass(render_pass_, nullptr);
     vk_device().destroyPipelineLayout(pipeline_layout_, nullptr);
     vk_device().destroyDescriptorSetLayout(desc_layout_, nullptr);
 
     vk_device().destroyBuffer(uniform_data_.buf, nullptr);
-    vk_device().freeMemory(uniform_data_.mem, nullptr);
+    device_allocator().Free(uniform_data_.mem);
 
     vk_device().destroyBuffer(vertex_attribs_.buf, nullptr);
-    vk_device().freeMemory(vertex_attribs_.mem, nullptr);
+    device_allocator().Free(vertex_attribs_.mem);
     vk_device().destroyBuffer(instance_attribs_.buf, nullptr);
-    vk_device().freeMemory(instance_attribs_.mem, nullptr);
+    device_allocator().Free(instance_attribs_.mem);
     vk_device().destroyBuffer(indices_.buf, nullptr);
-    vk_device().freeMemory(indices_.mem, nullptr);
+    device_allocator().Free(indices_.mem);
 
     for (uint32_t i = 0; i < DEMO_TEXTURE_COUNT; i++) {
         vk_device().destroyImageView(textures_[i].view, nullptr);
         vk_device().destroyImage(textures_[i].image, nullptr);
-        vk_device().freeMemory(textures_[i].mem, nullptr);
+        device_allocator().Free(textures_[i].mem);
         vk_device().destroySampler(textures_[i].sampler, nullptr);
     }
 }
 
-#include <ctime>
-static clock_t startTime;
-static int renderedFrames;
-
-DemoScene::DemoScene(GLFWwindow *window)
-    : VulkanScene(window)
+DemoScene::DemoScene(GLFWwindow *window, glm::ivec2 headless_size)
+    : VulkanScene(window, headless_size)
+    , shader_permutations_(vk_device())
     , quad_trees_{
-        {Settings::kFaceSize, CubeFace::kPosX},
-        {Settings::kFaceSize, CubeFace::kNegX},
-        {Settings::kFaceSize, CubeFace::kPosY},
-        {Settings::kFaceSize, CubeFace::kNegY},
-        {Settings::kFaceSize, CubeFace::kPosZ},
-        {Settings::kFaceSize, CubeFace::kNegZ},
+        {Settings::kFaceSize, CubeFace::kPosX, lod_table_, &height_query_},
+        {Settings::kFaceSize, CubeFace::kNegX, lod_table_, &height_query_},
+        {Settings::kFaceSize, CubeFace::kPosY, lod_table_, &height_query_},
+        {Settings::kFaceSize, CubeFace::kNegY, lod_table_, &height_query_},
+        {Settings::kFaceSize, CubeFace::kPosZ, lod_table_, &height_query_},
+        {Settings::kFaceSize, CubeFace::kNegZ, lod_table_, &height_query_},
       } {
   Prepare();
-  set_camera(AddComponent<engine::FreeFlyCamera>(
+  auto camera = AddComponent<engine::FreeFlyCamera>(
       glm::radians(60.0), 10, 1000000, glm::dvec3{-54483.2, 38919.9, 13576.9},
-      glm::dvec3{10, 0, 10}, 5000));
-  startTime = clock();
+      glm::dvec3{10, 0, 10}, 5000);
+  camera->set_position_constraint([this](const glm::dvec3& pos) {
+    return height_query_.ClampAboveGround(pos,
+                                          Settings::kCameraGroundClearance);
+  });
+  set_camera(camera);
 }
 
 DemoScene::~DemoScene() {
-  clock_t endTime = clock();
-  double elapsedSecs = double(endTime - startTime) / CLOCKS_PER_SEC;
-  std::cout << "Average FPS: " << renderedFrames / elapsedSecs << std::endl;
+  FinishRendering();
+  WaitForFrames();
+  frame_statistics().PrintSessionSummary(std::cout);
+  PrintLatencySummary(std::cout);
+  frame_statistics().WriteHistogram(Settings::kFrameTimeHistogramPath);
+  gpu_profiler().PrintSummary(std::cout);
+  device_allocator().PrintStatistics(std::cout);
+  if (lod_controller_.sample_count() != 0) {
+    lod_controller_.WriteTelemetry(Settings::kAdaptiveLodCsvPath);
+  }
   Cleanup();
 }
 
+// With a render thread, the packet is handed over to it, and the main thread
+// only waits if the render thread is queue depth frames behind.
 void DemoScene::Render() {
-  Draw();
-  renderedFrames++;
+  auto packet = std::make_shared<FramePacket>();
+  UpdateInstances();
+  packet->input_ns = turn_begin_ns();
+  packet->uniforms = uniforms_;
+  packet->instances = instances_;
+  packet->instance_version = instance_version_;
+  packet->instance_count = grid_mesh_.node_count();
+  std::copy(std::begin(face_instances_), std::end(face_instances_),
+            std::begin(packet->face_instances));
+  std::copy(std::begin(face_order_), std::end(face_order_),
+            std::begin(packet->face_order));
+
+  if (render_thread()) {
+    double wait_ms = render_thread()->Submit([this, packet] { Draw(*packet); });
+    frame_statistics().AddPhaseTime(engine::FrameStatistics::kPresentWait,
+                                    wait_ms);
+  } else {
+    Draw(*packet);
+  }
 }
 
-void DemoScene::Update() {
-  {
-    glm::mat4 mvp = scene()->camera()->projectionMatrix() *
-                    scene()->camera()->cameraMatrix();
-
-    UniformData* uniform_data;
-    vk::chk(vk_device().mapMemory(uniform_data_.mem, 0, sizeof(mvp),
-                                 vk::MemoryMapFlags{}, (void **)&uniform_data));
+// It runs in the render phase rather than in the updates, so the selection
+// follows the interpolated camera of every rendered frame.
+void DemoScene::UpdateInstances() {
+  PROFILE_SCOPE("DemoScene::UpdateInstances");
+
+  // The selected nodes only depend on the camera, if it didn't move, the last
+  // frame's uniforms, instances and draw commands can be reused.
+  const engine::Camera& camera = *scene()->camera();
+  if (Settings::kReuseUnchangedFrames && !instances_dirty_ &&
+      camera.cameraMatrix() == last_camera_matrix_ &&
+      camera.projectionMatrix() == last_projection_matrix_) {
+    last_frame_selected_ = false;
+    return;
+  }
+  last_camera_matrix_ = camera.cameraMatrix();
+  last_projection_matrix_ = camera.projectionMatrix();
+  instances_dirty_ = false;
+  ++instance_version_;
+
+  UpdateLodRanges(camera);
+  last_frame_selected_ = true;
+
+  uniforms_.mvp = camera.projectionMatrix() * camera.cameraMatrix();
+  uniforms_.camera_pos = camera.pos();
+  if (uploaded_lod_version_ != lod_table_.version()) {
+    lod_table_.GetShaderTable(uniforms_.lod_levels);
+    uploaded_lod_version_ = lod_table_.version();
+  }
 
-    uniform_data->mvp = mvp;
-    uniform_data->camera_pos = scene()->camera()->transform().pos();
-    uniform_data->terrain_smallest_geometry_lod_distance = Settings::kSmallestGeometryLodDistance;
-    uniform_data->terrain_sphere_radius = Settings::kSphereRadius;
-    uniform_data->face_size = Settings::kFaceSize;
-    uniform_data->height_scale = Settings::kMaxHeight;
-    uniform_data->terrain_max_lod_level = quad_trees_[0].max_node_level();
+  // update instances to draw
+  {
+    PROFILE_SCOPE("select nodes");
+    grid_mesh_.ClearRenderList();
+    for (int face = 0; face < 6; ++face) {
+      face_instances_[face].first = grid_mesh_.node_count();
+      quad_trees_[face].SelectNodes(camera, grid_mesh_);
+      face_instances_[face].count =
+          grid_mesh_.node_count() - face_instances_[face].first;
+    }
+  }
 
-    vk_device().unmapMemory(uniform_data_.mem);
+  // The sort keeps the faces in order, so face_instances_ stays valid
+  if (Settings::kMortonOrderedInstances || front_to_back_) {
+    PROFILE_SCOPE("sort instances");
+    grid_mesh_.SortRenderList(front_to_back_ ? &lod_table_ : nullptr);
   }
 
-  // update instances to draw
-  grid_mesh_.ClearRenderList();
-  for (CdlodQuadTree& quad_tree : quad_trees_) {
-    quad_tree.SelectNodes(*scene()->camera(), grid_mesh_);
+  // The nearest instance of a face is its first one after the sort
+  for (int face = 0; face < 6; ++face) {
+    face_order_[face] = face;
+  }
+  if (front_to_back_) {
+    const std::vector<float>& distances = grid_mesh_.distances();
+    auto nearest = [&](int face) {
+      return face_instances_[face].count ?
+          distances[face_instances_[face].first] :
+          std::numeric_limits<float>::max();
+    };
+    std::stable_sort(face_order_, face_order_ + 6, [&](int a, int b) {
+      return nearest(a) < nearest(b);
+    });
   }
 
   if (grid_mesh_.mesh_.render_data_.size() > Settings::kMaxInstanceCount) {
@@ -899,21 +1063,92 @@ void DemoScene::Update() {
     std::terminate();
   }
 
-  {
-    glm::vec4 *render_data_;
-    vk::chk(vk_device().mapMemory(instance_attribs_.mem, 0,
-                                 Settings::kMaxInstanceCount * sizeof(glm::vec4),
-                                 vk::MemoryMapFlags{}, (void **)&render_data_));
+  instances_ = std::make_shared<const std::vector<glm::vec4>>(
+      grid_mesh_.mesh_.render_data_);
+}
 
-    for (int i = 0; i < grid_mesh_.mesh_.render_data_.size(); ++i) {
-      render_data_[i] = grid_mesh_.mesh_.render_data_[i];
-    }
+// The latency is measured from the start of the frame's Turn() (the input was
+// polled right before it) to when its fence is seen signaled (see
+// FinishFrame()). The display's own latency isn't included.
+void DemoScene::PrintLatencySummary(std::ostream& os) const {
+  if (input_latencies_ms_.empty()) {
+    return;
+  }
+
+  std::vector<double> sorted = input_latencies_ms_;
+  std::sort(sorted.begin(), sorted.end());
+  os << "Input to present latency (ms): avg "
+     << Statistics::Average(sorted) << ", p50 "
+     << Statistics::PercentileOfSorted(sorted, 50) << ", p95 "
+     << Statistics::PercentileOfSorted(sorted, 95) << ", max "
+     << sorted.back() << std::endl;
+
+  double seconds = (last_present_ns_ - first_present_ns_) / 1e9;
+  os << "Throughput: ";
+  if (seconds > 0) {
+    os << (sorted.size() - 1) / seconds << " frames per second";
+  } else {
+    os << "-";
+  }
+  if (render_queue_depth()) {
+    os << ", with a render thread of queue depth " << render_queue_depth();
+  } else {
+    os << ", without a render thread";
+  }
+  os << std::endl;
+}
 
-    vk_device().unmapMemory(instance_attribs_.mem);
+void DemoScene::UpdateLodRanges(const engine::Camera& camera) {
+  double smallest_range = Settings::kSmallestGeometryLodDistance;
+  if (screen_space_error_lod_) {
+    smallest_range = CdlodLodTable::ScreenSpaceErrorRange(
+        Settings::kLodGeometricError, Settings::kLodPixelError,
+        camera.projectionMatrix(), framebuffer_size().y);
+  }
+  // A reused frame's time says nothing about the cost of the selected lod.
+  // The total would include the present wait, that vsync stretches to the
+  // refresh interval whatever the lod is, so only the work is counted.
+  if (adaptive_lod_ && last_frame_selected_) {
+    using engine::FrameStatistics;
+    lod_controller_.Update(Settings::kAdaptiveLodInstanceBudget ?
+        double(grid_mesh_.node_count()) :
+        frame_statistics().last_frame_ms(FrameStatistics::kUpdate) +
+        frame_statistics().last_frame_ms(FrameStatistics::kRender));
+  }
+  if (adaptive_lod_) {
+    smallest_range *= lod_controller_.multiplier();
+  }
+
+  // This is a no-op if the ranges didn't change, otherwise the quadtrees
+  // retest the lod spheres, and the shader's table is uploaded again.
+  lod_table_.set_smallest_range(smallest_range);
+}
+
+void DemoScene::KeyAction(int key, int scancode, int action, int mods) {
+  VulkanScene::KeyAction(key, scancode, action, mods);
+  if (action == GLFW_PRESS && key == GLFW_KEY_F3) {
+    front_to_back_ = !front_to_back_;
+    instances_dirty_ = true;
+    std::cout << "Front to back instance order: "
+              << (front_to_back_ ? "on" : "off") << std::endl;
+  }
+  if (action == GLFW_PRESS && key == GLFW_KEY_F4) {
+    screen_space_error_lod_ = !screen_space_error_lod_;
+    instances_dirty_ = true;
+    std::cout << "Lod metric: "
+              << (screen_space_error_lod_ ? "screen space error" : "distance")
+              << std::endl;
+  }
+  if (action == GLFW_PRESS && key == GLFW_KEY_F5) {
+    adaptive_lod_ = !adaptive_lod_;
+    instances_dirty_ = true;
+    std::cout << "Adaptive lod: " << (adaptive_lod_ ? "on" : "off")
+              << ", multiplier: " << lod_controller_.multiplier() << std::endl;
   }
 }
 
 void DemoScene::ScreenResizedClean() {
+  FinishRendering();
   Cleanup();
   VulkanScene::ScreenResizedClean();
 }
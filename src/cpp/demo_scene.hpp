@@ -3,12 +3,21 @@
 #ifndef DEMO_SCENE_HPP_
 #define DEMO_SCENE_HPP_
 
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <type_traits>
 #include <vulkan/vk_cpp.h>
 #include <GLFW/glfw3.h>
 
 #include "engine/vulkan_scene.hpp"
 #include "cdlod/cdlod_quad_tree.hpp"
+#include "cdlod/cdlod_linear_quad_tree.hpp"
+#include "cdlod/cdlod_lod_table.hpp"
+#include "cdlod/cdlod_lod_controller.hpp"
+#include "cdlod/terrain_height_query.hpp"
 #include "common/vulkan_application.hpp"
+#include "shader/shader_permutations.hpp"
 
 #define DEMO_TEXTURE_COUNT 6
 
@@ -18,55 +27,62 @@ struct TextureObject {
   vk::Image image;
   vk::ImageLayout imageLayout;
 
-  vk::DeviceMemory mem;
+  engine::DeviceAllocation mem;
   vk::ImageView view;
   int32_t tex_width = 0, tex_height = 0;
 };
 
+// The std140 layout of the vertex shader's uniform block.
 struct UniformData {
   glm::mat4 mvp;
   glm::vec3 camera_pos;
-  float terrain_smallest_geometry_lod_distance;
-  float terrain_sphere_radius;
-  float face_size;
-  float height_scale;
-  int terrain_max_lod_level;
+  float padding;
+  // Only written if the lod ranges change, see CdlodLodTable::GetShaderTable
+  glm::vec4 lod_levels[CdlodLodTable::kMaxLevelCount];
 };
 
 class DemoScene : public engine::VulkanScene {
 public:
-  DemoScene(GLFWwindow *window);
+  DemoScene(GLFWwindow *window, glm::ivec2 headless_size = glm::ivec2{});
   ~DemoScene();
 
   virtual void Render() override;
-  virtual void Update() override;
   virtual void ScreenResizedClean() override;
   virtual void ScreenResized(size_t width, size_t height) override;
+  virtual void KeyAction(int key, int scancode, int action, int mods) override;
 
 private:
   bool kUseStagingBuffer = true;
 
   struct TextureObject textures_[DEMO_TEXTURE_COUNT];
 
+  // Every swapchain image has its own UniformData in it, this far apart, that
+  // its draw command selects with a dynamic offset.
   struct {
     vk::Buffer buf;
-    vk::DeviceMemory mem;
+    engine::DeviceAllocation mem;
     vk::DescriptorBufferInfo buffer_info;
+    vk::DeviceSize stride = 0;
   } uniform_data_;
 
   vk::PipelineVertexInputStateCreateInfo vertex_input_;
   vk::VertexInputBindingDescription vertex_input_bindings_[2];
   vk::VertexInputAttributeDescription vertex_input_attribs_[2];
 
+  // Every swapchain image has its own kMaxInstanceCount instances in
+  // instance_attribs_.
   struct {
     vk::Buffer buf;
-    vk::DeviceMemory mem;
+    engine::DeviceAllocation mem;
   } vertex_attribs_, instance_attribs_, indices_;
 
   vk::PipelineLayout pipeline_layout_;
   vk::DescriptorSetLayout desc_layout_;
   vk::RenderPass render_pass_;
-  vk::Pipeline pipeline_;
+  // One pipeline per cube face if Settings::kPerFacePipelines, otherwise one
+  // pipeline, that can draw any face.
+  std::vector<vk::Pipeline> pipelines_;
+  Shader::PermutationCache shader_permutations_;
 
   vk::DescriptorPool desc_pool_;
   vk::DescriptorSet desc_set_;
@@ -74,16 +90,112 @@ private:
   std::unique_ptr<vk::Framebuffer> framebuffers_;
 
   QuadGridMesh grid_mesh_{Settings::kNodeDimension};
-  CdlodQuadTree quad_trees_[6];
-
-  void BuildDrawCmd();
-  void Draw();
-  void PrepareTextureImage(const unsigned char *tex_colors,
+  // The quadtrees select with this table, and the shader morphs with it. With
+  // the screen space error metric (F4 toggles it), its ranges follow the
+  // projection and the framebuffer's height.
+  CdlodLodTable lod_table_{CdlodLodTable::Default()};
+  bool screen_space_error_lod_ = Settings::kScreenSpaceErrorLod;
+  uint64_t uploaded_lod_version_ = 0;
+
+  // Scales the ranges to keep the cost of the frames under the budget (F5
+  // toggles it). It's only given the frames that ran the selection.
+  CdlodLodController lod_controller_{
+      Settings::kAdaptiveLodInstanceBudget ?
+          double(Settings::kAdaptiveLodInstanceBudget) :
+          Settings::kAdaptiveLodFrameTimeBudgetMs,
+      Settings::kAdaptiveLodHysteresis, Settings::kAdaptiveLodMinMultiplier,
+      Settings::kAdaptiveLodMaxMultiplier};
+  bool adaptive_lod_ = Settings::kAdaptiveLod;
+  bool last_frame_selected_ = false;
+
+  // The CPU copy of the heightmaps, keeps the camera above the terrain, and
+  // gives the heights of the quadtree nodes, so it's made before them.
+  TerrainHeightQuery height_query_{
+      TerrainHeightQuery::Load(Settings::kHeightmapDirectory)};
+  using QuadTree = std::conditional<Settings::kLinearQuadTree,
+                                    CdlodLinearQuadTree, CdlodQuadTree>::type;
+  QuadTree quad_trees_[6];
+
+  // The instances of each face are contiguous in the render list.
+  struct FaceInstances {
+    uint32_t first = 0, count = 0;
+  };
+  FaceInstances face_instances_[6];
+
+  // The instance data is only updated if the camera changed since the last
+  // frame (or after a resize). Each update gets a new version, and a swapchain
+  // image's uniforms and instances are only uploaded, and its draw command
+  // recorded again, if they are of an older version (zero means never).
+  glm::dmat4 last_camera_matrix_, last_projection_matrix_;
+  bool instances_dirty_ = true;
+  uint64_t instance_version_ = 0;
+  std::vector<uint64_t> recorded_instance_versions_;
+  UniformData uniforms_;
+  std::shared_ptr<const std::vector<glm::vec4>> instances_;
+
+  // Sort the instances front to back (F3 toggles it). The faces are drawn
+  // in face_order_, that is nearest first then.
+  bool front_to_back_ = Settings::kFrontToBackInstances;
+  int face_order_[6] = {0, 1, 2, 3, 4, 5};
+
+  // What Draw() needs of a frame. Render() builds it on the main thread, and
+  // it isn't changed after that, so it can be drawn on the render thread,
+  // while the main thread goes on with the next frame.
+  struct FramePacket {
+    // The data of the instance version, shared by the packets until the
+    // camera changes. A swapchain image that already has this version only
+    // submits its recorded draw command again.
+    UniformData uniforms;
+    std::shared_ptr<const std::vector<glm::vec4>> instances;
+    uint64_t instance_version = 0;
+    uint32_t instance_count = 0;
+    FaceInstances face_instances[6];
+    int face_order[6];
+    int64_t input_ns = 0;  // see Scene::turn_begin_ns()
+  };
+
+  // The frames that the GPU might still be drawing, at most one per
+  // swapchain image. A frame's semaphores and fence are reused after its
+  // fence was signaled, so Draw() only waits for the GPU if every frame is
+  // still in flight, or if the acquired image's last frame is.
+  struct FrameSync {
+    vk::Semaphore image_acquired, render_finished;
+    vk::Fence fence;
+    bool in_flight = false;
+    uint32_t image = 0;
+    int64_t input_ns = 0;
+  };
+  std::vector<FrameSync> frames_;
+  size_t next_frame_ = 0;
+  // The index of the frame that last drew into each swapchain image, or -1
+  std::vector<int> image_frames_;
+
+  // Written by Draw() (on the render thread, if there's one), and only read
+  // after FinishRendering().
+  std::vector<double> input_latencies_ms_;
+  int64_t first_present_ns_ = 0, last_present_ns_ = 0;
+
+  void UpdateInstances();
+  void UpdateLodRanges(const engine::Camera& camera);
+  void BuildDrawCmd(const FramePacket& packet);
+  void Draw(const FramePacket& packet);
+  void Upload(const FramePacket& packet, uint32_t image);
+  void PrepareFrames();
+  void DestroyFrames();
+  // Collects the results of the frame if the GPU finished it. It waits for
+  // the frame's fence if wait is true. Returns if the frame isn't in flight.
+  bool FinishFrame(FrameSync& frame, bool wait);
+  // Waits for every frame in flight.
+  void WaitForFrames();
+  void PrintLatencySummary(std::ostream& os) const;
+  void PrepareTextureImage(const uint16_t *tex_colors,
                            int tex_width, int tex_height,
                            TextureObject *tex_obj, vk::ImageTiling tiling,
                            vk::ImageUsageFlags usage,
-                           vk::MemoryPropertyFlags required_props,
-                           vk::Format tex_format);
+                           MemoryUsage memory_usage,
+                           vk::Format tex_format,
+                           engine::DeviceAllocator::Strategy strategy =
+                               engine::DeviceAllocator::Strategy::kFreeList);
   void PrepareTextures();
   void PrepareIndices();
   void PrepareVertices();
@@ -93,6 +205,7 @@ private:
   void PrepareUniformBuffer();
   void PrepareDescriptorSet();
   void PrepareFramebuffers();
+  void PreparePipelines();
   void Prepare();
   void Cleanup();
 };
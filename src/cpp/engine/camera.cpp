@@ -2,6 +2,8 @@
 
 #include "engine/camera.hpp"
 #include "engine/scene.hpp"
+#include "engine/cpu_profiler.hpp"
+#include "common/settings.hpp"
 
 namespace engine {
 
@@ -17,14 +19,45 @@ void Camera::ScreenResized(size_t width, size_t height) {
 }
 
 void Camera::Update() {
-  UpdateCameraMatrix();
+  const Transform& t = transform();
+  Pose pose{t.pos(), t.forward(), t.up()};
+  previous_pose_ = has_pose_ ? current_pose_ : pose;
+  current_pose_ = pose;
+  has_pose_ = true;
+
+  UpdateMatrices(current_pose_);
+}
+
+void Camera::Interpolate(double alpha) {
+  if (!has_pose_) { return; }
+  if (!Settings::kInterpolateCamera || alpha >= 1.0) {
+    UpdateMatrices(current_pose_);
+    return;
+  }
+
+  Pose pose;
+  pose.pos = glm::mix(previous_pose_.pos, current_pose_.pos, alpha);
+  pose.forward = glm::mix(previous_pose_.forward, current_pose_.forward, alpha);
+  pose.up = glm::mix(previous_pose_.up, current_pose_.up, alpha);
+  // The directions can't be blended if the camera turned around in one step
+  if (glm::length(pose.forward) < Settings::kEpsilon ||
+      glm::length(pose.up) < Settings::kEpsilon) {
+    pose = current_pose_;
+  }
+  pose.forward = glm::normalize(pose.forward);
+  pose.up = glm::normalize(pose.up);
+  UpdateMatrices(pose);
+}
+
+void Camera::UpdateMatrices(const Pose& pose) {
+  UpdateCameraMatrix(pose);
   UpdateProjectionMatrix();
   UpdateFrustum();
 }
 
-void Camera::UpdateCameraMatrix() {
-  const Transform& t = transform();
-  cam_mat_ = glm::lookAt(t.pos(), t.pos()+t.forward(), t.up());
+void Camera::UpdateCameraMatrix(const Pose& pose) {
+  render_pos_ = pose.pos;
+  cam_mat_ = glm::lookAt(pose.pos, pose.pos + pose.forward, pose.up);
 }
 
 void Camera::UpdateProjectionMatrix() {
@@ -90,10 +123,13 @@ FreeFlyCamera::FreeFlyCamera(GameObject* parent, double fov, double z_near,
 }
 
 void FreeFlyCamera::Update() {
-  glm::dvec2 cursor_pos;
-  GLFWwindow* window = scene_->window();
-  glfwGetCursorPos(window, &cursor_pos.x, &cursor_pos.y);
+  PROFILE_SCOPE("FreeFlyCamera::Update");
   static glm::dvec2 prev_cursor_pos;
+  glm::dvec2 cursor_pos = prev_cursor_pos;
+  GLFWwindow* window = scene_->window();
+  if (window) {
+    glfwGetCursorPos(window, &cursor_pos.x, &cursor_pos.y);
+  }
   glm::dvec2 diff = cursor_pos - prev_cursor_pos;
   prev_cursor_pos = cursor_pos;
 
@@ -128,17 +164,22 @@ void FreeFlyCamera::Update() {
   // Update the position
   double ds = dt * speed_per_sec_;
   glm::dvec3 local_pos = transform().local_pos();
-  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-    local_pos += transform().forward() * ds;
-  }
-  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-    local_pos -= transform().forward() * ds;
-  }
-  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-    local_pos += transform().right() * ds;
+  if (window) {
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+      local_pos += transform().forward() * ds;
+    }
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+      local_pos -= transform().forward() * ds;
+    }
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+      local_pos += transform().right() * ds;
+    }
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+      local_pos -= transform().right() * ds;
+    }
   }
-  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-    local_pos -= transform().right() * ds;
+  if (position_constraint_) {
+    local_pos = position_constraint_(local_pos);
   }
   transform().set_local_pos(local_pos);
 
@@ -174,10 +215,13 @@ ThirdPersonalCamera::ThirdPersonalCamera(GameObject* parent,
 }
 
 void ThirdPersonalCamera::Update() {
+  PROFILE_SCOPE("ThirdPersonalCamera::Update");
   static glm::dvec2 prev_cursor_pos;
-  glm::dvec2 cursor_pos;
+  glm::dvec2 cursor_pos = prev_cursor_pos;
   GLFWwindow* window = scene_->window();
-  glfwGetCursorPos(window, &cursor_pos.x, &cursor_pos.y);
+  if (window) {
+    glfwGetCursorPos(window, &cursor_pos.x, &cursor_pos.y);
+  }
   glm::dvec2 diff = cursor_pos - prev_cursor_pos;
   prev_cursor_pos = cursor_pos;
 
@@ -4,6 +4,7 @@
 #define ENGINE_CAMERA_H_
 
 #include <cmath>
+#include <functional>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -21,7 +22,10 @@ class CameraTransform : public Transform {
 
   // We shouldn't inherit the parent's rotation, like how a normal Transform does
   virtual const quat rot() const override { return rot_; }
-  virtual void set_rot(const quat& new_rot) override { rot_ = new_rot; }
+  virtual void set_rot(const quat& new_rot) override {
+    rot_ = new_rot;
+    Invalidate();
+  }
 
   // We have custom up and right vectors
   virtual vec3 up() const override { return up_; }
@@ -48,6 +52,9 @@ class Camera : public GameObject {
 
   virtual void ScreenResized(size_t width, size_t height) override;
 
+  // The rendered frame's position (see Interpolate()), the transform has the
+  // position of the last update.
+  const glm::dvec3& pos() const { return render_pos_; }
   const glm::dmat4& cameraMatrix() const { return cam_mat_; }
   const glm::dmat4& projectionMatrix() const { return proj_mat_; }
   const Frustum& frustum() const { return frustum_; }
@@ -61,17 +68,29 @@ class Camera : public GameObject {
   double z_far() const { return z_far_;}
   void set_z_far(double z_far) { z_far_ = z_far; }
 
+  // Computes the matrices of the rendered frame between the poses of the last
+  // two updates, alpha = 0 is the previous one, and 1 is the current one.
+  void Interpolate(double alpha);
+
  protected:
   // it must be called through Derived::Update()
   virtual void Update() override;
 
  private:
+  struct Pose {
+    glm::dvec3 pos, forward, up;
+  };
+
   double fovy_, z_near_, z_far_, width_, height_;
 
+  glm::dvec3 render_pos_;
   glm::dmat4 cam_mat_, proj_mat_;
   Frustum frustum_;
+  Pose previous_pose_, current_pose_;
+  bool has_pose_ = false;
 
-  void UpdateCameraMatrix();
+  void UpdateMatrices(const Pose& pose);
+  void UpdateCameraMatrix(const Pose& pose);
   void UpdateProjectionMatrix();
   void UpdateFrustum();
 };
@@ -92,9 +111,17 @@ class FreeFlyCamera : public Camera {
   void set_mouse_sensitivity(double value) { mouse_sensitivity_ = value; }
   void set_cos_max_pitch_angle(double value) { cos_max_pitch_angle_ = value; }
 
+  // If it's set, the camera's new local position is passed through it on
+  // every update, for ex. to keep the camera above the terrain.
+  using PositionConstraint = std::function<glm::dvec3(const glm::dvec3&)>;
+  void set_position_constraint(PositionConstraint constraint) {
+    position_constraint_ = std::move(constraint);
+  }
+
  protected:
   bool first_call_;
   double speed_per_sec_, mouse_sensitivity_, cos_max_pitch_angle_;
+  PositionConstraint position_constraint_;
 
  private:
   virtual void Update() override;
@@ -0,0 +1,150 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/camera_track.hpp"
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "engine/scene.hpp"
+#include "engine/cpu_profiler.hpp"
+
+namespace engine {
+
+CameraPose CameraTrack::Sample(double time) const {
+  if (poses_.empty()) {
+    return CameraPose{time, glm::dvec3{}, glm::dvec3{0, 0, -1},
+                      glm::dvec3{0, 1, 0}, glm::radians(60.0)};
+  }
+
+  auto next = std::upper_bound(poses_.begin(), poses_.end(), time,
+      [](double t, const CameraPose& pose) { return t < pose.time; });
+  if (next == poses_.begin()) {
+    return poses_.front();
+  } else if (next == poses_.end()) {
+    return poses_.back();
+  }
+
+  const CameraPose& a = *(next - 1);
+  const CameraPose& b = *next;
+  double t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1.0;
+
+  CameraPose pose;
+  pose.time = time;
+  pose.pos = glm::mix(a.pos, b.pos, t);
+  pose.forward = glm::normalize(glm::mix(a.forward, b.forward, t));
+  pose.up = glm::normalize(glm::mix(a.up, b.up, t));
+  pose.fovy = glm::mix(a.fovy, b.fovy, t);
+  return pose;
+}
+
+size_t CameraTrack::frame_count(double timestep) const {
+  return static_cast<size_t>(std::floor(duration() / timestep)) + 1;
+}
+
+bool CameraTrack::Load(const std::string& path) {
+  std::ifstream file(path.c_str());
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open camera track '" << path << "'." << std::endl;
+    return false;
+  }
+
+  poses_.clear();
+  std::string line;
+  for (int line_number = 1; std::getline(file, line); ++line_number) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream is(line);
+    CameraPose pose;
+    is >> pose.time >> pose.pos.x >> pose.pos.y >> pose.pos.z
+       >> pose.forward.x >> pose.forward.y >> pose.forward.z
+       >> pose.up.x >> pose.up.y >> pose.up.z >> pose.fovy;
+    if (!is || (!poses_.empty() && pose.time < poses_.back().time)) {
+      std::cerr << path << ':' << line_number << ": invalid camera pose."
+                << std::endl;
+      poses_.clear();
+      return false;
+    }
+    poses_.push_back(pose);
+  }
+
+  return true;
+}
+
+bool CameraTrack::Save(const std::string& path) const {
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open '" << path << "' for writing." << std::endl;
+    return false;
+  }
+
+  file << "# time pos.xyz forward.xyz up.xyz fovy" << std::endl;
+  file << std::setprecision(std::numeric_limits<double>::max_digits10);
+  for (const CameraPose& pose : poses_) {
+    file << pose.time << ' '
+         << pose.pos.x << ' ' << pose.pos.y << ' ' << pose.pos.z << ' '
+         << pose.forward.x << ' ' << pose.forward.y << ' ' << pose.forward.z << ' '
+         << pose.up.x << ' ' << pose.up.y << ' ' << pose.up.z << ' '
+         << pose.fovy << '\n';
+  }
+
+  return true;
+}
+
+CameraTrackRecorder::CameraTrackRecorder(GameObject* parent,
+                                         const std::string& path)
+    : GameObject(parent), path_(path) {
+  if (scene_) {
+    DeclareUpdateAccess(scene_->UpdateResource("camera"), 0);
+  }
+}
+
+CameraTrackRecorder::~CameraTrackRecorder() {
+  if (track_.Save(path_)) {
+    std::cout << "Camera track of " << track_.poses().size()
+              << " poses saved to '" << path_ << "'." << std::endl;
+  }
+}
+
+void CameraTrackRecorder::Update() {
+  const Camera* camera = scene_ ? scene_->camera() : nullptr;
+  if (!camera) { return; }
+
+  const Transform& t = camera->transform();
+  track_.Add(CameraPose{time_, t.pos(), t.forward(), t.up(), camera->fovy()});
+  time_ += scene_->camera_time().dt();
+}
+
+ReplayCamera::ReplayCamera(GameObject* parent, double z_near, double z_far,
+                           const CameraTrack& track, double timestep)
+    : Camera(parent, track.Sample(0).fovy, z_near, z_far)
+    , track_(track), timestep_(timestep) {
+  ApplyPose(track_.Sample(0));
+  // Unlike the other cameras, it doesn't read the input, so it can be updated
+  // on any thread. It might be stepped without a scene though.
+  if (scene_) {
+    DeclareUpdateAccess(0, scene_->UpdateResource("camera"));
+  }
+}
+
+void ReplayCamera::Update() {
+  PROFILE_SCOPE("ReplayCamera::Update");
+  ApplyPose(track_.Sample(time_));
+  time_ += timestep_;
+
+  Camera::Update();
+}
+
+void ReplayCamera::ApplyPose(const CameraPose& pose) {
+  transform().set_pos(pose.pos);
+  transform().set_forward(pose.forward);
+  transform().set_up(pose.up);
+  set_fovy(pose.fovy);
+}
+
+}  // namespace engine
@@ -0,0 +1,87 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_CAMERA_TRACK_H_
+#define ENGINE_CAMERA_TRACK_H_
+
+#include <string>
+#include <vector>
+
+#include "engine/camera.hpp"
+
+namespace engine {
+
+struct CameraPose {
+  double time;  // in seconds, from the start of the track
+  glm::dvec3 pos, forward, up;
+  double fovy;
+};
+
+// A recorded camera flight, that can be replayed to get identical frames in
+// different performance runs.
+//
+// The file format is text, one pose per line:
+//   time pos.x pos.y pos.z forward.x forward.y forward.z up.x up.y up.z fovy
+// Lines starting with '#' are comments.
+class CameraTrack {
+ public:
+  // The poses have to be added in increasing time order.
+  void Add(const CameraPose& pose) { poses_.push_back(pose); }
+  void Clear() { poses_.clear(); }
+
+  // Interpolates between the two closest poses, and clamps to the ends.
+  CameraPose Sample(double time) const;
+
+  const std::vector<CameraPose>& poses() const { return poses_; }
+  bool empty() const { return poses_.empty(); }
+  double duration() const { return poses_.empty() ? 0 : poses_.back().time; }
+
+  // The number of frames a replay with this timestep takes.
+  size_t frame_count(double timestep) const;
+
+  bool Load(const std::string& path);
+  bool Save(const std::string& path) const;
+
+ private:
+  std::vector<CameraPose> poses_;
+};
+
+// Records the pose of the scene's camera every frame, and saves it on
+// destruction.
+class CameraTrackRecorder : public GameObject {
+ public:
+  CameraTrackRecorder(GameObject* parent, const std::string& path);
+  virtual ~CameraTrackRecorder();
+
+ private:
+  std::string path_;
+  CameraTrack track_;
+  double time_ = 0;
+
+  virtual void Update() override;
+};
+
+// A camera that follows a track with a fixed timestep, independently of the
+// wall time and of any input.
+class ReplayCamera : public Camera {
+ public:
+  ReplayCamera(GameObject* parent, double z_near, double z_far,
+               const CameraTrack& track, double timestep);
+
+  double time() const { return time_; }
+  bool finished() const { return time_ > track_.duration(); }
+
+  // Public, so that the camera can be stepped without a scene (for ex. in a
+  // benchmark). Don't forget to call ScreenResized() before the first step.
+  virtual void Update() override;
+
+ private:
+  CameraTrack track_;
+  double timestep_;
+  double time_ = 0;
+
+  void ApplyPose(const CameraPose& pose);
+};
+
+}  // namespace engine
+
+#endif
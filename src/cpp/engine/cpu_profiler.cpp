@@ -0,0 +1,138 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/cpu_profiler.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+
+namespace engine {
+
+namespace {
+
+struct Event {
+  const char* name;
+  int64_t begin_ns, end_ns;
+};
+
+// Caps the memory usage of a long session at 24 MB (1M events) per thread.
+constexpr size_t kMaxEventsPerThread = 1 << 20;
+
+struct ThreadBuffer {
+  uint32_t thread_index = 0;
+  std::vector<Event> events;
+  size_t dropped_events = 0;
+};
+
+// The thread buffers are only added here (under the mutex), and are never
+// freed, so that a thread can keep a pointer to its own buffer.
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& registry() {
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+ThreadBuffer& thread_buffer() {
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (!buffer) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.buffers.push_back(make_unique<ThreadBuffer>());
+    buffer = reg.buffers.back().get();
+    buffer->thread_index = reg.buffers.size() - 1;
+  }
+  return *buffer;
+}
+
+std::atomic<bool> profiler_enabled{Settings::kCpuProfiling};
+
+const std::chrono::steady_clock::time_point start_time =
+    std::chrono::steady_clock::now();
+
+void WriteJsonString(std::ostream& os, const char* str) {
+  os << '"';
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      os << '\\';
+    }
+    os << *str;
+  }
+  os << '"';
+}
+
+}
+
+CpuProfiler::ScopedMarker::ScopedMarker(const char* name)
+    : name_(enabled() ? name : nullptr)
+    , begin_ns_(name_ ? Now() : 0) {}
+
+CpuProfiler::ScopedMarker::~ScopedMarker() {
+  if (!name_) { return; }
+
+  int64_t end_ns = Now();
+  ThreadBuffer& buffer = thread_buffer();
+  if (buffer.events.size() < kMaxEventsPerThread) {
+    buffer.events.push_back(Event{name_, begin_ns_, end_ns});
+  } else {
+    buffer.dropped_events++;
+  }
+}
+
+bool CpuProfiler::enabled() {
+  return profiler_enabled.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::set_enabled(bool enabled) {
+  profiler_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t CpuProfiler::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start_time).count();
+}
+
+bool CpuProfiler::WriteChromeTrace(const std::string& path) {
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open '" << path << "' for writing." << std::endl;
+    return false;
+  }
+
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+
+  // The timestamps are in microseconds. The events are written in the order
+  // they ended, the trace viewers reconstruct the nesting from the times.
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  file.setf(std::ios::fixed);
+  file.precision(3);
+  bool first = true;
+  for (const auto& buffer : reg.buffers) {
+    for (const Event& event : buffer->events) {
+      file << (first ? "\n" : ",\n") << "{\"name\":";
+      WriteJsonString(file, event.name);
+      file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->thread_index
+           << ",\"ts\":" << event.begin_ns / 1000.0
+           << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << '}';
+      first = false;
+    }
+
+    if (buffer->dropped_events) {
+      std::cerr << "CpuProfiler: thread " << buffer->thread_index << " dropped "
+                << buffer->dropped_events << " events." << std::endl;
+    }
+  }
+  file << "\n]}" << std::endl;
+
+  return true;
+}
+
+}  // namespace engine
@@ -0,0 +1,60 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_CPU_PROFILER_H_
+#define ENGINE_CPU_PROFILER_H_
+
+#include <string>
+#include <cstdint>
+
+#include "common/settings.hpp"
+
+namespace engine {
+
+// A low overhead profiler for the CPU side of the frame, with nested scopes.
+//
+// Every thread records into its own buffer, so a scope costs two clock reads
+// and a push_back, without any locking. The recorded scopes can be written out
+// in the Chrome trace event format, which can be opened with chrome://tracing
+// or https://ui.perfetto.dev.
+//
+// Mark the scopes with PROFILE_SCOPE("name"). The name has to be a string
+// literal (only the pointer is stored). Building with VK_PROFILING=0 compiles
+// all the markers out.
+class CpuProfiler {
+ public:
+  class ScopedMarker {
+   public:
+    explicit ScopedMarker(const char* name);
+    ~ScopedMarker();
+
+    ScopedMarker(const ScopedMarker&) = delete;
+    ScopedMarker& operator=(const ScopedMarker&) = delete;
+
+   private:
+    const char* name_;
+    int64_t begin_ns_;
+  };
+
+  static bool enabled();
+  static void set_enabled(bool enabled);
+
+  // Nanoseconds from a monotonic clock, since the start of the program.
+  static int64_t Now();
+
+  // Writes the scopes recorded by every thread. The other threads shouldn't
+  // record anything meanwhile.
+  static bool WriteChromeTrace(const std::string& path);
+};
+
+}  // namespace engine
+
+#if VK_PROFILING
+  #define PROFILE_CONCAT_IMPL(a, b) a##b
+  #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+  #define PROFILE_SCOPE(name) \
+    engine::CpuProfiler::ScopedMarker PROFILE_CONCAT(profile_scope_, __LINE__){name}
+#else
+  #define PROFILE_SCOPE(name)
+#endif
+
+#endif
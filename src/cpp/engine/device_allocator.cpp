@@ -0,0 +1,414 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/device_allocator.hpp"
+
+#include <iomanip>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+#include "common/error_checking.hpp"
+
+namespace engine {
+
+static vk::DeviceSize AlignUp(vk::DeviceSize offset, vk::DeviceSize alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+static double Megabytes(vk::DeviceSize bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+
+DeviceAllocator::DeviceAllocator(const vk::Device& device,
+                                 const vk::PhysicalDevice& gpu,
+                                 vk::DeviceSize block_size,
+                                 double heap_budget)
+    : device_(device) {
+  gpu.getMemoryProperties(&memory_properties_);
+
+  vk::PhysicalDeviceProperties properties;
+  gpu.getProperties(&properties);
+  buffer_image_granularity_ = properties.limits().bufferImageGranularity();
+  non_coherent_atom_size_ =
+      std::max<vk::DeviceSize>(properties.limits().nonCoherentAtomSize(), 1);
+  max_allocation_count_ = properties.limits().maxMemoryAllocationCount();
+
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount(); ++i) {
+    uint32_t heap = memory_properties_.memoryTypes()[i].heapIndex();
+    vk::DeviceSize heap_size = memory_properties_.memoryHeaps()[heap].size();
+    block_sizes_.push_back(std::min(block_size, heap_size / 8));
+  }
+  for (uint32_t i = 0; i < memory_properties_.memoryHeapCount(); ++i) {
+    heap_budgets_.push_back(static_cast<vk::DeviceSize>(
+        memory_properties_.memoryHeaps()[i].size() * heap_budget));
+  }
+  heap_block_bytes_.resize(heap_budgets_.size());
+}
+
+DeviceAllocator::~DeviceAllocator() {
+  for (Block& block : blocks_) {
+    if (block.size) {
+      DestroyBlock(block);
+    }
+  }
+}
+
+DeviceAllocator::Placement DeviceAllocator::Place(
+    uint32_t memory_type, const vk::MemoryRequirements& requirements,
+    bool linear_resources, Strategy strategy) const {
+  Placement placement;
+
+  // The flushed ranges have to be aligned to the atom size, and they
+  // shouldn't touch the neighbouring allocations
+  placement.size = requirements.size();
+  placement.alignment = std::max<vk::DeviceSize>(requirements.alignment(), 1);
+  if (IsNonCoherent(memory_type)) {
+    placement.size = AlignUp(placement.size, non_coherent_atom_size_);
+    placement.alignment = AlignUp(placement.alignment, non_coherent_atom_size_);
+  }
+
+  const vk::DeviceSize block_size = block_sizes_[memory_type];
+  if (placement.size > block_size / 2) {
+    placement.new_block_bytes = placement.size;
+    placement.dedicated = true;
+    return placement;
+  }
+
+  vk::DeviceSize offset;
+  for (uint32_t i = 0; i < blocks_.size(); ++i) {
+    const Block& block = blocks_[i];
+    if (block.size && !block.dedicated && block.memory_type == memory_type &&
+        block.strategy == strategy &&
+        block.linear_resources == linear_resources &&
+        FindOffset(block, placement.size, placement.alignment, offset)) {
+      placement.block = i;
+      return placement;
+    }
+  }
+
+  placement.new_block_bytes = block_size;
+  return placement;
+}
+
+DeviceAllocation DeviceAllocator::Allocate(
+    const vk::MemoryRequirements& requirements,
+    MemoryUsage usage, bool linear_resource, Strategy strategy) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Without a granularity, any two resources can be neighbours
+  const bool linear_resources =
+      linear_resource || buffer_image_granularity_ <= 1;
+
+  // Only a new block takes from the heap's budget, an existing block with
+  // room for the resource is free to use.
+  const uint32_t type_count = memory_properties_.memoryTypeCount();
+  std::vector<Placement> placements(type_count);
+  std::vector<vk::DeviceSize> new_bytes(type_count);
+  for (uint32_t i = 0; i < type_count; ++i) {
+    if ((requirements.memoryTypeBits() >> i) & 1) {
+      placements[i] = Place(i, requirements, linear_resources, strategy);
+      new_bytes[i] = placements[i].new_block_bytes;
+    }
+  }
+  std::vector<vk::DeviceSize> budgets_left(heap_budgets_.size());
+  for (size_t i = 0; i < budgets_left.size(); ++i) {
+    budgets_left[i] = heap_budgets_[i] > heap_block_bytes_[i] ?
+                      heap_budgets_[i] - heap_block_bytes_[i] : 0;
+  }
+  const uint32_t memory_type = ChooseMemoryType(
+      memory_properties_, requirements.memoryTypeBits(),
+      MemoryTypeRequestFor(usage), budgets_left.data(), new_bytes.data());
+
+  const Placement& placement = placements[memory_type];
+  uint32_t block = placement.block;
+  if (block == Placement::kNewBlock) {
+    // It fits into an empty block for sure
+    block = CreateBlock(memory_type, placement.new_block_bytes, strategy,
+                        linear_resources, placement.dedicated);
+  }
+
+  DeviceAllocation allocation;
+  AllocateFrom(block, placement.size, placement.alignment, allocation);
+  return allocation;
+}
+
+DeviceAllocation DeviceAllocator::AllocateBuffer(
+    const vk::Buffer& buffer, MemoryUsage usage, Strategy strategy) {
+  vk::MemoryRequirements requirements;
+  device_.getBufferMemoryRequirements(buffer, &requirements);
+
+  DeviceAllocation allocation =
+      Allocate(requirements, usage, true, strategy);
+  vk::chk(device_.bindBufferMemory(buffer, allocation.memory,
+                                   allocation.offset));
+  return allocation;
+}
+
+DeviceAllocation DeviceAllocator::AllocateImage(
+    const vk::Image& image, vk::ImageTiling tiling, MemoryUsage usage,
+    Strategy strategy) {
+  vk::MemoryRequirements requirements;
+  device_.getImageMemoryRequirements(image, &requirements);
+
+  DeviceAllocation allocation = Allocate(
+      requirements, usage, tiling == vk::ImageTiling::eLinear, strategy);
+  vk::chk(device_.bindImageMemory(image, allocation.memory,
+                                  allocation.offset));
+  return allocation;
+}
+
+void DeviceAllocator::Free(DeviceAllocation& allocation) {
+  if (!allocation) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Block& block = blocks_[allocation.block];
+  --block.allocation_count;
+  block.used_bytes -= allocation.size;
+  used_bytes_ -= allocation.size;
+
+  if (block.dedicated) {
+    DestroyBlock(block);
+  } else if (block.strategy == Strategy::kLinear) {
+    if (block.allocation_count == 0) {
+      block.top = 0;
+    }
+  } else {
+    auto range = block.free_ranges.emplace(allocation.offset,
+                                           allocation.size).first;
+    auto next = std::next(range);
+    if (next != block.free_ranges.end() &&
+        range->first + range->second == next->first) {
+      range->second += next->second;
+      block.free_ranges.erase(next);
+    }
+    if (range != block.free_ranges.begin()) {
+      auto prev = std::prev(range);
+      if (prev->first + prev->second == range->first) {
+        prev->second += range->second;
+        block.free_ranges.erase(range);
+      }
+    }
+  }
+
+  allocation = DeviceAllocation{};
+}
+
+void DeviceAllocator::Flush(const DeviceAllocation& allocation) const {
+  if (!allocation || !IsNonCoherent(allocation.memory_type)) {
+    return;
+  }
+  const vk::MappedMemoryRange range = vk::MappedMemoryRange()
+      .memory(allocation.memory)
+      .offset(allocation.offset)
+      .size(allocation.size);
+  vk::chk(device_.flushMappedMemoryRanges(1, &range));
+}
+
+void DeviceAllocator::Invalidate(const DeviceAllocation& allocation) const {
+  if (!allocation || !IsNonCoherent(allocation.memory_type)) {
+    return;
+  }
+  const vk::MappedMemoryRange range = vk::MappedMemoryRange()
+      .memory(allocation.memory)
+      .offset(allocation.offset)
+      .size(allocation.size);
+  vk::chk(device_.invalidateMappedMemoryRanges(1, &range));
+}
+
+bool DeviceAllocator::IsNonCoherent(uint32_t memory_type) const {
+  vk::MemoryPropertyFlags flags = memory_properties(memory_type);
+  return (flags & vk::MemoryPropertyFlagBits::eHostVisible) &&
+         !(flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+uint32_t DeviceAllocator::CreateBlock(uint32_t memory_type,
+                                      vk::DeviceSize size, Strategy strategy,
+                                      bool linear_resources, bool dedicated) {
+  if (live_device_allocations_ >= max_allocation_count_) {
+    throw std::runtime_error("Too many device memory allocations.");
+  }
+
+  Block block;
+  block.size = size;
+  block.memory_type = memory_type;
+  block.strategy = strategy;
+  block.linear_resources = linear_resources;
+  block.dedicated = dedicated;
+
+  const vk::MemoryAllocateInfo alloc_info = vk::MemoryAllocateInfo()
+      .allocationSize(size)
+      .memoryTypeIndex(memory_type);
+  vk::chk(device_.allocateMemory(&alloc_info, nullptr, &block.memory));
+  ++device_allocation_count_;
+  ++live_device_allocations_;
+  heap_block_bytes_[memory_properties_.memoryTypes()[memory_type]
+                        .heapIndex()] += size;
+
+  if (memory_properties_.memoryTypes()[memory_type].propertyFlags() &
+      vk::MemoryPropertyFlagBits::eHostVisible) {
+    vk::chk(device_.mapMemory(block.memory, 0, VK_WHOLE_SIZE,
+                              vk::MemoryMapFlags{}, &block.mapped));
+  }
+  if (strategy == Strategy::kFreeList) {
+    block.free_ranges[0] = size;
+  }
+
+  for (uint32_t i = 0; i < blocks_.size(); ++i) {
+    if (!blocks_[i].size) {
+      blocks_[i] = std::move(block);
+      return i;
+    }
+  }
+  blocks_.push_back(std::move(block));
+  return blocks_.size() - 1;
+}
+
+void DeviceAllocator::DestroyBlock(Block& block) {
+  if (block.mapped) {
+    device_.unmapMemory(block.memory);
+  }
+  device_.freeMemory(block.memory, nullptr);
+  --live_device_allocations_;
+  heap_block_bytes_[memory_properties_.memoryTypes()[block.memory_type]
+                        .heapIndex()] -= block.size;
+  block = Block{};
+}
+
+bool DeviceAllocator::FindOffset(const Block& block, vk::DeviceSize size,
+                                 vk::DeviceSize alignment,
+                                 vk::DeviceSize& offset) const {
+  if (block.strategy == Strategy::kLinear) {
+    offset = AlignUp(block.top, alignment);
+    return offset + size <= block.size;
+  }
+
+  for (const auto& range : block.free_ranges) {
+    offset = AlignUp(range.first, alignment);
+    if (offset + size <= range.first + range.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DeviceAllocator::AllocateFrom(uint32_t block_index, vk::DeviceSize size,
+                                   vk::DeviceSize alignment,
+                                   DeviceAllocation& allocation) {
+  Block& block = blocks_[block_index];
+  vk::DeviceSize offset = 0;
+  if (!FindOffset(block, size, alignment, offset)) {
+    return false;
+  }
+
+  if (block.strategy == Strategy::kLinear) {
+    block.top = offset + size;
+  } else {
+    // The free range that the offset is in
+    auto range = std::prev(block.free_ranges.upper_bound(offset));
+
+    // The padding before the allocation and the rest after it stay free
+    const vk::DeviceSize range_begin = range->first;
+    const vk::DeviceSize range_end = range->first + range->second;
+    block.free_ranges.erase(range);
+    if (range_begin < offset) {
+      block.free_ranges[range_begin] = offset - range_begin;
+    }
+    if (offset + size < range_end) {
+      block.free_ranges[offset + size] = range_end - (offset + size);
+    }
+  }
+
+  ++block.allocation_count;
+  block.used_bytes += size;
+  used_bytes_ += size;
+  peak_used_bytes_ = std::max(peak_used_bytes_, used_bytes_);
+
+  allocation.memory = block.memory;
+  allocation.offset = offset;
+  allocation.size = size;
+  allocation.mapped =
+      block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+  allocation.memory_type = block.memory_type;
+  allocation.block = block_index;
+  return true;
+}
+
+void DeviceAllocator::AddStatistics(const Block& block,
+                                    Statistics& statistics) const {
+  if (!block.size) {
+    return;
+  }
+
+  ++statistics.block_count;
+  statistics.allocation_count += block.allocation_count;
+  statistics.block_bytes += block.size;
+  statistics.used_bytes += block.used_bytes;
+
+  vk::DeviceSize largest_free_range = 0;
+  if (block.strategy == Strategy::kLinear) {
+    largest_free_range = block.size - block.top;
+  } else {
+    for (const auto& range : block.free_ranges) {
+      largest_free_range = std::max(largest_free_range, range.second);
+    }
+  }
+  statistics.largest_free_range =
+      std::max(statistics.largest_free_range, largest_free_range);
+}
+
+DeviceAllocator::Statistics DeviceAllocator::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Statistics statistics;
+  for (const Block& block : blocks_) {
+    AddStatistics(block, statistics);
+  }
+  return statistics;
+}
+
+DeviceAllocator::Statistics DeviceAllocator::statistics(
+    uint32_t memory_type) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Statistics statistics;
+  for (const Block& block : blocks_) {
+    if (block.memory_type == memory_type) {
+      AddStatistics(block, statistics);
+    }
+  }
+  return statistics;
+}
+
+void DeviceAllocator::PrintStatistics(std::ostream& os) const {
+  os << "Device memory: " << device_allocation_count()
+     << " vkAllocateMemory calls (limit " << max_allocation_count_
+     << "), peak " << std::fixed << std::setprecision(2)
+     << Megabytes(peak_used_bytes()) << " MB used" << std::endl;
+  os << "memory type  blocks  allocations  block MB   used MB  largest free MB"
+     << "  properties" << std::endl;
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount(); ++i) {
+    Statistics type_statistics = statistics(i);
+    if (!type_statistics.block_count) {
+      continue;
+    }
+    os << std::setw(11) << i
+       << std::setw(8) << type_statistics.block_count
+       << std::setw(13) << type_statistics.allocation_count
+       << std::setw(10) << Megabytes(type_statistics.block_bytes)
+       << std::setw(10) << Megabytes(type_statistics.used_bytes)
+       << std::setw(17) << Megabytes(type_statistics.largest_free_range)
+       << "  " << MemoryPropertyNames(memory_properties(i)) << std::endl;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint32_t i = 0; i < heap_budgets_.size(); ++i) {
+    if (heap_block_bytes_[i]) {
+      os << "heap " << i << ": " << Megabytes(heap_block_bytes_[i])
+         << " MB of the " << Megabytes(heap_budgets_[i]) << " MB budget"
+         << std::endl;
+    }
+  }
+  os.unsetf(std::ios::floatfield);
+}
+
+}  // namespace engine
@@ -0,0 +1,166 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_DEVICE_ALLOCATOR_H_
+#define ENGINE_DEVICE_ALLOCATOR_H_
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <iostream>
+#include <vulkan/vk_cpp.h>
+
+#include "common/vulkan_memory.hpp"
+
+namespace engine {
+
+// A range of a memory block, that a buffer or an image is bound to.
+struct DeviceAllocation {
+  vk::DeviceMemory memory;
+  vk::DeviceSize offset = 0, size = 0;
+  // Points to the offset, if the memory is host visible. The host visible
+  // blocks stay mapped for their whole life.
+  void* mapped = nullptr;
+  uint32_t memory_type = 0;
+  uint32_t block = 0;
+
+  explicit operator bool() const { return size != 0; }
+};
+
+// Sub-allocates the buffers and the images from big vkAllocateMemory blocks,
+// instead of allocating memory for each of them, as the number of allocations
+// is limited (maxMemoryAllocationCount can be as low as 4096), and they are
+// slow.
+//
+// Every block belongs to one memory type and one strategy:
+//  - kFreeList finds the first free range that fits, and merges the freed
+//    ranges with their free neighbours. For the long lived resources.
+//  - kLinear only bumps an offset, and its block is reused after all of its
+//    allocations were freed. For the short lived ones, like a staging image.
+// The offsets follow the resources' alignment. The linear resources (buffers
+// and linear images) and the optimal images don't share a block if the
+// device's bufferImageGranularity is bigger than one, so they can never be
+// closer than that. The resources bigger than half a block get a block of
+// their own, that is freed with them.
+//
+// The memory type is chosen for the MemoryUsage (see ChooseMemoryType), within
+// the heap's budget: a Settings::kMemoryHeapBudget fraction of its size. Only
+// the new blocks count against the budget, not the allocations that fit into
+// an existing block.
+//
+// The empty blocks are kept, so recreating the resources (after a resize)
+// doesn't allocate again. The blocks are freed by the destructor, every
+// allocation should be freed (and its resource destroyed) before that.
+class DeviceAllocator {
+ public:
+  enum class Strategy { kFreeList, kLinear };
+
+  // The block_size is limited to an eighth of the memory heap's size.
+  DeviceAllocator(const vk::Device& device, const vk::PhysicalDevice& gpu,
+                  vk::DeviceSize block_size, double heap_budget = 1.0);
+  ~DeviceAllocator();
+
+  DeviceAllocator(const DeviceAllocator&) = delete;
+  DeviceAllocator& operator=(const DeviceAllocator&) = delete;
+
+  // Throws std::runtime_error if no memory type fits the usage.
+  DeviceAllocation Allocate(const vk::MemoryRequirements& requirements,
+                            MemoryUsage usage, bool linear_resource,
+                            Strategy strategy = Strategy::kFreeList);
+
+  // Allocates the memory of the resource and binds it.
+  DeviceAllocation AllocateBuffer(const vk::Buffer& buffer, MemoryUsage usage,
+                                  Strategy strategy = Strategy::kFreeList);
+  DeviceAllocation AllocateImage(const vk::Image& image,
+                                 vk::ImageTiling tiling, MemoryUsage usage,
+                                 Strategy strategy = Strategy::kFreeList);
+
+  // Resets the allocation. Freeing an empty allocation is a no-op.
+  void Free(DeviceAllocation& allocation);
+
+  // If the memory isn't host coherent, the host's writes have to be flushed
+  // before the device reads them, and the device's writes invalidated before
+  // the host reads them. They are no-ops for the coherent memory.
+  void Flush(const DeviceAllocation& allocation) const;
+  void Invalidate(const DeviceAllocation& allocation) const;
+
+  vk::MemoryPropertyFlags memory_properties(uint32_t memory_type) const {
+    return memory_properties_.memoryTypes()[memory_type].propertyFlags();
+  }
+
+  struct Statistics {
+    size_t block_count = 0, allocation_count = 0;
+    vk::DeviceSize block_bytes = 0, used_bytes = 0;
+    // If it's much smaller than the free bytes, the free space is fragmented.
+    vk::DeviceSize largest_free_range = 0;
+  };
+
+  Statistics statistics() const;
+  Statistics statistics(uint32_t memory_type) const;
+  // The number of vkAllocateMemory calls so far, and the peak used bytes.
+  size_t device_allocation_count() const { return device_allocation_count_; }
+  vk::DeviceSize peak_used_bytes() const { return peak_used_bytes_; }
+
+  // The statistics of every memory type that has a block, and of the heaps.
+  void PrintStatistics(std::ostream& os) const;
+
+ private:
+  struct Block {
+    vk::DeviceMemory memory;
+    vk::DeviceSize size = 0;
+    uint32_t memory_type = 0;
+    Strategy strategy = Strategy::kFreeList;
+    bool linear_resources = false;
+    bool dedicated = false;
+    void* mapped = nullptr;
+
+    size_t allocation_count = 0;
+    vk::DeviceSize used_bytes = 0;
+    // Offset -> size, only for kFreeList
+    std::map<vk::DeviceSize, vk::DeviceSize> free_ranges;
+    // The end of the last allocation, only for kLinear
+    vk::DeviceSize top = 0;
+  };
+
+  vk::Device device_;
+  vk::PhysicalDeviceMemoryProperties memory_properties_;
+  vk::DeviceSize buffer_image_granularity_, non_coherent_atom_size_;
+  uint32_t max_allocation_count_;
+  std::vector<vk::DeviceSize> block_sizes_;  // per memory type
+  // Per heap
+  std::vector<vk::DeviceSize> heap_budgets_, heap_block_bytes_;
+
+  // The freed dedicated blocks leave a slot with a null memory, that is
+  // reused by the next block.
+  std::vector<Block> blocks_;
+  size_t device_allocation_count_ = 0, live_device_allocations_ = 0;
+  vk::DeviceSize used_bytes_ = 0, peak_used_bytes_ = 0;
+  mutable std::mutex mutex_;
+
+  // Where an allocation would go in a memory type: into an existing block, or
+  // into a new one of new_block_bytes.
+  struct Placement {
+    static constexpr uint32_t kNewBlock = ~uint32_t(0);
+    vk::DeviceSize size = 0, alignment = 1;
+    uint32_t block = kNewBlock;
+    vk::DeviceSize new_block_bytes = 0;
+    bool dedicated = false;
+  };
+
+  bool IsNonCoherent(uint32_t memory_type) const;
+  Placement Place(uint32_t memory_type,
+                  const vk::MemoryRequirements& requirements,
+                  bool linear_resources, Strategy strategy) const;
+  uint32_t CreateBlock(uint32_t memory_type, vk::DeviceSize size,
+                       Strategy strategy, bool linear_resources,
+                       bool dedicated);
+  void DestroyBlock(Block& block);
+  bool FindOffset(const Block& block, vk::DeviceSize size,
+                  vk::DeviceSize alignment, vk::DeviceSize& offset) const;
+  bool AllocateFrom(uint32_t block_index, vk::DeviceSize size,
+                    vk::DeviceSize alignment, DeviceAllocation& allocation);
+  void AddStatistics(const Block& block, Statistics& statistics) const;
+};
+
+}  // namespace engine
+
+#endif
@@ -0,0 +1,48 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/frame_limiter.hpp"
+
+#include <thread>
+
+namespace engine {
+
+FrameLimiter::FrameLimiter(double max_fps, double spin_ms)
+    : spin_(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double, std::milli>(spin_ms))) {
+  set_max_fps(max_fps);
+}
+
+void FrameLimiter::set_max_fps(double max_fps) {
+  max_fps_ = max_fps > 0 ? max_fps : 0;
+  period_ = max_fps_ ? std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::duration<double>(1.0 / max_fps_))
+                     : Clock::duration::zero();
+  has_deadline_ = false;
+}
+
+void FrameLimiter::Wait() {
+  if (!max_fps_) {
+    return;
+  }
+
+  // The deadline is when the next frame should start
+  Clock::time_point now = Clock::now();
+  if (has_deadline_) {
+    deadline_ += period_;
+  }
+  if (!has_deadline_ || deadline_ < now) {
+    // The first frame, or one that took longer than a period
+    deadline_ = now;
+    has_deadline_ = true;
+    return;
+  }
+
+  if (deadline_ - now > spin_) {
+    std::this_thread::sleep_for(deadline_ - now - spin_);
+  }
+  while (Clock::now() < deadline_) {
+    std::this_thread::yield();
+  }
+}
+
+}  // namespace engine
@@ -0,0 +1,39 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_FRAME_LIMITER_H_
+#define ENGINE_FRAME_LIMITER_H_
+
+#include <chrono>
+
+namespace engine {
+
+// Keeps the frames from starting more often than max_fps per second.
+//
+// The OS's sleep is only accurate to a millisecond or a few, so Wait() sleeps
+// until spin_ms before the deadline, and yields in a loop for the rest. The
+// deadlines follow each other by exactly one period, so the sleep's errors
+// don't add up, but after a long frame the next deadline is counted from the
+// end of that frame, instead of rushing through a burst of frames.
+class FrameLimiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Zero max_fps means no limit.
+  explicit FrameLimiter(double max_fps = 0, double spin_ms = 2.0);
+
+  double max_fps() const { return max_fps_; }
+  void set_max_fps(double max_fps);
+
+  // Call it at the end of every frame.
+  void Wait();
+
+ private:
+  double max_fps_;
+  Clock::duration period_, spin_;
+  Clock::time_point deadline_;
+  bool has_deadline_ = false;
+};
+
+}  // namespace engine
+
+#endif
@@ -0,0 +1,184 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/frame_statistics.hpp"
+
+#include <cmath>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+
+#include "common/statistics.hpp"
+
+namespace engine {
+
+constexpr size_t FrameStatistics::kMaxHistogramBins;
+
+FrameStatistics::FrameStatistics(size_t rolling_window,
+                                 double histogram_bin_ms)
+    : rolling_window_(std::max<size_t>(rolling_window, 1))
+    , histogram_bin_ms_(histogram_bin_ms) {
+  std::fill(std::begin(current_frame_.ms), std::end(current_frame_.ms), 0.0);
+  window_.reserve(rolling_window_);
+}
+
+void FrameStatistics::BeginFrame() {
+  std::fill(std::begin(current_frame_.ms), std::end(current_frame_.ms), 0.0);
+  frame_begin_ = std::chrono::steady_clock::now();
+  if (frame_count_ == 0) {
+    session_begin_ = frame_begin_;
+  }
+  frame_started_ = true;
+}
+
+void FrameStatistics::AddPhaseTime(Phase phase, double ms) {
+  current_frame_.ms[phase] += ms;
+}
+
+void FrameStatistics::EndFrame() {
+  if (!frame_started_) { return; }
+  frame_started_ = false;
+
+  last_frame_end_ = std::chrono::steady_clock::now();
+  current_frame_.ms[kTotal] = std::chrono::duration<double, std::milli>(
+      last_frame_end_ - frame_begin_).count();
+  current_frame_.ms[kRender] = std::max(
+      current_frame_.ms[kRender] - current_frame_.ms[kPresentWait], 0.0);
+
+  if (window_.size() < rolling_window_) {
+    window_.push_back(current_frame_);
+  } else {
+    window_[frame_count_ % rolling_window_] = current_frame_;
+  }
+  AddToTotals(current_frame_);
+  ++frame_count_;
+}
+
+void FrameStatistics::AddToTotals(const Frame& frame) {
+  for (int i = 0; i < kPhaseCount; ++i) {
+    PhaseTotals& totals = totals_[i];
+    const double ms = frame.ms[i];
+    totals.sum += ms;
+    totals.min = frame_count_ == 0 ? ms : std::min(totals.min, ms);
+    totals.max = frame_count_ == 0 ? ms : std::max(totals.max, ms);
+
+    size_t bin = std::min(static_cast<size_t>(ms / histogram_bin_ms_),
+                          kMaxHistogramBins - 1);
+    if (bin >= totals.bins.size()) {
+      totals.bins.resize(bin + 1, 0);
+    }
+    totals.bins[bin]++;
+  }
+}
+
+FrameStatistics::Summary FrameStatistics::RollingSummary(Phase phase) const {
+  Summary summary;
+  if (window_.empty()) {
+    return summary;
+  }
+
+  std::vector<double> samples;
+  samples.reserve(window_.size());
+  for (const Frame& frame : window_) {
+    samples.push_back(frame.ms[phase]);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  summary.min = samples.front();
+  summary.avg = Statistics::Average(samples);
+  summary.p50 = Statistics::PercentileOfSorted(samples, 50);
+  summary.p95 = Statistics::PercentileOfSorted(samples, 95);
+  summary.p99 = Statistics::PercentileOfSorted(samples, 99);
+  summary.max = samples.back();
+  return summary;
+}
+
+FrameStatistics::Summary FrameStatistics::SessionSummary(Phase phase) const {
+  Summary summary;
+  if (frame_count_ == 0) {
+    return summary;
+  }
+
+  const PhaseTotals& totals = totals_[phase];
+  summary.min = totals.min;
+  summary.avg = totals.sum / frame_count_;
+  summary.max = totals.max;
+
+  // The same ranks as PercentileOfSorted, the samples of a bin are assumed
+  // to be spread evenly in it
+  auto percentile = [&](double p) {
+    double rank = p / 100.0 * (frame_count_ - 1);
+    uint64_t below = 0;
+    for (size_t i = 0; i < totals.bins.size(); ++i) {
+      if (rank < below + totals.bins[i]) {
+        double ms = (i + (rank - below + 0.5) / totals.bins[i]) *
+                    histogram_bin_ms_;
+        return std::min(std::max(ms, totals.min), totals.max);
+      }
+      below += totals.bins[i];
+    }
+    return totals.max;
+  };
+  summary.p50 = percentile(50);
+  summary.p95 = percentile(95);
+  summary.p99 = percentile(99);
+  return summary;
+}
+
+void FrameStatistics::PrintSummary(std::ostream& os, bool session) const {
+  os << "Frame times (ms):     min      avg      p50      p95      p99      max"
+     << std::endl;
+  for (int i = 0; i < kPhaseCount; ++i) {
+    Phase phase = static_cast<Phase>(i);
+    Summary s = session ? SessionSummary(phase) : RollingSummary(phase);
+    os << std::left << std::setw(16) << PhaseName(phase) << std::right
+       << std::fixed << std::setprecision(3)
+       << std::setw(9) << s.min << std::setw(9) << s.avg
+       << std::setw(9) << s.p50 << std::setw(9) << s.p95
+       << std::setw(9) << s.p99 << std::setw(9) << s.max << std::endl;
+  }
+  os.unsetf(std::ios::floatfield);
+}
+
+void FrameStatistics::PrintRollingSummary(std::ostream& os) const {
+  os << "Last " << window_.size() << " frames:" << std::endl;
+  PrintSummary(os, false);
+}
+
+void FrameStatistics::PrintSessionSummary(std::ostream& os) const {
+  if (frame_count_ == 0) {
+    return;
+  }
+
+  os << frame_count_ << " frames in " << session_seconds()
+     << " s, average FPS: " << frame_count_ / session_seconds() << std::endl;
+  PrintSummary(os, true);
+}
+
+bool FrameStatistics::WriteHistogram(const std::string& path) const {
+  std::ofstream file(path.c_str());
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open '" << path << "' for writing." << std::endl;
+    return false;
+  }
+
+  const std::vector<uint64_t>& bins = totals_[kTotal].bins;
+  file << "bin_begin_ms,bin_end_ms,frames" << std::endl;
+  for (size_t i = 0; i < bins.size(); ++i) {
+    file << i * histogram_bin_ms_ << ',' << (i + 1) * histogram_bin_ms_ << ','
+         << bins[i] << '\n';
+  }
+
+  return true;
+}
+
+const char* FrameStatistics::PhaseName(Phase phase) {
+  switch (phase) {
+    case kUpdate: return "update";
+    case kRender: return "render";
+    case kPresentWait: return "present wait";
+    case kTotal: return "total";
+    default: return "unknown";
+  }
+}
+
+}  // namespace engine
@@ -0,0 +1,116 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_FRAME_STATISTICS_H_
+#define ENGINE_FRAME_STATISTICS_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+namespace engine {
+
+// Records how long every phase of the frames took, using a monotonic clock.
+//
+// The frame total is measured between BeginFrame() and EndFrame() (by
+// Scene::Turn), the phases are added by the code that knows about them. The
+// present wait happens inside RenderAll(), so it is subtracted from the render
+// time when the frame ends, and the render time only includes the work until
+// the submission.
+//
+// Only the last rolling_window frames are kept. The session's statistics come
+// from running totals and a histogram of each phase, so a long session uses
+// the same memory, and its percentiles are accurate to a histogram bin.
+class FrameStatistics {
+ public:
+  enum Phase { kUpdate, kRender, kPresentWait, kTotal, kPhaseCount };
+
+  struct Summary {
+    double min = 0, avg = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+  };
+
+  // Adds the time from its construction to its destruction to a phase.
+  class PhaseTimer {
+   public:
+    PhaseTimer(FrameStatistics& stats, Phase phase)
+        : stats_(stats), phase_(phase)
+        , begin_(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() {
+      stats_.AddPhaseTime(phase_, std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - begin_).count());
+    }
+
+   private:
+    FrameStatistics& stats_;
+    Phase phase_;
+    std::chrono::steady_clock::time_point begin_;
+  };
+
+  FrameStatistics(size_t rolling_window, double histogram_bin_ms);
+
+  void BeginFrame();
+  void AddPhaseTime(Phase phase, double ms);
+  void EndFrame();
+
+  size_t frame_count() const { return frame_count_; }
+
+  // The wall clock time from the first frame's begin to the last one's end,
+  // with everything between the frames (the events, the frame limiter), that
+  // the frame totals miss.
+  double session_seconds() const {
+    return std::chrono::duration<double>(last_frame_end_ - session_begin_)
+        .count();
+  }
+
+  // Of the last ended frame, zero if there wasn't one.
+  double last_frame_ms(Phase phase) const {
+    return frame_count_ == 0 ? 0.0 :
+        window_[(frame_count_ - 1) % rolling_window_].ms[phase];
+  }
+
+  // Of the last rolling_window frames.
+  Summary RollingSummary(Phase phase) const;
+  // Of every frame since the start, the percentiles are interpolated inside
+  // their histogram bin.
+  Summary SessionSummary(Phase phase) const;
+
+  void PrintRollingSummary(std::ostream& os) const;
+  void PrintSessionSummary(std::ostream& os) const;
+
+  // Writes the histogram of the total frame times as a CSV file.
+  bool WriteHistogram(const std::string& path) const;
+
+  static const char* PhaseName(Phase phase);
+
+ private:
+  // The times over this many bins are counted in the last one.
+  static constexpr size_t kMaxHistogramBins = 1 << 16;
+
+  struct Frame {
+    double ms[kPhaseCount];
+  };
+
+  struct PhaseTotals {
+    double sum = 0, min = 0, max = 0;
+    std::vector<uint64_t> bins;
+  };
+
+  size_t rolling_window_;
+  double histogram_bin_ms_;
+  // A ring buffer, the frame i is at i % rolling_window_
+  std::vector<Frame> window_;
+  size_t frame_count_ = 0;
+  PhaseTotals totals_[kPhaseCount];
+  Frame current_frame_;
+  std::chrono::steady_clock::time_point frame_begin_;
+  std::chrono::steady_clock::time_point session_begin_, last_frame_end_;
+  bool frame_started_ = false;
+
+  void AddToTotals(const Frame& frame);
+  void PrintSummary(std::ostream& os, bool session) const;
+};
+
+}  // namespace engine
+
+#endif
@@ -4,10 +4,18 @@
 #include <GLFW/glfw3.h>
 
 #include "engine/game_engine.hpp"
+#include "engine/cpu_profiler.hpp"
 
 namespace engine {
 
-GameEngine::GameEngine() {
+// The window's size is polled in every this many frames.
+static constexpr size_t kWindowSizePollInterval = 30;
+
+GameEngine::GameEngine(bool headless) : headless_(headless) {
+  if (headless_) {
+    return;
+  }
+
   glfwSetErrorCallback(ErrorCallback);
 
   if (!glfwInit()) {
@@ -34,6 +42,7 @@ GameEngine::GameEngine() {
   glfwSetKeyCallback(window_, KeyCallback);
   glfwSetCharCallback(window_, CharCallback);
   //glfwSetFramebufferSizeCallback(window_, ScreenResizeCallback);
+  glfwSetWindowSizeCallback(window_, WindowSizeCallback);
   glfwSetScrollCallback(window_, MouseScrolledCallback);
   glfwSetMouseButtonCallback(window_, MouseButtonPressed);
   glfwSetCursorPosCallback(window_, MouseMoved);
@@ -46,7 +55,9 @@ GameEngine::~GameEngine() {
     glfwDestroyWindow(window_);
     window_ = nullptr;
   }
-  glfwTerminate();
+  if (!headless_) {
+    glfwTerminate();
+  }
 }
 
 void GameEngine::LoadScene(std::unique_ptr<Scene>&& new_scene) {
@@ -66,25 +77,53 @@ glm::vec2 GameEngine::window_size() {
 void GameEngine::Run() {
   int width = 0, height = 0;
   int last_width = 0, last_height = 0;
-  glfwGetWindowSize(window_, &last_width, &last_height);
-  while (!glfwWindowShouldClose(window_)) {
+  if (window_) {
+    glfwGetWindowSize(window_, &last_width, &last_height);
+  }
+
+  for (size_t frame = 0; frame_limit_ == 0 || frame < frame_limit_; ++frame) {
+    if (window_ && glfwWindowShouldClose(window_)) {
+      break;
+    }
+    PROFILE_SCOPE("Frame");
+
     if (new_scene_) {
       std::swap(scene_, new_scene_);
       new_scene_ = nullptr;
     }
 
     if (scene_) {
-      glfwPollEvents();
+      if (window_) {
+        PROFILE_SCOPE("glfwPollEvents");
+        glfwPollEvents();
+      }
       scene_->Turn();
     }
 
-    // GLFW bug workaround (the screen resize callback is often not called)
-    glfwGetWindowSize(window_, &width, &height);
-    if (width != last_width || height != last_height) {
-      ScreenResizeCallback(window_, width, height);
-      last_width = width;
-      last_height = height;
+    if (window_) {
+      // The resize is only applied here, outside of glfwPollEvents(), as the
+      // callback can come many times during a resize. The size is also polled
+      // now and then, as the callback is not always called (GLFW bug).
+      if (window_resized_ || frame % kWindowSizePollInterval == 0) {
+        window_resized_ = false;
+        glfwGetWindowSize(window_, &width, &height);
+        if (width != last_width || height != last_height) {
+          ScreenResizeCallback(window_, width, height);
+          last_width = width;
+          last_height = height;
+        }
+      }
+    }
+
+    frame_limiter_.Wait();
+  }
+
+  if (Settings::kCpuProfiling) {
+    // No other thread can record scopes while the trace is written
+    if (scene_) {
+      scene_->FinishRendering();
     }
+    CpuProfiler::WriteChromeTrace(Settings::kCpuTraceJsonPath);
   }
 }
 
@@ -136,6 +175,13 @@ void GameEngine::ScreenResizeCallback(GLFWwindow* window, int width, int height)
   }
 }
 
+void GameEngine::WindowSizeCallback(GLFWwindow* window, int width, int height) {
+  GameEngine* game_engine = reinterpret_cast<GameEngine*>(glfwGetWindowUserPointer(window));
+  if (game_engine) {
+    game_engine->window_resized_ = true;
+  }
+}
+
 void GameEngine::MouseScrolledCallback(GLFWwindow* window, double xoffset,
                                   double yoffset) {
   GameEngine* game_engine = reinterpret_cast<GameEngine*>(glfwGetWindowUserPointer(window));
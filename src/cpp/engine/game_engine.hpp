@@ -5,24 +5,41 @@
 
 #include <typeinfo>
 #include "engine/scene.hpp"
+#include "engine/frame_limiter.hpp"
+#include "common/settings.hpp"
 
 namespace engine {
 
 class GameEngine {
  public:
-  GameEngine();
+  // A headless engine doesn't initialize GLFW, and doesn't create a window.
+  explicit GameEngine(bool headless = false);
   ~GameEngine();
 
   void LoadScene(std::unique_ptr<Scene>&& new_scene);
   Scene* scene() { return scene_.get(); }
   GLFWwindow* window() { return window_; }
   glm::vec2 window_size();
+
+  // Run() returns after this many frames (zero means no limit). A headless
+  // engine has no window to be closed, so it should have a frame limit.
+  size_t frame_limit() const { return frame_limit_; }
+  void set_frame_limit(size_t frame_limit) { frame_limit_ = frame_limit; }
+
+  // Paces the frames of Run(), see Settings::kFrameRateLimit.
+  FrameLimiter& frame_limiter() { return frame_limiter_; }
+
   void Run();
 
  private:
   std::unique_ptr<Scene> scene_;
   std::unique_ptr<Scene> new_scene_;
   GLFWwindow *window_ = nullptr;
+  bool headless_;
+  size_t frame_limit_ = 0;
+  FrameLimiter frame_limiter_{Settings::kFrameRateLimit};
+  // Set by the window size callback, the size is checked after the frame.
+  bool window_resized_ = false;
 
   // Callbacks
   static void ErrorCallback(int error, const char* message);
@@ -30,6 +47,7 @@ class GameEngine {
                           int action, int mods);
   static void CharCallback(GLFWwindow* window, unsigned codepoint);
   static void ScreenResizeCallback(GLFWwindow* window, int width, int height);
+  static void WindowSizeCallback(GLFWwindow* window, int width, int height);
   static void MouseScrolledCallback(GLFWwindow* window, double xoffset,
                                     double yoffset);
   static void MouseButtonPressed(GLFWwindow* window, int button,
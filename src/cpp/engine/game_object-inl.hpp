@@ -25,6 +25,7 @@ T* GameObject::AddComponent(Args&&... args) {
   try {
     T *obj = new T(this, std::forward<Args>(args)...);
     components_just_added_.push_back(std::unique_ptr<GameObject>(obj));
+    ComponentsChanged();
     return obj;
   } catch (const std::exception& ex) {
     std::cerr << ex.what() << std::endl;
@@ -14,6 +14,10 @@
 namespace engine {
 
 GameObject::~GameObject() {
+  // The scene might be destroyed already, the removals don't have to be
+  // reported to it anymore.
+  scene_ = nullptr;
+
   // The childrens destructor have to run before this one's,
   // as those functions might try to access this object via the parent_ ptr
   for (auto& comp_ptr : components_) {
@@ -32,6 +36,7 @@ GameObject* GameObject::AddComponent(std::unique_ptr<GameObject>&& component) {
     obj->parent_ = this;
     obj->transform_->set_parent(transform_.get());
     obj->scene_ = scene_;
+    ComponentsChanged();
 
     return obj;
   } catch (const std::exception& ex) {
@@ -45,6 +50,25 @@ void GameObject::set_parent(GameObject* parent) {
   if (parent) { transform_->set_parent(&parent_->transform()); }
 }
 
+void GameObject::DeclareUpdateAccess(uint64_t reads, uint64_t writes) {
+  update_access_declared_ = true;
+  update_reads_ = reads;
+  update_writes_ = writes;
+}
+
+void GameObject::NotOverridden(DispatchedEvent event) {
+  overridden_events_ &= ~event;
+  if (scene_) {
+    scene_->MarkDispatchListsDirty();
+  }
+}
+
+void GameObject::ComponentsChanged() {
+  if (scene_) {
+    scene_->MarkComponentsChanged();
+  }
+}
+
 void GameObject::RenderAll() {
   if (!enabled_) { return; }
 
@@ -144,10 +168,9 @@ void GameObject::InternalUpdate() {
 void GameObject::AddNewComponents() {
   if (!components_just_added_.empty()) {
     // make sure all the componenets just enabled are aware of the screen's size
-    int width, height;
-    glfwGetWindowSize(scene()->window(), &width, &height);
+    glm::ivec2 size = scene()->window_size();
     for (const auto& component : components_just_added_) {
-      component->ScreenResizedAll(width, height);
+      component->ScreenResizedAll(size.x, size.y);
     }
 
     // move them to their new place
@@ -161,10 +184,19 @@ void GameObject::AddNewComponents() {
 
 void GameObject::RemoveComponents() {
   if (!components_to_remove_.empty()) {
+    std::sort(components_to_remove_.begin(), components_to_remove_.end());
+    auto is_removed = [&](const std::unique_ptr<GameObject>& go_ptr) {
+      return std::binary_search(components_to_remove_.begin(),
+                                components_to_remove_.end(), go_ptr.get());
+    };
+    for (auto& component : components_) {
+      // It doesn't have to tell this object that it's removed
+      if (component && is_removed(component)) {
+        component->parent_ = nullptr;
+      }
+    }
     components_.erase(std::remove_if(components_.begin(), components_.end(),
-      [&](const std::unique_ptr<GameObject>& go_ptr){
-        return components_to_remove_.find(go_ptr.get()) != components_to_remove_.end();
-      }), components_.end());
+                                     is_removed), components_.end());
     components_to_remove_.clear();
   }
 }
@@ -180,19 +212,21 @@ bool GameObject::StealComponent(GameObject* go) {
       // The move leaves a nullptr in the parent->components_
       // that should be removed, as it decrases performance
       parent->RemoveComponent(nullptr);
-      component->parent_ = this;
-      component->transform_->set_parent(transform_.get());
-      component->scene_ = scene_;
+      GameObject* stolen = components_just_added_.back().get();
+      stolen->parent_ = this;
+      stolen->transform_->set_parent(transform_.get());
+      stolen->scene_ = scene_;
+      ComponentsChanged();
       return true;
     }
   }
   return false;
 }
 
+// A nullptr removes the empty slots, that StealComponent leaves behind.
 void GameObject::RemoveComponent(GameObject* component_to_remove) {
-  if (component_to_remove) {
-    components_to_remove_.insert(component_to_remove);
-  }
+  components_to_remove_.push_back(component_to_remove);
+  ComponentsChanged();
 }
 
 }  // namespace engine
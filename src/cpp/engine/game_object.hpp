@@ -3,9 +3,9 @@
 #ifndef ENGINE_GAME_OBJECT_H_
 #define ENGINE_GAME_OBJECT_H_
 
-#include <set>
 #include <memory>
 #include <vector>
+#include <cstdint>
 #include <iostream>
 #include <algorithm>
 
@@ -32,6 +32,14 @@ class GameObject {
 
   void RemoveComponent(GameObject* component_to_remove);
 
+  // The events that the scene dispatches every frame, from flattened lists.
+  enum DispatchedEvent : uint8_t {
+    kUpdateEvent = 1 << 0,
+    kRenderEvent = 1 << 1,
+    kRender2DEvent = 1 << 2,
+    kAllDispatchedEvents = kUpdateEvent | kRenderEvent | kRender2DEvent
+  };
+
   Transform& transform() { return *transform_.get(); }
   const Transform& transform() const { return *transform_.get(); }
 
@@ -46,9 +54,21 @@ class GameObject {
   bool enabled() const { return enabled_; }
   void set_enabled(bool value) { enabled_ = value; }
 
-  virtual void Render() {}
-  virtual void Render2D() {}
-  virtual void Update() {}
+  // The shared state that Update() reads and writes, as sets of the scene's
+  // update resources (see Scene::UpdateResource). The parallel update runs the
+  // objects that declared it at the same time, on any thread, unless one of
+  // them writes a resource that the other accesses. The objects that don't
+  // declare it are updated alone, on the scene's thread.
+  void DeclareUpdateAccess(uint64_t reads, uint64_t writes);
+  bool update_access_declared() const { return update_access_declared_; }
+  uint64_t update_reads() const { return update_reads_; }
+  uint64_t update_writes() const { return update_writes_; }
+
+  // The base implementations only record that they aren't overridden, so the
+  // scene doesn't call them anymore. The overrides shouldn't call them.
+  virtual void Render() { NotOverridden(kRenderEvent); }
+  virtual void Render2D() { NotOverridden(kRender2DEvent); }
+  virtual void Update() { NotOverridden(kUpdateEvent); }
   virtual void ScreenResizedClean() {}
   virtual void ScreenResized(size_t width, size_t height) {}
   virtual void KeyAction(int key, int scancode, int action, int mods) {}
@@ -74,14 +94,22 @@ class GameObject {
   std::unique_ptr<Transform> transform_;
   std::vector<std::unique_ptr<GameObject>> components_;
   std::vector<std::unique_ptr<GameObject>> components_just_added_;
-  std::set<GameObject*> components_to_remove_;
+  std::vector<GameObject*> components_to_remove_;
   bool enabled_;
+  uint8_t overridden_events_ = kAllDispatchedEvents;
+  bool update_access_declared_ = false;
+  uint64_t update_reads_ = 0, update_writes_ = 0;
 
   void InternalUpdate();
 
  private:
+  friend class Scene;
+
   void AddNewComponents();
   void RemoveComponents();
+  void NotOverridden(DispatchedEvent event);
+  // Asks the scene to apply the pending additions and removals.
+  void ComponentsChanged();
 };
 
 }  // namespace engine
@@ -0,0 +1,266 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/gpu_profiler.hpp"
+
+#include <memory>
+#include <cassert>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+#include "common/statistics.hpp"
+#include "common/error_checking.hpp"
+
+namespace engine {
+
+const char* const GpuProfiler::kStatisticNames[] = {
+  "input primitives", "vertex shader invocations", "clipping primitives",
+  "fragment shader invocations"
+};
+constexpr uint32_t GpuProfiler::kStatisticCount;
+
+GpuProfiler::GpuProfiler(const vk::Device& device, const vk::PhysicalDevice& gpu,
+                         uint32_t queue_family_index, uint32_t slot_count,
+                         const std::string& csv_path, bool pipeline_statistics)
+    : device_(device), pipeline_statistics_(pipeline_statistics) {
+  if (slot_count == 0) {
+    return;
+  }
+
+  uint32_t queue_count = 0;
+  gpu.getQueueFamilyProperties(&queue_count, nullptr);
+  std::vector<vk::QueueFamilyProperties> queue_props(queue_count);
+  gpu.getQueueFamilyProperties(&queue_count, queue_props.data());
+
+  uint32_t valid_bits = queue_family_index < queue_count ?
+      queue_props[queue_family_index].timestampValidBits() : 0;
+  if (valid_bits == 0) {
+    std::cerr << "The GPU doesn't support timestamp queries on the graphics "
+                 "queue, GPU profiling is disabled." << std::endl;
+    return;
+  }
+  if (valid_bits < 64) {
+    timestamp_mask_ = (uint64_t(1) << valid_bits) - 1;
+  }
+
+  vk::PhysicalDeviceProperties props;
+  gpu.getProperties(&props);
+  timestamp_period_ = props.limits().timestampPeriod();
+
+  CreateSlots(slot_count);
+
+  // The timings are in milliseconds, the statistics are counts
+  csv_.open(csv_path.c_str());
+  if (csv_.is_open()) {
+    csv_ << "frame,scope,value" << std::endl;
+  } else {
+    std::cerr << "Couldn't open '" << csv_path << "' for writing." << std::endl;
+  }
+
+  enabled_ = true;
+}
+
+GpuProfiler::~GpuProfiler() {
+  DestroySlots();
+}
+
+void GpuProfiler::set_slot_count(uint32_t slot_count) {
+  if (!enabled_ || slot_count == slots_.size()) { return; }
+
+  for (uint32_t slot = 0; slot < slots_.size(); ++slot) {
+    CollectResults(slot);
+  }
+  DestroySlots();
+  CreateSlots(slot_count);
+  current_slot_ = nullptr;
+  open_scopes_.clear();
+}
+
+void GpuProfiler::CreateSlots(uint32_t slot_count) {
+  const vk::QueryPoolCreateInfo query_pool_info = vk::QueryPoolCreateInfo()
+      .queryType(vk::QueryType::eTimestamp)
+      .queryCount(2 * kMaxScopesPerFrame);
+
+  const vk::QueryPoolCreateInfo statistics_query_pool_info =
+      vk::QueryPoolCreateInfo()
+      .queryType(vk::QueryType::ePipelineStatistics)
+      .queryCount(1)
+      .pipelineStatistics(
+          vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+          vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+          vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+          vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations);
+
+  slots_.resize(slot_count);
+  for (Slot& slot : slots_) {
+    vk::chk(device_.createQueryPool(&query_pool_info, nullptr, &slot.query_pool));
+    if (pipeline_statistics_) {
+      vk::chk(device_.createQueryPool(&statistics_query_pool_info, nullptr,
+                                      &slot.statistics_query_pool));
+    }
+  }
+}
+
+void GpuProfiler::DestroySlots() {
+  for (Slot& slot : slots_) {
+    device_.destroyQueryPool(slot.query_pool, nullptr);
+    if (slot.statistics_query_pool) {
+      device_.destroyQueryPool(slot.statistics_query_pool, nullptr);
+    }
+  }
+  slots_.clear();
+}
+
+void GpuProfiler::BeginFrame(const vk::CommandBuffer& cmd, uint32_t slot) {
+  if (!enabled_) { return; }
+  assert(slot < slots_.size());
+
+  current_slot_ = &slots_[slot];
+  current_slot_->scopes.clear();
+  open_scopes_.clear();
+
+  cmd.resetQueryPool(current_slot_->query_pool, 0, 2 * kMaxScopesPerFrame);
+  current_slot_->has_statistics = false;
+  if (pipeline_statistics_) {
+    cmd.resetQueryPool(current_slot_->statistics_query_pool, 0, 1);
+  }
+}
+
+void GpuProfiler::BeginScope(const vk::CommandBuffer& cmd,
+                             const std::string& name,
+                             vk::PipelineStageFlagBits stage) {
+  if (!enabled_) { return; }
+  assert(current_slot_);
+
+  std::vector<Scope>& scopes = current_slot_->scopes;
+  if (scopes.size() >= kMaxScopesPerFrame) {
+    throw std::runtime_error("GpuProfiler: too many scopes in a frame.");
+  }
+
+  uint32_t query = 2 * scopes.size();
+  scopes.push_back(Scope{name, query, query + 1});
+  open_scopes_.push_back(scopes.size() - 1);
+
+  cmd.writeTimestamp(stage, current_slot_->query_pool, query);
+}
+
+void GpuProfiler::EndScope(const vk::CommandBuffer& cmd,
+                           vk::PipelineStageFlagBits stage) {
+  if (!enabled_) { return; }
+  assert(current_slot_ && !open_scopes_.empty());
+
+  const Scope& scope = current_slot_->scopes[open_scopes_.back()];
+  open_scopes_.pop_back();
+
+  cmd.writeTimestamp(stage, current_slot_->query_pool, scope.end_query);
+}
+
+void GpuProfiler::BeginStatistics(const vk::CommandBuffer& cmd) {
+  if (!enabled_ || !pipeline_statistics_) { return; }
+  assert(current_slot_ && !current_slot_->has_statistics);
+
+  cmd.beginQuery(current_slot_->statistics_query_pool, 0,
+                 vk::QueryControlFlags());
+  current_slot_->has_statistics = true;
+}
+
+void GpuProfiler::EndStatistics(const vk::CommandBuffer& cmd) {
+  if (!enabled_ || !pipeline_statistics_) { return; }
+  assert(current_slot_ && current_slot_->has_statistics);
+
+  cmd.endQuery(current_slot_->statistics_query_pool, 0);
+}
+
+void GpuProfiler::FrameSubmitted(uint32_t slot) {
+  if (!enabled_) { return; }
+  assert(slot < slots_.size());
+
+  slots_[slot].frame = frame_index_++;
+}
+
+void GpuProfiler::CollectResults(uint32_t slot_index) {
+  if (!enabled_) { return; }
+  assert(slot_index < slots_.size());
+
+  Slot& slot = slots_[slot_index];
+  const uint64_t frame = slot.frame;
+  slot.frame = ~uint64_t(0);
+  if (slot.scopes.empty() || frame == ~uint64_t(0)) {
+    return;
+  }
+
+  uint32_t query_count = 2 * slot.scopes.size();
+  std::unique_ptr<uint64_t[]> timestamps{new uint64_t[query_count]};
+  vk::Result result = device_.getQueryPoolResults(
+      slot.query_pool, 0, query_count, query_count * sizeof(uint64_t),
+      timestamps.get(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+
+  // Don't stall if the results aren't there yet, rather drop this frame.
+  if (result != vk::Result::eSuccess) {
+    return;
+  }
+
+  for (const Scope& scope : slot.scopes) {
+    uint64_t ticks = (timestamps[scope.end_query] - timestamps[scope.begin_query])
+                     & timestamp_mask_;
+    double ms = ticks * timestamp_period_ / 1e6;
+    samples_[scope.name].push_back(ms);
+    if (csv_.is_open()) {
+      csv_ << frame << ',' << scope.name << ',' << ms << '\n';
+    }
+  }
+
+  if (slot.has_statistics) {
+    uint64_t statistics[kStatisticCount];
+    result = device_.getQueryPoolResults(
+        slot.statistics_query_pool, 0, 1, sizeof(statistics), statistics,
+        sizeof(statistics), vk::QueryResultFlagBits::e64);
+    if (result == vk::Result::eSuccess) {
+      for (uint32_t i = 0; i < kStatisticCount; ++i) {
+        statistics_samples_[kStatisticNames[i]].push_back(statistics[i]);
+        if (csv_.is_open()) {
+          csv_ << frame << ',' << kStatisticNames[i] << ','
+               << statistics[i] << '\n';
+        }
+      }
+    }
+  }
+}
+
+void GpuProfiler::PrintSummary(std::ostream& os) const {
+  if (!enabled_ || samples_.empty()) {
+    return;
+  }
+
+  os << "GPU times (ms):       avg      p50      p95      p99      max" << std::endl;
+  for (const auto& scope : samples_) {
+    std::vector<double> sorted = scope.second;
+    std::sort(sorted.begin(), sorted.end());
+
+    os << std::left << std::setw(16) << scope.first << std::right << std::fixed
+       << std::setprecision(3)
+       << std::setw(9) << Statistics::Average(sorted)
+       << std::setw(9) << Statistics::PercentileOfSorted(sorted, 50)
+       << std::setw(9) << Statistics::PercentileOfSorted(sorted, 95)
+       << std::setw(9) << Statistics::PercentileOfSorted(sorted, 99)
+       << std::setw(9) << sorted.back() << std::endl;
+  }
+  os.unsetf(std::ios::floatfield);
+
+  if (statistics_samples_.empty()) {
+    return;
+  }
+
+  os << "GPU pipeline statistics (per frame):  avg          max" << std::endl;
+  for (const auto& statistic : statistics_samples_) {
+    const std::vector<double>& samples = statistic.second;
+    os << std::left << std::setw(30) << statistic.first << std::right
+       << std::fixed << std::setprecision(0)
+       << std::setw(11) << Statistics::Average(samples)
+       << std::setw(13) << *std::max_element(samples.begin(), samples.end())
+       << std::endl;
+  }
+  os.unsetf(std::ios::floatfield);
+}
+
+}  // namespace engine
@@ -0,0 +1,114 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_GPU_PROFILER_H_
+#define ENGINE_GPU_PROFILER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <vulkan/vk_cpp.h>
+
+namespace engine {
+
+// Measures how much GPU time the named scopes of a command buffer take, using
+// timestamp queries.
+//
+// Every slot (for ex. a swapchain image, with its own command buffer) has its
+// own query pool, so the results of a slot can be read back without waiting
+// for the work of the other slots. The scopes recorded into a command buffer
+// stay valid until the slot is recorded again, so a pre-recorded command
+// buffer can be submitted many times.
+//
+// If the device was created with the pipelineStatisticsQuery feature, the
+// pipeline statistics (for ex. the fragment shader invocations, that show the
+// overdraw) of a part of the frame can be queried too.
+//
+// Every frame's results are written to a CSV file, and PrintSummary() prints
+// the percentiles of the samples of each scope.
+class GpuProfiler {
+ public:
+  GpuProfiler(const vk::Device& device, const vk::PhysicalDevice& gpu,
+              uint32_t queue_family_index, uint32_t slot_count,
+              const std::string& csv_path, bool pipeline_statistics = false);
+  ~GpuProfiler();
+
+  // False if the slot count is zero, or if the queue doesn't support
+  // timestamps. Every call is a no-op then.
+  bool enabled() const { return enabled_; }
+
+  // Collects the results of the old slots, and makes slot_count new ones, for
+  // ex. for a recreated swapchain. The GPU must have finished with the old
+  // ones. A disabled profiler stays disabled.
+  void set_slot_count(uint32_t slot_count);
+
+  // Has to be recorded before the first scope of the command buffer.
+  void BeginFrame(const vk::CommandBuffer& cmd, uint32_t slot);
+  // The scopes can be nested, but not overlapping.
+  void BeginScope(const vk::CommandBuffer& cmd, const std::string& name,
+                  vk::PipelineStageFlagBits stage =
+                      vk::PipelineStageFlagBits::eTopOfPipe);
+  void EndScope(const vk::CommandBuffer& cmd,
+                vk::PipelineStageFlagBits stage =
+                    vk::PipelineStageFlagBits::eBottomOfPipe);
+
+  // Counts the pipeline statistics of the commands between these. Can be used
+  // once per frame, outside of a render pass.
+  void BeginStatistics(const vk::CommandBuffer& cmd);
+  void EndStatistics(const vk::CommandBuffer& cmd);
+
+  // Has to be called after every submit of the slot's command buffer, the
+  // results are written with the number of the frame it was submitted in.
+  void FrameSubmitted(uint32_t slot);
+
+  // Reads back the timings of the slot. The last submitted command buffer of
+  // the slot should have finished execution, otherwise the frame is dropped.
+  void CollectResults(uint32_t slot);
+
+  void PrintSummary(std::ostream& os) const;
+
+ private:
+  static constexpr uint32_t kMaxScopesPerFrame = 32;
+
+  struct Scope {
+    std::string name;
+    uint32_t begin_query, end_query;
+  };
+
+  struct Slot {
+    vk::QueryPool query_pool;
+    std::vector<Scope> scopes;
+    vk::QueryPool statistics_query_pool;
+    bool has_statistics = false;
+    // The frame of the last submit, ~0 if there's none to collect.
+    uint64_t frame = ~uint64_t(0);
+  };
+
+  // The names of the queried statistics, in the order of their flag bits.
+  static const char* const kStatisticNames[];
+  static constexpr uint32_t kStatisticCount = 4;
+
+  vk::Device device_;
+  bool enabled_ = false;
+  bool pipeline_statistics_ = false;
+  double timestamp_period_ = 1.0;  // nanoseconds per tick
+  uint64_t timestamp_mask_ = ~uint64_t(0);
+
+  std::vector<Slot> slots_;
+  Slot* current_slot_ = nullptr;
+  std::vector<size_t> open_scopes_;
+
+  // Counts the submitted frames, the dropped ones too.
+  uint64_t frame_index_ = 0;
+  std::ofstream csv_;
+  std::map<std::string, std::vector<double>> samples_;  // in milliseconds
+  std::map<std::string, std::vector<double>> statistics_samples_;
+
+  void CreateSlots(uint32_t slot_count);
+  void DestroySlots();
+};
+
+}  // namespace engine
+
+#endif
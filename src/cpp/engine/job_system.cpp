@@ -0,0 +1,87 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/job_system.hpp"
+
+namespace engine {
+
+JobSystem::JobSystem(size_t worker_count) {
+  if (worker_count == 0) {
+    unsigned hardware_threads = std::thread::hardware_concurrency();
+    worker_count = hardware_threads > 1 ? hardware_threads - 1 : 0;
+  }
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(&JobSystem::WorkerLoop, this);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  job_started_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void JobSystem::ParallelFor(size_t count,
+                            const std::function<void(size_t)>& function) {
+  if (workers_.empty() || count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      function(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    function_ = &function;
+    count_ = count;
+    next_index_ = 0;
+    ++job_id_;
+  }
+  job_started_.notify_all();
+
+  RunJob(function, count);
+
+  // A worker that wakes up after this only sees that there's no job.
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_finished_.wait(lock, [this] { return busy_workers_ == 0; });
+  function_ = nullptr;
+}
+
+void JobSystem::WorkerLoop() {
+  uint64_t last_job_id = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_started_.wait(lock, [&] { return quit_ || job_id_ != last_job_id; });
+    if (quit_) {
+      return;
+    }
+    last_job_id = job_id_;
+    if (!function_) {
+      continue;
+    }
+
+    const std::function<void(size_t)>& function = *function_;
+    size_t count = count_;
+    ++busy_workers_;
+    lock.unlock();
+    RunJob(function, count);
+    lock.lock();
+    if (--busy_workers_ == 0) {
+      job_finished_.notify_all();
+    }
+  }
+}
+
+void JobSystem::RunJob(const std::function<void(size_t)>& function,
+                       size_t count) {
+  size_t i;
+  while ((i = next_index_.fetch_add(1)) < count) {
+    function(i);
+  }
+}
+
+}  // namespace engine
@@ -0,0 +1,55 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_JOB_SYSTEM_H_
+#define ENGINE_JOB_SYSTEM_H_
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace engine {
+
+// A fixed pool of worker threads, for the parts of a frame that can run at the
+// same time. The calling thread takes part in the work too, so a pool without
+// workers runs everything on the calling thread.
+class JobSystem {
+ public:
+  // Zero workers means one less than the hardware threads.
+  explicit JobSystem(size_t worker_count = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  size_t worker_count() const { return workers_.size(); }
+
+  // Calls function(i) for every i in [0, count), in any order, and at the same
+  // time on the workers and on the calling thread. Returns when all the calls
+  // finished. The function mustn't throw, and it mustn't call ParallelFor.
+  void ParallelFor(size_t count, const std::function<void(size_t)>& function);
+
+ private:
+  std::vector<std::thread> workers_;
+
+  // The current job, guarded by the mutex. The workers take its indices from
+  // next_index_, without locking.
+  std::mutex mutex_;
+  std::condition_variable job_started_, job_finished_;
+  const std::function<void(size_t)>* function_ = nullptr;
+  size_t count_ = 0;
+  uint64_t job_id_ = 0;
+  size_t busy_workers_ = 0;
+  bool quit_ = false;
+  std::atomic<size_t> next_index_{0};
+
+  void WorkerLoop();
+  void RunJob(const std::function<void(size_t)>& function, size_t count);
+};
+
+}  // namespace engine
+
+#endif
@@ -0,0 +1,87 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/render_thread.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+namespace engine {
+
+RenderThread::RenderThread(size_t queue_depth)
+    : queue_depth_(std::max<size_t>(queue_depth, 1))
+    , thread_(&RenderThread::ThreadLoop, this) {}
+
+RenderThread::~RenderThread() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_finished_.wait(lock, [this] { return jobs_in_flight_ == 0; });
+    quit_ = true;
+  }
+  job_submitted_.notify_all();
+  thread_.join();
+}
+
+double RenderThread::Submit(std::function<void()> job) {
+  auto begin = std::chrono::steady_clock::now();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_finished_.wait(lock, [this] {
+      return jobs_in_flight_ < queue_depth_ || error_;
+    });
+    RethrowError(lock);
+    jobs_.push_back(std::move(job));
+    ++jobs_in_flight_;
+  }
+  job_submitted_.notify_one();
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - begin).count();
+}
+
+void RenderThread::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_finished_.wait(lock, [this] { return jobs_in_flight_ == 0; });
+  RethrowError(lock);
+}
+
+void RenderThread::ThreadLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_submitted_.wait(lock, [this] { return quit_ || !jobs_.empty(); });
+    if (jobs_.empty()) {
+      return;
+    }
+
+    std::function<void()> job = std::move(jobs_.front());
+    jobs_.pop_front();
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      job();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+
+    // The frames after a failed one are dropped
+    if (error && !error_) {
+      error_ = error;
+    }
+    if (error_) {
+      jobs_in_flight_ -= jobs_.size();
+      jobs_.clear();
+    }
+    --jobs_in_flight_;
+    job_finished_.notify_all();
+  }
+}
+
+void RenderThread::RethrowError(std::unique_lock<std::mutex>& lock) {
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    lock.unlock();
+    std::rethrow_exception(error);
+  }
+}
+
+}  // namespace engine
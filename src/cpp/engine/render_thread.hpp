@@ -0,0 +1,62 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_RENDER_THREAD_H_
+#define ENGINE_RENDER_THREAD_H_
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+namespace engine {
+
+// Runs the frames' Vulkan work (recording, submission and present) on its own
+// thread, in the order they were submitted, while the main thread goes on
+// with the input, the updates and the selection of the next frame.
+//
+// At most queue_depth frames are in flight (waiting or being drawn), and
+// Submit() blocks while the queue is full, so the main thread can't get more
+// than queue_depth frames ahead of the screen. That caps the latency: a depth
+// of one overlaps the main thread's work with the previous frame's drawing,
+// a depth of two adds one more frame of latency for smoother throughput.
+//
+// An exception of a job is thrown again on the main thread, by the next
+// Submit() or Flush().
+class RenderThread {
+ public:
+  explicit RenderThread(size_t queue_depth);
+  // Finishes the submitted jobs first
+  ~RenderThread();
+
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+
+  size_t queue_depth() const { return queue_depth_; }
+
+  // Returns how many milliseconds it waited for a free place in the queue.
+  double Submit(std::function<void()> job);
+
+  // Returns after every submitted job finished. Anything that touches the
+  // render thread's Vulkan objects (for ex. a resize) has to call it first.
+  void Flush();
+
+ private:
+  size_t queue_depth_;
+  std::mutex mutex_;
+  std::condition_variable job_submitted_, job_finished_;
+  std::deque<std::function<void()>> jobs_;
+  // Including the running one
+  size_t jobs_in_flight_ = 0;
+  bool quit_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  void ThreadLoop();
+  void RethrowError(std::unique_lock<std::mutex>& lock);
+};
+
+}  // namespace engine
+
+#endif
@@ -3,26 +3,78 @@
 #include "engine/scene.hpp"
 
 #include <stdexcept>
+#include <algorithm>
 #include "engine/game_engine.hpp"
+#include "engine/cpu_profiler.hpp"
+#include "common/settings.hpp"
 #include "common/error_checking.hpp"
 
 namespace engine {
 
-Scene::Scene(GLFWwindow *window)
+Scene::Scene(GLFWwindow *window, glm::ivec2 headless_size)
     : GameObject(nullptr)
     , camera_(nullptr)
-    , window_(window) {
+    , simulation_timestep_(Settings::kSimulationTimestep)
+    , lockstep_(window == nullptr)
+    , frame_statistics_(Settings::kFrameStatisticsWindow,
+                        Settings::kFrameTimeHistogramBinMs)
+    , window_(window)
+    , headless_size_(headless_size) {
   set_scene(this);
+  set_parallel_update(Settings::kParallelUpdate);
+}
+
+glm::ivec2 Scene::window_size() const {
+  if (window_) {
+    int width, height;
+    glfwGetWindowSize(window_, &width, &height);
+    return glm::ivec2(width, height);
+  } else {
+    return headless_size_;
+  }
 }
 
 Scene::~Scene() {}
 
+uint64_t Scene::UpdateResource(const std::string& name) {
+  auto iter = update_resources_.find(name);
+  if (iter != update_resources_.end()) {
+    return iter->second;
+  }
+  if (update_resources_.size() == 64) {
+    throw std::length_error("Too many update resources.");
+  }
+  uint64_t resource = uint64_t(1) << update_resources_.size();
+  update_resources_[name] = resource;
+  return resource;
+}
+
+void Scene::set_parallel_update(bool value) {
+  if (value && !job_system_) {
+    job_system_ = make_unique<JobSystem>(Settings::kUpdateWorkerCount);
+  } else if (!value) {
+    job_system_.reset();
+  }
+}
+
 void Scene::KeyAction(int key, int scancode, int action, int mods) {
   if (action == GLFW_PRESS) {
     switch (key) {
       case GLFW_KEY_F1:
         camera_time_.Toggle();
         break;
+      case GLFW_KEY_F2:
+        frame_statistics_.PrintRollingSummary(std::cout);
+        break;
+      case GLFW_KEY_F6:
+        set_parallel_update(!parallel_update());
+        std::cout << "Parallel update: ";
+        if (parallel_update()) {
+          std::cout << job_system_->worker_count() << " workers" << std::endl;
+        } else {
+          std::cout << "off" << std::endl;
+        }
+        break;
       case GLFW_KEY_P:
         if (camera()) {
           std::cout << camera()->transform().pos() << std::endl;
@@ -35,27 +87,238 @@ void Scene::KeyAction(int key, int scancode, int action, int mods) {
 }
 
 void Scene::Turn() {
-  UpdateAll();
-  RenderAll();
-  Render2DAll();
+  PROFILE_SCOPE("Scene::Turn");
+  turn_begin_ns_ = CpuProfiler::Now();
+  frame_statistics_.BeginFrame();
+  {
+    FrameStatistics::PhaseTimer timer(frame_statistics_, FrameStatistics::kUpdate);
+    for (int count = UpdateCount(); count > 0; --count) {
+      camera_time_.Step(simulation_timestep_);
+      UpdateAll();
+      ++update_count_;
+    }
+    if (camera_) {
+      camera_->Interpolate(interpolation_);
+    }
+  }
+  {
+    FrameStatistics::PhaseTimer timer(frame_statistics_, FrameStatistics::kRender);
+    RenderAll();
+    Render2DAll();
+  }
+  frame_statistics_.EndFrame();
+}
+
+// The wall time is accumulated, and is used up in fixed steps. The rest is less
+// than a step, and it tells how far the rendered frame is between the last two
+// steps. After a hitch, the backlog over kMaxUpdatesPerTurn steps is dropped,
+// rather than letting the updates fall further and further behind.
+int Scene::UpdateCount() {
+  if (lockstep_) {
+    interpolation_ = 1;
+    return 1;
+  }
+
+  wall_time_.Tick();
+  accumulated_time_ += wall_time_.dt();
+  int count = std::min(int(accumulated_time_ / simulation_timestep_),
+                       Settings::kMaxUpdatesPerTurn);
+  accumulated_time_ = std::min(accumulated_time_ - count * simulation_timestep_,
+                               simulation_timestep_);
+  interpolation_ = accumulated_time_ / simulation_timestep_;
+
+  // The first frame needs an update, that adds the components, and sets up
+  // the camera.
+  if (update_count_ == 0 && count == 0) {
+    count = 1;
+    interpolation_ = 1;
+  }
+  return count;
+}
+
+// Reports an exception of a dispatched call, outside of the dispatch loop.
+static void ReportDispatchError(const char* what) {
+  std::cerr << "Exception: " << what << std::endl;
+}
+
+template<typename Function>
+void Scene::Dispatch(const std::vector<DispatchEntry>& list,
+                     Function function) {
+  // The try block is only entered again after an exception, that skips the
+  // object that threw it (but not its descendants).
+  size_t i = 0;
+  while (i < list.size()) {
+    try {
+      while (i < list.size()) {
+        const DispatchEntry& entry = list[i];
+        if (!entry.object->enabled_) {
+          i = entry.subtree_end;
+          continue;
+        }
+        if (entry.call) {
+          function(entry.object);
+        }
+        ++i;
+      }
+    } catch (const std::exception& ex) {
+      ReportDispatchError(ex.what());
+      ++i;
+    } catch (...) {
+      ReportDispatchError("unknown");
+      ++i;
+    }
+  }
+}
+
+void Scene::CallUpdate(GameObject* object) {
+  try {
+    object->Update();
+  } catch (const std::exception& ex) {
+    ReportDispatchError(ex.what());
+  } catch (...) {
+    ReportDispatchError("unknown");
+  }
+}
+
+// The enabled flags are all read before the updates, so if an object disables
+// another one in its Update(), it only takes effect in the next frame.
+//
+// The consecutive objects are grouped into waves, while they don't conflict:
+// none of them writes a resource that another one reads or writes, and all of
+// them declared their access. The waves run one after the other, so the
+// conflicting objects still update in the order of the tree, and each wave
+// sees everything the earlier ones wrote. The render phase starts after the
+// last wave, so it sees the state of the finished update.
+//
+// The world space values of a Transform are cached on their first read after
+// a change, without synchronization (see Transformation). An object that moves
+// a transform should read it back in its own Update(), so its readers in the
+// later waves only read the cache.
+void Scene::UpdateParallel() {
+  parallel_updates_.clear();
+  size_t index = 0;
+  while (index < update_list_.size()) {
+    const DispatchEntry& entry = update_list_[index];
+    if (!entry.object->enabled_) {
+      index = entry.subtree_end;
+      continue;
+    }
+    if (entry.call) {
+      parallel_updates_.push_back(entry.object);
+    }
+    ++index;
+  }
+
+  size_t wave_begin = 0;
+  uint64_t wave_reads = 0, wave_writes = 0;
+  bool wave_exclusive = false;
+  for (size_t i = 0; i < parallel_updates_.size(); ++i) {
+    const GameObject* object = parallel_updates_[i];
+    bool conflicts = !object->update_access_declared_ ||
+                     (object->update_writes_ & (wave_reads | wave_writes)) ||
+                     (object->update_reads_ & wave_writes);
+    if (i != wave_begin && (wave_exclusive || conflicts)) {
+      RunUpdateWave(wave_begin, i);
+      wave_begin = i;
+      wave_reads = wave_writes = 0;
+    }
+    wave_exclusive = !object->update_access_declared_;
+    wave_reads |= object->update_reads_;
+    wave_writes |= object->update_writes_;
+  }
+  RunUpdateWave(wave_begin, parallel_updates_.size());
+}
+
+void Scene::RunUpdateWave(size_t begin, size_t end) {
+  if (end - begin == 1) {
+    CallUpdate(parallel_updates_[begin]);
+  } else if (end > begin) {
+    PROFILE_SCOPE("parallel update wave");
+    job_system_->ParallelFor(end - begin, [this, begin](size_t i) {
+      CallUpdate(parallel_updates_[begin + i]);
+    });
+  }
+}
+
+void Scene::ApplyComponentChanges(GameObject* object) {
+  object->InternalUpdate();
+  for (auto& component : object->components_) {
+    if (component) {
+      ApplyComponentChanges(component.get());
+    }
+  }
+}
+
+void Scene::ApplyComponentChanges() {
+  PROFILE_SCOPE("Scene::ApplyComponentChanges");
+  // The new components might add more components, when they get the
+  // screen's size.
+  while (components_changed_) {
+    components_changed_ = false;
+    ApplyComponentChanges(this);
+  }
+  dispatch_lists_dirty_ = true;
+}
+
+void Scene::BuildDispatchList(GameObject* object, DispatchedEvent event,
+                              std::vector<DispatchEntry>& list) {
+  size_t index = list.size();
+  bool call = object->overridden_events_ & event;
+  list.push_back(DispatchEntry{object, 0, call});
+  for (auto& component : object->components_) {
+    if (component) {
+      BuildDispatchList(component.get(), event, list);
+    }
+  }
+
+  if (!call && list.size() == index + 1) {
+    list.pop_back();
+  } else {
+    list[index].subtree_end = list.size();
+  }
+}
+
+void Scene::BuildDispatchLists() {
+  PROFILE_SCOPE("Scene::BuildDispatchLists");
+  update_list_.clear();
+  render_list_.clear();
+  render2d_list_.clear();
+  BuildDispatchList(this, kUpdateEvent, update_list_);
+  BuildDispatchList(this, kRenderEvent, render_list_);
+  BuildDispatchList(this, kRender2DEvent, render2d_list_);
+  dispatch_lists_dirty_ = false;
 }
 
 void Scene::UpdateAll() {
-  camera_time_.Tick();
+  PROFILE_SCOPE("Scene::UpdateAll");
+
+  if (components_changed_) {
+    ApplyComponentChanges();
+  }
+  if (dispatch_lists_dirty_) {
+    BuildDispatchLists();
+  }
+  if (job_system_) {
+    UpdateParallel();
+  } else {
+    Dispatch(update_list_, [](GameObject* object) { object->Update(); });
+  }
 
-  GameObject::UpdateAll();
+  PROFILE_SCOPE("update transforms");
+  transforms_.Update();
 }
 
 void Scene::RenderAll() {
+  PROFILE_SCOPE("Scene::RenderAll");
   if (!camera_) {
     throw std::runtime_error("Need a camera to render a 3D scene.");
   }
 
-  GameObject::RenderAll();
+  Dispatch(render_list_, [](GameObject* object) { object->Render(); });
 }
 
 void Scene::Render2DAll() {
-  GameObject::Render2DAll();
+  Dispatch(render2d_list_, [](GameObject* object) { object->Render2D(); });
 }
 
 }  // namespace engine
@@ -3,13 +3,19 @@
 #ifndef ENGINE_SCENE_H_
 #define ENGINE_SCENE_H_
 
+#include <map>
+#include <atomic>
+#include <string>
 #include <vector>
 #include <memory>
 #include <vulkan/vk_cpp.h>
 
 #include "engine/timer.hpp"
 #include "engine/camera.hpp"
+#include "engine/frame_statistics.hpp"
+#include "engine/job_system.hpp"
 #include "engine/game_object.hpp"
+#include "engine/transform_system.hpp"
 
 #include "common/debug_callback.hpp"
 #include "common/vulkan_application.hpp"
@@ -20,26 +26,115 @@ class GameObject;
 
 class Scene : public GameObject {
  public:
-  Scene(GLFWwindow *window);
+  // Without a window, the scene is headless, and pretends to have a window
+  // of headless_size.
+  Scene(GLFWwindow *window, glm::ivec2 headless_size = glm::ivec2{});
   virtual ~Scene();
 
+  // The simulation's time, it advances by simulation_timestep() per update.
   const Timer& camera_time() const { return camera_time_; }
   Timer& camera_time() { return camera_time_; }
 
+  // The updates run in fixed steps of this many seconds, as many per Turn() as
+  // the wall time requires, and the camera is rendered between the poses of
+  // the last two steps (see Turn()).
+  double simulation_timestep() const { return simulation_timestep_; }
+  void set_simulation_timestep(double value) { simulation_timestep_ = value; }
+
+  // Every Turn() runs exactly one update, regardless of the wall time, so the
+  // frames don't depend on the machine's speed. Headless scenes default to it.
+  bool lockstep() const { return lockstep_; }
+  void set_lockstep(bool value) { lockstep_ = value; }
+
+  // Where the rendered frame is between the last two updates, in [0, 1].
+  double interpolation() const { return interpolation_; }
+
+  // When the current Turn() began, right after the input was polled, in
+  // CpuProfiler::Now()'s nanoseconds. For measuring the input's latency.
+  int64_t turn_begin_ns() const { return turn_begin_ns_; }
+
   const Camera* camera() const { return camera_; }
   Camera* camera() { return camera_; }
   void set_camera(Camera* camera) { camera_ = camera; }
 
+  // The transforms of the objects that are too many to be GameObjects. They
+  // are updated after the GameObjects.
+  const TransformSystem& transforms() const { return transforms_; }
+  TransformSystem& transforms() { return transforms_; }
+
+  const FrameStatistics& frame_statistics() const { return frame_statistics_; }
+  FrameStatistics& frame_statistics() { return frame_statistics_; }
+
   GLFWwindow* window() const { return window_; }
   void set_window(GLFWwindow* window) { window_ = window; }
+  bool headless() const { return window_ == nullptr; }
+  glm::ivec2 window_size() const;
 
   virtual void KeyAction(int key, int scancode, int action, int mods) override;
   virtual void Turn();
 
+  // Returns after the frames that are still being drawn (for ex. on a render
+  // thread) are finished. The scene doesn't draw anything by itself.
+  virtual void FinishRendering() {}
+
+  // A bit for a named part of the shared state, for the update access
+  // declarations (see GameObject::DeclareUpdateAccess). The same name always
+  // gets the same bit. Throws if more than 64 names are used.
+  uint64_t UpdateResource(const std::string& name);
+
+  // Update the objects that declared their access on a job system, see
+  // UpdateParallel(). F6 toggles it.
+  bool parallel_update() const { return job_system_ != nullptr; }
+  void set_parallel_update(bool value);
+
+  // The components' additions and removals are applied at the beginning of
+  // the next update, in one batch.
+  void MarkComponentsChanged() { components_changed_ = true; }
+  // The dispatch lists are rebuilt at the beginning of the next update.
+  void MarkDispatchListsDirty() { dispatch_lists_dirty_ = true; }
+
  private:
+  // The objects of a dispatch list are in the order of the recursive
+  // traversal, and the objects that don't override the event are left out
+  // (unless they have descendants that do, as they can disable those). If an
+  // object is disabled, its subtree is skipped until subtree_end.
+  struct DispatchEntry {
+    GameObject* object;
+    uint32_t subtree_end;
+    bool call;
+  };
   Camera* camera_;
   Timer camera_time_;
+  Timer wall_time_;
+  double simulation_timestep_, accumulated_time_ = 0, interpolation_ = 1;
+  bool lockstep_;
+  uint64_t update_count_ = 0;
+  int64_t turn_begin_ns_ = 0;
+  TransformSystem transforms_;
+  FrameStatistics frame_statistics_;
   GLFWwindow* window_;
+  glm::ivec2 headless_size_;
+
+  std::vector<DispatchEntry> update_list_, render_list_, render2d_list_;
+  // Atomic, as the objects might add components in a parallel update.
+  std::atomic<bool> components_changed_{true}, dispatch_lists_dirty_{true};
+
+  std::map<std::string, uint64_t> update_resources_;
+  std::unique_ptr<JobSystem> job_system_;
+  // The objects to update in this frame, in the order of update_list_
+  std::vector<GameObject*> parallel_updates_;
+
+  void ApplyComponentChanges();
+  static void ApplyComponentChanges(GameObject* object);
+  void BuildDispatchLists();
+  static void BuildDispatchList(GameObject* object, DispatchedEvent event,
+                                std::vector<DispatchEntry>& list);
+  template<typename Function>
+  void Dispatch(const std::vector<DispatchEntry>& list, Function function);
+  int UpdateCount();
+  void UpdateParallel();
+  void RunUpdateWave(size_t begin, size_t end);
+  static void CallUpdate(GameObject* object);
 
 protected:
   virtual void UpdateAll() override;
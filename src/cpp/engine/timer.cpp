@@ -2,11 +2,20 @@
 
 #include "timer.hpp"
 
+#include <chrono>
+
 namespace engine {
 
+// Seconds from a monotonic clock. Unlike glfwGetTime(), this works without
+// initializing GLFW (in headless mode).
+static double GetTime() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 double Timer::Tick() {
   if (!stopped_) {
-    double time = glfwGetTime();
+    double time = GetTime();
     if (last_time_ != 0) {
       dt_ = time - last_time_;
     }
@@ -16,6 +25,14 @@ double Timer::Tick() {
   return current_time_;
 }
 
+double Timer::Step(double dt) {
+  if (!stopped_) {
+    dt_ = dt;
+    current_time_ += dt_;
+  }
+  return current_time_;
+}
+
 void Timer::Stop() {
   stopped_ = true;
   dt_ = 0;
@@ -23,7 +40,7 @@ void Timer::Stop() {
 
 void Timer::Start() {
   stopped_ = false;
-  last_time_ = glfwGetTime();
+  last_time_ = GetTime();
 }
 
 void Timer::Toggle() {
@@ -14,7 +14,10 @@ class Timer {
  public:
   Timer() : last_time_(0), current_time_(0), dt_(0), stopped_(false) {}
 
+  // Advances by the wall time since the last Tick()
   double Tick();
+  // Advances by a fixed dt, for the simulation steps
+  double Step(double dt);
   void   Stop();
   void   Start();
   void   Toggle();
@@ -5,6 +5,7 @@
 
 #include <cmath>
 #include <vector>
+#include <cstdint>
 #include <algorithm>
 
 #include "common/settings.hpp"
@@ -21,6 +22,13 @@
 
 namespace engine {
 
+// The world space values (and matrices) are cached, and only recomputed when
+// they are read after the transformation or one of its ancestors changed.
+// A change marks the descendants dirty (the parents know their children for
+// this), and reading a dirty value recomputes the ancestors first, so every
+// transformation is recomputed at most once per change, and the reads of the
+// unchanged ones are O(1). The caches make the const getters unsafe to call
+// from more threads at the same time.
 template<typename T, glm::precision P = glm::precision::highp>
 class Transformation {
  protected:
@@ -36,20 +44,58 @@ class Transformation {
 
  public:
   Transformation(Transformation* parent = nullptr)
-      : parent_(parent)
-      , scale_(1, 1, 1) { }
+      : parent_(nullptr)
+      , scale_(1, 1, 1) {
+    set_parent(parent);
+  }
 
-  virtual ~Transformation() {}
+  // The copy has the same local values and parent, but no children.
+  Transformation(const Transformation& other)
+      : parent_(nullptr), pos_(other.pos_), scale_(other.scale_)
+      , rot_(other.rot_) {
+    set_parent(other.parent_);
+  }
 
-  void set_parent(Transformation* parent) { parent_ = parent; }
-  Transformation* parent() const { return parent_; }
+  Transformation& operator=(const Transformation& other) {
+    pos_ = other.pos_;
+    scale_ = other.scale_;
+    rot_ = other.rot_;
+    set_parent(other.parent_);
+    Invalidate();
+    return *this;
+  }
 
-  virtual const vec3 pos() const {
+  virtual ~Transformation() {
+    set_parent(nullptr);
+    for (Transformation* child : children_) {
+      child->parent_ = nullptr;
+      child->Invalidate();
+    }
+  }
+
+  void set_parent(Transformation* parent) {
     if (parent_) {
-      return vec3{parent_->localToWorldMatrix() * vec4{pos_, 1}};
-    } else {
-      return pos_;
+      auto& siblings = parent_->children_;
+      siblings.erase(std::remove(siblings.begin(), siblings.end(), this),
+                     siblings.end());
     }
+    parent_ = parent;
+    if (parent_) {
+      parent_->children_.push_back(this);
+    }
+    Invalidate();
+  }
+  Transformation* parent() const { return parent_; }
+
+  // Changes every time the world space values are recomputed.
+  uint64_t version() const {
+    UpdateWorld();
+    return version_;
+  }
+
+  virtual const vec3 pos() const {
+    UpdateWorld();
+    return world_pos_;
   }
 
   virtual void set_pos(const vec3& new_pos) {
@@ -59,6 +105,7 @@ class Transformation {
     } else {
       pos_ = new_pos;
     }
+    Invalidate();
   }
 
   const vec3& local_pos() const {
@@ -67,14 +114,12 @@ class Transformation {
 
   virtual void set_local_pos(const vec3& new_pos) {
     pos_ = new_pos;
+    Invalidate();
   }
 
   virtual const vec3 scale() const {
-    if (parent_) {
-      return mat3(parent_->localToWorldMatrix()) * scale_;
-    } else {
-      return scale_;
-    }
+    UpdateWorld();
+    return world_scale_;
   }
 
   virtual void set_scale(const vec3& new_scale) {
@@ -83,6 +128,7 @@ class Transformation {
     } else {
       scale_ = new_scale;
     }
+    Invalidate();
   }
 
   const vec3& local_scale() const {
@@ -91,14 +137,12 @@ class Transformation {
 
   virtual void set_local_scale(const vec3& new_scale) {
     scale_ = new_scale;
+    Invalidate();
   }
 
   virtual const quat rot() const {
-    if (parent_) {
-      return parent_->rot() * rot_;
-    } else {
-      return rot_;
-    }
+    UpdateWorld();
+    return world_rot_;
   }
 
   virtual void set_rot(const quat& new_rot) {
@@ -107,6 +151,7 @@ class Transformation {
     } else {
       rot_ = new_rot;
     }
+    Invalidate();
   }
 
   const quat& local_rot() const {
@@ -115,6 +160,7 @@ class Transformation {
 
   virtual void set_local_rot(const quat& new_rot) {
     rot_ = new_rot;
+    Invalidate();
   }
 
   // Sets the rotation, so that 'local_space_vec' in local space will be
@@ -191,18 +237,17 @@ class Transformation {
   }
 
   mat4 worldToLocalMatrix() const {
-    return glm::inverse(localToWorldMatrix());
+    UpdateWorld();
+    if (inverse_dirty_) {
+      world_to_local_ = glm::inverse(local_to_world_);
+      inverse_dirty_ = false;
+    }
+    return world_to_local_;
   }
 
   virtual mat4 localToWorldMatrix() const {
-    mat4 local_transf = glm::scale(glm::mat4_cast(rot_), scale_);
-    local_transf[3] = vec4(pos_, 1);
-
-    if (parent_) {
-      return parent_->localToWorldMatrix() * local_transf;
-    } else {
-      return local_transf;
-    }
+    UpdateWorld();
+    return local_to_world_;
   }
 
   // To help the users to decide which matrix they need, in case of confusion
@@ -217,6 +262,52 @@ class Transformation {
   operator mat4() const {
     return localToWorldMatrix();
   }
+
+ protected:
+  // Marks the world space values of this and the descendants out of date.
+  // A derived class that changes what the world space values depend on has
+  // to call it.
+  void Invalidate() {
+    // The descendants of a dirty transformation are all dirty already
+    if (world_dirty_) { return; }
+    world_dirty_ = true;
+    for (Transformation* child : children_) {
+      child->Invalidate();
+    }
+  }
+
+ private:
+  std::vector<Transformation*> children_;
+
+  mutable bool world_dirty_ = true, inverse_dirty_ = true;
+  mutable uint64_t version_ = 0;
+  mutable mat4 local_to_world_, world_to_local_;
+  mutable vec3 world_pos_, world_scale_;
+  mutable quat world_rot_;
+
+  void UpdateWorld() const {
+    if (!world_dirty_) { return; }
+
+    mat4 local_transf = glm::scale(glm::mat4_cast(rot_), scale_);
+    local_transf[3] = vec4(pos_, 1);
+
+    if (parent_) {
+      const mat4& parent_transf = parent_->localToWorldMatrix();
+      local_to_world_ = parent_transf * local_transf;
+      world_pos_ = vec3{local_to_world_[3]};
+      world_scale_ = mat3(parent_transf) * scale_;
+      world_rot_ = parent_->rot() * rot_;
+    } else {
+      local_to_world_ = local_transf;
+      world_pos_ = pos_;
+      world_scale_ = scale_;
+      world_rot_ = rot_;
+    }
+
+    world_dirty_ = false;
+    inverse_dirty_ = true;
+    ++version_;
+  }
 };
 
 using Transform = Transformation<double, glm::precision::highp>;
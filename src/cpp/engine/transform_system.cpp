@@ -0,0 +1,184 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "engine/transform_system.hpp"
+
+#include <cassert>
+#include <algorithm>
+
+namespace engine {
+
+constexpr uint32_t TransformSystem::kInvalidId;
+
+// Moves element order[i] of the array to position i.
+template<typename T>
+static void Permute(std::vector<T>& array, const std::vector<uint32_t>& order) {
+  std::vector<T> permuted;
+  permuted.reserve(order.size());
+  for (uint32_t old_index : order) {
+    permuted.push_back(array[old_index]);
+  }
+  array.swap(permuted);
+}
+
+TransformSystem::Handle TransformSystem::Create(Handle parent) {
+  Handle handle;
+  if (free_ids_.empty()) {
+    handle.id = index_of_id_.size();
+    index_of_id_.push_back(kInvalidId);
+    generation_of_id_.push_back(0);
+  } else {
+    handle.id = free_ids_.back();
+    free_ids_.pop_back();
+  }
+  handle.generation = generation_of_id_[handle.id];
+
+  uint32_t parent_index = parent.valid() ? index(parent) : kInvalidId;
+  uint32_t depth = parent.valid() ? depth_[parent_index] + 1 : 0;
+  if (!depth_.empty() && depth < depth_.back()) {
+    unsorted_ = true;
+  }
+
+  index_of_id_[handle.id] = size();
+  local_pos_.push_back(glm::dvec3{});
+  local_scale_.push_back(glm::dvec3{1, 1, 1});
+  local_rot_.push_back(glm::dquat{});
+  parent_.push_back(parent_index);
+  depth_.push_back(depth);
+  dirty_.push_back(true);
+  world_.push_back(glm::dmat4{});
+  id_.push_back(handle.id);
+
+  return handle;
+}
+
+void TransformSystem::Destroy(Handle handle) {
+  assert(alive(handle));
+
+  // The parents come before the children, so the descendants are marked in
+  // one pass.
+  std::vector<bool> destroyed(size(), false);
+  destroyed[index(handle)] = true;
+  std::vector<uint32_t> order;
+  order.reserve(size());
+  for (uint32_t i = 0; i < size(); ++i) {
+    if (parent_[i] != kInvalidId && destroyed[parent_[i]]) {
+      destroyed[i] = true;
+    }
+    if (destroyed[i]) {
+      index_of_id_[id_[i]] = kInvalidId;
+      generation_of_id_[id_[i]]++;
+      free_ids_.push_back(id_[i]);
+    } else {
+      order.push_back(i);
+    }
+  }
+
+  // The survivors keep their relative order
+  std::vector<uint32_t> new_index(size(), kInvalidId);
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    new_index[order[i]] = i;
+  }
+  Reorder(order, new_index);
+}
+
+bool TransformSystem::alive(Handle handle) const {
+  return handle.valid() && handle.id < index_of_id_.size() &&
+         index_of_id_[handle.id] != kInvalidId &&
+         generation_of_id_[handle.id] == handle.generation;
+}
+
+TransformSystem::Handle TransformSystem::parent(Handle handle) const {
+  Handle parent;
+  uint32_t parent_index = parent_[index(handle)];
+  if (parent_index != kInvalidId) {
+    parent.id = id_[parent_index];
+    parent.generation = generation_of_id_[parent.id];
+  }
+  return parent;
+}
+
+void TransformSystem::set_local_pos(Handle handle, const glm::dvec3& value) {
+  local_pos_[index(handle)] = value;
+  dirty_[index(handle)] = true;
+}
+
+void TransformSystem::set_local_rot(Handle handle, const glm::dquat& value) {
+  local_rot_[index(handle)] = value;
+  dirty_[index(handle)] = true;
+}
+
+void TransformSystem::set_local_scale(Handle handle, const glm::dvec3& value) {
+  local_scale_[index(handle)] = value;
+  dirty_[index(handle)] = true;
+}
+
+void TransformSystem::Update() {
+  if (unsorted_) {
+    SortByDepth();
+  }
+
+  // A transform changes if its local values did, or if its parent changed in
+  // this pass, that is already known as the parent comes first.
+  for (uint32_t i = 0; i < size(); ++i) {
+    uint32_t parent = parent_[i];
+    if (parent != kInvalidId && dirty_[parent]) {
+      dirty_[i] = true;
+    }
+    if (!dirty_[i]) {
+      continue;
+    }
+
+    glm::dmat4 local = glm::mat4_cast(local_rot_[i]);
+    local[0] *= local_scale_[i].x;
+    local[1] *= local_scale_[i].y;
+    local[2] *= local_scale_[i].z;
+    local[3] = glm::dvec4{local_pos_[i], 1};
+    world_[i] = parent != kInvalidId ? world_[parent] * local : local;
+  }
+
+  std::fill(dirty_.begin(), dirty_.end(), 0);
+}
+
+void TransformSystem::SortByDepth() {
+  unsorted_ = false;
+  if (size() == 0) {
+    return;
+  }
+
+  // Counting sort, it keeps the order inside a level
+  uint32_t max_depth = *std::max_element(depth_.begin(), depth_.end());
+  std::vector<uint32_t> level_begin(max_depth + 2, 0);
+  for (uint32_t depth : depth_) {
+    level_begin[depth + 1]++;
+  }
+  for (uint32_t depth = 1; depth < level_begin.size(); ++depth) {
+    level_begin[depth] += level_begin[depth - 1];
+  }
+  std::vector<uint32_t> order(size()), new_index(size());
+  for (uint32_t i = 0; i < size(); ++i) {
+    new_index[i] = level_begin[depth_[i]]++;
+    order[new_index[i]] = i;
+  }
+
+  Reorder(order, new_index);
+}
+
+void TransformSystem::Reorder(const std::vector<uint32_t>& order,
+                              const std::vector<uint32_t>& new_index) {
+  Permute(local_pos_, order);
+  Permute(local_scale_, order);
+  Permute(local_rot_, order);
+  Permute(parent_, order);
+  Permute(depth_, order);
+  Permute(dirty_, order);
+  Permute(world_, order);
+  Permute(id_, order);
+  for (uint32_t i = 0; i < size(); ++i) {
+    if (parent_[i] != kInvalidId) {
+      parent_[i] = new_index[parent_[i]];
+    }
+    index_of_id_[id_[i]] = i;
+  }
+}
+
+}  // namespace engine
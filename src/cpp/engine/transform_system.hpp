@@ -0,0 +1,110 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef ENGINE_TRANSFORM_SYSTEM_H_
+#define ENGINE_TRANSFORM_SYSTEM_H_
+
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+#include "common/glm.hpp"
+#include <glm/gtc/quaternion.hpp>
+
+namespace engine {
+
+// A transform hierarchy for a lot of small objects (markers on the globe),
+// that don't need to be GameObjects. The local values, the parents and the
+// world matrices are in separate arrays, sorted by the depth in the hierarchy,
+// so a parent always comes before its children, and Update() recomputes every
+// changed world matrix in one linear pass, without recursion or virtual calls.
+//
+// The objects are referred to by handles, that stay valid while the arrays
+// are reordered, until the object is destroyed. A destroyed object's id is
+// reused with the next generation, so its old handles don't see the new one.
+class TransformSystem {
+ public:
+  static constexpr uint32_t kInvalidId = ~uint32_t(0);
+
+  struct Handle {
+    // Not default member initializers, Create()'s default argument needs
+    // the constructor before the end of TransformSystem.
+    Handle() : id(kInvalidId), generation(0) {}
+
+    uint32_t id, generation;
+    bool valid() const { return id != kInvalidId; }
+  };
+
+  // The new transform is the identity, relative to the parent.
+  Handle Create(Handle parent = Handle{});
+
+  // Destroys the transform and all of its descendants. It is O(size()).
+  void Destroy(Handle handle);
+
+  size_t size() const { return parent_.size(); }
+  // False for a destroyed object, even if its id is reused since.
+  bool alive(Handle handle) const;
+
+  Handle parent(Handle handle) const;
+
+  const glm::dvec3& local_pos(Handle handle) const {
+    return local_pos_[index(handle)];
+  }
+  void set_local_pos(Handle handle, const glm::dvec3& value);
+
+  const glm::dquat& local_rot(Handle handle) const {
+    return local_rot_[index(handle)];
+  }
+  void set_local_rot(Handle handle, const glm::dquat& value);
+
+  const glm::dvec3& local_scale(Handle handle) const {
+    return local_scale_[index(handle)];
+  }
+  void set_local_scale(Handle handle, const glm::dvec3& value);
+
+  // Recomputes the world matrices of the changed transforms, and their
+  // descendants.
+  void Update();
+
+  // As of the last Update()
+  const glm::dmat4& world_matrix(Handle handle) const {
+    return world_[index(handle)];
+  }
+  glm::dvec3 world_pos(Handle handle) const {
+    return glm::dvec3{world_matrix(handle)[3]};
+  }
+
+  // The world matrices in the storage order, for uploading all of them.
+  const std::vector<glm::dmat4>& world_matrices() const { return world_; }
+
+ private:
+  // Indexed by the storage index
+  std::vector<glm::dvec3> local_pos_, local_scale_;
+  std::vector<glm::dquat> local_rot_;
+  std::vector<uint32_t> parent_;  // storage index, or kInvalidId for a root
+  std::vector<uint32_t> depth_;
+  std::vector<uint8_t> dirty_;
+  std::vector<glm::dmat4> world_;
+  std::vector<uint32_t> id_;
+
+  // Indexed by the handle's id
+  std::vector<uint32_t> index_of_id_;
+  std::vector<uint32_t> generation_of_id_;
+  std::vector<uint32_t> free_ids_;
+
+  // Set when a new transform breaks the depth order.
+  bool unsorted_ = false;
+
+  uint32_t index(Handle handle) const {
+    assert(alive(handle));
+    return index_of_id_[handle.id];
+  }
+  void SortByDepth();
+  // Moves the transform at order[i] to i, new_index is the inverse of order
+  // (with kInvalidId for the removed ones).
+  void Reorder(const std::vector<uint32_t>& order,
+               const std::vector<uint32_t>& new_index);
+};
+
+}  // namespace engine
+
+#endif
@@ -4,20 +4,24 @@
 
 #include <memory>
 #include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <stdexcept>
 #include <GLFW/glfw3.h>
+#include <lodepng.h>
 
 #include "common/error_checking.hpp"
-#include "common/vulkan_memory.hpp"
+#include "common/settings.hpp"
 
 namespace engine {
 
 /******************************************************
 *                          Ctor                       *
 *******************************************************/
-VulkanScene::VulkanScene(GLFWwindow *window)
-    : engine::Scene(window)
-    , vk_instance_(CreateInstance(vk_app_))
+VulkanScene::VulkanScene(GLFWwindow *window, glm::ivec2 headless_size)
+    : engine::Scene(window, headless_size)
+    , vk_instance_(CreateInstance(vk_app_, headless()))
 #if VK_VALIDATE
     , vk_debug_callback_(new DebugCallback(vk_instance_))
 #endif
@@ -25,8 +29,14 @@ VulkanScene::VulkanScene(GLFWwindow *window)
     , vk_surface_(CreateSurface(vk_instance_, window))
     , vk_graphics_queue_node_index_(
         SelectQraphicsQueueNodeIndex(vk_gpu_, vk_surface_, vk_app_))
-    , vk_device_(CreateDevice(vk_gpu_, vk_graphics_queue_node_index_, vk_app_))
+    , vk_device_(CreateDevice(vk_gpu_, vk_graphics_queue_node_index_, vk_app_,
+                              headless()))
     , vk_queue_(GetQueue(vk_device_, vk_graphics_queue_node_index_)) {
+  if (!ParsePresentMode(Settings::kPresentMode, requested_present_mode_)) {
+    requested_present_mode_ = vk::PresentModeKHR::eFifoKHR;
+  }
+  present_mode_ = requested_present_mode_;
+
   GetSurfaceProperties(vk_gpu_, vk_surface_, vk_app_, vk_surface_format_,
                        vk_surface_color_space_, vk_gpu_memory_properties_);
 
@@ -36,60 +46,151 @@ VulkanScene::VulkanScene(GLFWwindow *window)
 
   vk::chk(vk_device_.createCommandPool(&cmd_pool_info, nullptr, &vk_cmd_pool_));
 
-  const vk::CommandBufferAllocateInfo cmd = vk::CommandBufferAllocateInfo()
-      .commandPool(vk_cmd_pool_)
-      .level(vk::CommandBufferLevel::ePrimary)
-      .commandBufferCount(1);
-
-  vk::chk(vk_device_.allocateCommandBuffers(&cmd, &vk_draw_cmd_));
+  device_allocator_ = make_unique<DeviceAllocator>(
+      vk_device_, vk_gpu_, Settings::kDeviceMemoryBlockSize,
+      Settings::kMemoryHeapBudget);
 
   PrepareBuffers();
+  AllocateDrawCommands();
 
   vk_depth_buffer_ = CreateDepthBuffer(window, vk_device_, *this);
+
+  gpu_profiler_ = make_unique<GpuProfiler>(
+      vk_device_, vk_gpu_, vk_graphics_queue_node_index_,
+      Settings::kGpuProfiling ? vk_swapchain_image_count_ : 0,
+      Settings::kGpuProfileCsvPath, UsePipelineStatistics(vk_gpu_));
+
+  set_render_queue_depth(Settings::kRenderQueueDepth);
 }
 
 /******************************************************
 *                          Dtor                       *
 *******************************************************/
 VulkanScene::~VulkanScene() {
+  FinishRendering();
+  render_thread_.reset();
+  gpu_profiler_.reset();
+
   if (vk_setup_cmd_) {
     vk_device_.freeCommandBuffers(vk_cmd_pool_, 1, &vk_setup_cmd_);
   }
-  vk_device_.freeCommandBuffers(vk_cmd_pool_, 1, &vk_draw_cmd_);
+  FreeDrawCommands();
   vk_device_.destroyCommandPool(vk_cmd_pool_, nullptr);
 
   vk_device_.destroyImageView(vk_depth_buffer_.view, nullptr);
   vk_device_.destroyImage(vk_depth_buffer_.image, nullptr);
-  vk_device_.freeMemory(vk_depth_buffer_.mem, nullptr);
+  device_allocator_->Free(vk_depth_buffer_.mem);
 
-  for (uint32_t i = 0; i < vk_swapchain_image_count_; i++) {
-    vk_device_.destroyImageView(vk_buffers()[i].view, nullptr);
-  }
+  DestroyBuffers();
+  device_allocator_.reset();
 
-  vk_app_.entry_points.DestroySwapchainKHR(vk_device_, vk_swapchain_, nullptr);
+  if (!headless()) {
+    vk_app_.entry_points.DestroySwapchainKHR(vk_device_, vk_swapchain_, nullptr);
+  }
 
   vk_device_.destroy(nullptr);
-  vk_instance_.destroySurfaceKHR(vk_surface_, nullptr);
+  if (!headless()) {
+    vk_instance_.destroySurfaceKHR(vk_surface_, nullptr);
+  }
+}
+
+/******************************************************
+*                      Present mode                   *
+*******************************************************/
+static const vk::PresentModeKHR kPresentModes[] = {
+    vk::PresentModeKHR::eImmediateKHR, vk::PresentModeKHR::eMailboxKHR,
+    vk::PresentModeKHR::eFifoKHR, vk::PresentModeKHR::eFifoRelaxedKHR};
+
+bool VulkanScene::ParsePresentMode(const std::string& name,
+                                   vk::PresentModeKHR& mode) {
+  for (vk::PresentModeKHR present_mode : kPresentModes) {
+    if (name == PresentModeName(present_mode)) {
+      mode = present_mode;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* VulkanScene::PresentModeName(vk::PresentModeKHR mode) {
+  switch (mode) {
+    case vk::PresentModeKHR::eImmediateKHR: return "immediate";
+    case vk::PresentModeKHR::eMailboxKHR: return "mailbox";
+    case vk::PresentModeKHR::eFifoKHR: return "fifo";
+    case vk::PresentModeKHR::eFifoRelaxedKHR: return "fifo_relaxed";
+    default: return "unknown";
+  }
+}
+
+void VulkanScene::set_present_mode(vk::PresentModeKHR mode) {
+  requested_present_mode_ = mode;
+  if (headless() || mode == present_mode_) {
+    return;
+  }
+
+  // The same as a resize, with the same size
+  FinishRendering();
+  vk::chk(vk_device_.waitIdle());
+  glm::ivec2 size = window_size();
+  ScreenResizedCleanAll();
+  ScreenResizedAll(size.x, size.y);
+}
+
+void VulkanScene::KeyAction(int key, int scancode, int action, int mods) {
+  Scene::KeyAction(key, scancode, action, mods);
+  if (action == GLFW_PRESS && key == GLFW_KEY_F7 && !headless()) {
+    const size_t count = sizeof(kPresentModes) / sizeof(kPresentModes[0]);
+    size_t current = std::find(kPresentModes, kPresentModes + count,
+                               requested_present_mode_) - kPresentModes;
+    set_present_mode(kPresentModes[(current + 1) % count]);
+    std::cout << "Present mode: " << PresentModeName(present_mode_)
+              << std::endl;
+  }
+}
+
+/******************************************************
+*                      Render thread                  *
+*******************************************************/
+void VulkanScene::set_render_queue_depth(size_t depth) {
+  if (depth == render_queue_depth()) {
+    return;
+  }
+  FinishRendering();
+  render_thread_.reset();
+  if (depth > 0) {
+    render_thread_ = make_unique<RenderThread>(depth);
+  }
+}
+
+void VulkanScene::FinishRendering() {
+  if (!render_thread_) {
+    return;
+  }
+  try {
+    render_thread_->Flush();
+  } catch (const std::exception& ex) {
+    std::cerr << "Exception: " << ex.what() << std::endl;
+  }
 }
 
 /******************************************************
 *                      ScreenResizedClean                 *
 *******************************************************/
 void VulkanScene::ScreenResizedClean() {
+  // The render thread's frames use the objects that are destroyed here
+  FinishRendering();
   if (vk_setup_cmd_) {
     vk_device_.freeCommandBuffers(vk_cmd_pool_, 1, &vk_setup_cmd_);
     vk_setup_cmd_ = VK_NULL_HANDLE;
   }
-  vk_device_.freeCommandBuffers(vk_cmd_pool_, 1, &vk_draw_cmd_);
+  FreeDrawCommands();
   vk_device_.destroyCommandPool(vk_cmd_pool_, nullptr);
 
   vk_device_.destroyImageView(vk_depth_buffer_.view, nullptr);
   vk_device_.destroyImage(vk_depth_buffer_.image, nullptr);
-  vk_device_.freeMemory(vk_depth_buffer_.mem, nullptr);
+  device_allocator_->Free(vk_depth_buffer_.mem);
 
-  for (uint32_t i = 0; i < vk_swapchain_image_count_; i++) {
-    vk_device_.destroyImageView(vk_buffers()[i].view, nullptr);
-  }
+  DestroyBuffers();
 }
 
 /******************************************************
@@ -102,15 +203,35 @@ void VulkanScene::ScreenResized(size_t width, size_t height) {
 
   vk::chk(vk_device_.createCommandPool(&cmd_pool_info, nullptr, &vk_cmd_pool_));
 
+  PrepareBuffers();
+  AllocateDrawCommands();
+  vk_depth_buffer_ = CreateDepthBuffer(window(), vk_device_, *this);
+
+  // The new swapchain can have a different number of images
+  gpu_profiler_->set_slot_count(vk_swapchain_image_count_);
+}
+
+/******************************************************
+*                  AllocateDrawCommands               *
+*******************************************************/
+void VulkanScene::AllocateDrawCommands() {
   const vk::CommandBufferAllocateInfo cmd = vk::CommandBufferAllocateInfo()
       .commandPool(vk_cmd_pool_)
       .level(vk::CommandBufferLevel::ePrimary)
       .commandBufferCount(1);
 
-  vk::chk(vk_device_.allocateCommandBuffers(&cmd, &vk_draw_cmd_));
+  for (uint32_t i = 0; i < vk_swapchain_image_count_; i++) {
+    vk::chk(vk_device_.allocateCommandBuffers(&cmd, &vk_buffers()[i].cmd));
+  }
+}
 
-  PrepareBuffers();
-  vk_depth_buffer_ = CreateDepthBuffer(window(), vk_device_, *this);
+/******************************************************
+*                    FreeDrawCommands                 *
+*******************************************************/
+void VulkanScene::FreeDrawCommands() {
+  for (uint32_t i = 0; i < vk_swapchain_image_count_; i++) {
+    vk_device_.freeCommandBuffers(vk_cmd_pool_, 1, &vk_buffers()[i].cmd);
+  }
 }
 
 /******************************************************
@@ -121,22 +242,7 @@ void VulkanScene::SetImageLayout(const vk::Image& image,
                                  const vk::ImageLayout& old_image_layout,
                                  const vk::ImageLayout& new_image_layout,
                                  vk::AccessFlags src_access) {
-    if (vk_setup_cmd_ == VK_NULL_HANDLE) {
-        const vk::CommandBufferAllocateInfo cmd = vk::CommandBufferAllocateInfo()
-            .commandPool(vk_cmd_pool_)
-            .level(vk::CommandBufferLevel::ePrimary)
-            .commandBufferCount(1);
-
-        vk::chk(vk_device_.allocateCommandBuffers(&cmd, &vk_setup_cmd_));
-
-        vk::CommandBufferInheritanceInfo cmd_buf_inh_info =
-            vk::CommandBufferInheritanceInfo();
-
-        vk::CommandBufferBeginInfo cmd_buf_info =
-          vk::CommandBufferBeginInfo().pInheritanceInfo(&cmd_buf_inh_info);
-
-        vk::chk(vk_setup_cmd_.begin(&cmd_buf_info));
-    }
+    BeginSetupCommand();
 
     vk::ImageMemoryBarrier image_memory_barrier = vk::ImageMemoryBarrier()
         .oldLayout(old_image_layout)
@@ -178,6 +284,30 @@ void VulkanScene::SetImageLayout(const vk::Image& image,
       vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
 }
 
+/******************************************************
+*                   BeginSetupCommand                 *
+*******************************************************/
+void VulkanScene::BeginSetupCommand() {
+    if (vk_setup_cmd_ != VK_NULL_HANDLE) {
+        return;
+    }
+
+    const vk::CommandBufferAllocateInfo cmd = vk::CommandBufferAllocateInfo()
+        .commandPool(vk_cmd_pool_)
+        .level(vk::CommandBufferLevel::ePrimary)
+        .commandBufferCount(1);
+
+    vk::chk(vk_device_.allocateCommandBuffers(&cmd, &vk_setup_cmd_));
+
+    vk::CommandBufferInheritanceInfo cmd_buf_inh_info =
+        vk::CommandBufferInheritanceInfo();
+
+    vk::CommandBufferBeginInfo cmd_buf_info =
+      vk::CommandBufferBeginInfo().pInheritanceInfo(&cmd_buf_inh_info);
+
+    vk::chk(vk_setup_cmd_.begin(&cmd_buf_info));
+}
+
 
 /******************************************************
 *                  GET_INSTANCE_PROC_ADDR             *
@@ -194,7 +324,7 @@ void VulkanScene::SetImageLayout(const vk::Image& image,
 /******************************************************
 *                      CreateInstance                 *
 *******************************************************/
-vk::Instance VulkanScene::CreateInstance(VulkanApplication& app) {
+vk::Instance VulkanScene::CreateInstance(VulkanApplication& app, bool headless) {
   /* Look for instance validation layers */
   uint32_t all_instance_layer_count = 0;
   vk::chk(vk::enumerateInstanceLayerProperties(&all_instance_layer_count, nullptr));
@@ -213,18 +343,20 @@ vk::Instance VulkanScene::CreateInstance(VulkanApplication& app) {
 #endif
   }
 
-  /* Look for instance extensions */
-  unsigned required_extension_count;
-  const char** required_extensions =
-      glfwGetRequiredInstanceExtensions(&required_extension_count);
-  if (!required_extensions) {
-    throw std::runtime_error("glfwGetRequiredInstanceExtensions failed to find the "
-                             "platform surface extensions.\n\nDo you have a compatible "
-                             "Vulkan installable client driver (ICD) installed?");
-  }
+  /* Look for instance extensions (headless, no surface is needed) */
+  if (!headless) {
+    unsigned required_extension_count;
+    const char** required_extensions =
+        glfwGetRequiredInstanceExtensions(&required_extension_count);
+    if (!required_extensions) {
+      throw std::runtime_error("glfwGetRequiredInstanceExtensions failed to find the "
+                               "platform surface extensions.\n\nDo you have a compatible "
+                               "Vulkan installable client driver (ICD) installed?");
+    }
 
-  for (uint32_t i = 0; i < required_extension_count; i++) {
-    app.instance_extension_names.push_back(required_extensions[i]);
+    for (uint32_t i = 0; i < required_extension_count; i++) {
+      app.instance_extension_names.push_back(required_extensions[i]);
+    }
   }
 
   vk::InstanceCreateInfo inst_info = vk::InstanceCreateInfo()
@@ -248,6 +380,10 @@ vk::Instance VulkanScene::CreateInstance(VulkanApplication& app) {
                                "(ICD) installed?");
   }
 
+  if (headless) {
+    return instance;
+  }
+
   // Having these GIPA queries of device extension entry points both
   // BEFORE and AFTER vk::createDevice is a good test for the loader
   GET_INSTANCE_PROC_ADDR(instance, app, GetPhysicalDeviceSurfaceCapabilitiesKHR);
@@ -315,6 +451,9 @@ vk::PhysicalDevice VulkanScene::CreatePhysicalDevice(vk::Instance& instance,
 *******************************************************/
 VkSurfaceKHR VulkanScene::CreateSurface(const vk::Instance& instance,
                                         GLFWwindow* window) {
+  if (!window) {
+    return VK_NULL_HANDLE;
+  }
 
   VkSurfaceKHR surface;
 
@@ -341,6 +480,17 @@ uint32_t VulkanScene::SelectQraphicsQueueNodeIndex(const vk::PhysicalDevice& gpu
   assert(1 <= queue_count);
   queue_props.resize(queue_count);
 
+  // Headless, any graphics queue will do
+  if (surface == VK_NULL_HANDLE) {
+    for (uint32_t i = 0; i < queue_count; i++) {
+      if ((queue_props[i].queueFlags() & vk::QueueFlagBits::eGraphics)
+          != vk::QueueFlags{}) {
+        return i;
+      }
+    }
+    throw std::runtime_error("Could not find a graphics queue");
+  }
+
   // Graphics queue and MemMgr queue can be separate.
   // TODO: Add support for separate queues, including synchronization,
   //       and appropriate tracking for QueueSubmit
@@ -411,12 +561,34 @@ uint32_t VulkanScene::SelectQraphicsQueueNodeIndex(const vk::PhysicalDevice& gpu
   }                                                                                      \
 }
 
+/******************************************************
+*                 UsePipelineStatistics               *
+*******************************************************/
+bool VulkanScene::UsePipelineStatistics(const vk::PhysicalDevice& gpu) {
+  if (!Settings::kGpuProfiling) {
+    return false;
+  }
+
+  vk::PhysicalDeviceFeatures supported_features;
+  gpu.getFeatures(&supported_features);
+  return supported_features.pipelineStatisticsQuery();
+}
+
 /******************************************************
 *                   CreateDevice                      *
 *******************************************************/
 vk::Device VulkanScene::CreateDevice(const vk::PhysicalDevice& gpu,
                                      uint32_t graphics_queue_node_index,
-                                     VulkanApplication& app) {
+                                     VulkanApplication& app, bool headless) {
+  // The offscreen images don't need a swapchain
+  if (headless) {
+    auto& extensions = app.device_extension_names;
+    extensions.erase(std::remove_if(extensions.begin(), extensions.end(),
+      [](const char* name) {
+        return !std::strcmp(name, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+      }), extensions.end());
+  }
+
   float queue_priorities[1] = {0.0};
   const vk::DeviceQueueCreateInfo queue = vk::DeviceQueueCreateInfo()
       .queueFamilyIndex(graphics_queue_node_index)
@@ -424,7 +596,8 @@ vk::Device VulkanScene::CreateDevice(const vk::PhysicalDevice& gpu,
       .pQueuePriorities(queue_priorities);
 
   vk::PhysicalDeviceFeatures features = vk::PhysicalDeviceFeatures()
-      .fillModeNonSolid(true);
+      .fillModeNonSolid(true)
+      .pipelineStatisticsQuery(UsePipelineStatistics(gpu));
 
   vk::DeviceCreateInfo device_create_info = vk::DeviceCreateInfo()
       .queueCreateInfoCount(1)
@@ -438,6 +611,10 @@ vk::Device VulkanScene::CreateDevice(const vk::PhysicalDevice& gpu,
   vk::Device device;
   vk::chk(gpu.createDevice(&device_create_info, nullptr, &device));
 
+  if (headless) {
+    return device;
+  }
+
   GET_DEVICE_PROC_ADDR(device, app, CreateSwapchainKHR);
   GET_DEVICE_PROC_ADDR(device, app, DestroySwapchainKHR);
   GET_DEVICE_PROC_ADDR(device, app, GetSwapchainImagesKHR);
@@ -468,6 +645,14 @@ void VulkanScene::GetSurfaceProperties(const vk::PhysicalDevice& gpu,
                                        vk::Format& format,
                                        vk::ColorSpaceKHR& color_space,
                                        vk::PhysicalDeviceMemoryProperties& memory_properties) {
+    // Get Memory information and properties
+    gpu.getMemoryProperties(&memory_properties);
+
+    // The offscreen images can be saved to PNGs without any conversion
+    if (surface == VK_NULL_HANDLE) {
+        format = vk::Format::eR8G8B8A8Unorm;
+        return;
+    }
 
     // Get the list of vk::Format's that are supported:
     uint32_t format_count;
@@ -488,9 +673,6 @@ void VulkanScene::GetSurfaceProperties(const vk::PhysicalDevice& gpu,
         format = static_cast<vk::Format>(surf_formats.get()[0].format);
     }
     color_space = static_cast<vk::ColorSpaceKHR>(surf_formats.get()[0].colorSpace);
-
-    // Get Memory information and properties
-    gpu.getMemoryProperties(&memory_properties);
 }
 
 
@@ -513,7 +695,6 @@ VulkanScene::DepthBuffer VulkanScene::CreateDepthBuffer(GLFWwindow* window,
       .tiling(vk::ImageTiling::eOptimal)
       .usage(vk::ImageUsageFlagBits::eDepthStencilAttachment);
 
-  vk::MemoryAllocateInfo mem_alloc;
   vk::ImageViewCreateInfo view = vk::ImageViewCreateInfo()
     .format(depth_format)
     .subresourceRange(vk::ImageSubresourceRange()
@@ -525,28 +706,14 @@ VulkanScene::DepthBuffer VulkanScene::CreateDepthBuffer(GLFWwindow* window,
     )
     .viewType(vk::ImageViewType::e2D);
 
-  vk::MemoryRequirements mem_reqs;
-
   depth.format = depth_format;
 
   /* create image */
   vk::chk(vk_device.createImage(&image, nullptr, &depth.image));
 
-  /* get memory requirements for this object */
-  vk_device.getImageMemoryRequirements(depth.image, &mem_reqs);
-
-  /* select memory size and type */
-  mem_alloc.allocationSize(mem_reqs.size());
-  MemoryTypeFromProperties(scene.vk_gpu_memory_properties(),
-                           mem_reqs.memoryTypeBits(),
-                           vk::MemoryPropertyFlags(), /* No requirements */
-                           mem_alloc);
-
-  /* allocate memory */
-  vk::chk(vk_device.allocateMemory(&mem_alloc, nullptr, &depth.mem));
-
-  /* bind memory */
-  vk::chk(vk_device.bindImageMemory(depth.image, depth.mem, 0));
+  /* allocate and bind memory */
+  depth.mem = scene.device_allocator().AllocateImage(
+      depth.image, vk::ImageTiling::eOptimal, MemoryUsage::kGpuOnly);
 
   scene.SetImageLayout(depth.image, vk::ImageAspectFlagBits::eDepth,
                        vk::ImageLayout::eUndefined,
@@ -582,6 +749,11 @@ void VulkanScene::FlushInitCommand() {
 
 
 void VulkanScene::PrepareBuffers() {
+  if (headless()) {
+    PrepareOffscreenBuffers();
+    return;
+  }
+
   vk::SwapchainKHR old_swapchain = vk_swapchain_;
 
   // Check the surface capabilities and formats
@@ -616,11 +788,17 @@ void VulkanScene::PrepareBuffers() {
       framebuffer_size_.y = surf_capabilities.currentExtent().height();
   }
 
-#if VK_VSYNC
-  vk::PresentModeKHR swapchain_present_mode = vk::PresentModeKHR::eFifoKHR;
-#else
-  vk::PresentModeKHR swapchain_present_mode = vk::PresentModeKHR::eImmediateKHR;
-#endif
+  // Fifo is always supported
+  present_mode_ = vk::PresentModeKHR::eFifoKHR;
+  for (uint32_t i = 0; i < present_mode_count; ++i) {
+    if (vk::PresentModeKHR(presentModes.get()[i]) == requested_present_mode_) {
+      present_mode_ = requested_present_mode_;
+    }
+  }
+  if (present_mode_ != requested_present_mode_) {
+    std::cerr << "The '" << PresentModeName(requested_present_mode_)
+              << "' present mode is not supported, using 'fifo'." << std::endl;
+  }
 
   // Determine the number of vk::Image's to use in the swap chain (we desire to
   // own only 1 image at a time, besides the images being displayed and
@@ -652,7 +830,7 @@ void VulkanScene::PrepareBuffers() {
       .imageSharingMode(vk::SharingMode::eExclusive)
       .queueFamilyIndexCount(0)
       .pQueueFamilyIndices(nullptr)
-      .presentMode(swapchain_present_mode)
+      .presentMode(present_mode_)
       .oldSwapchain(old_swapchain)
       .clipped(true);
 
@@ -714,6 +892,180 @@ void VulkanScene::PrepareBuffers() {
 }
 
 
+void VulkanScene::PrepareOffscreenBuffers() {
+  framebuffer_size_ = window_size();
+  vk_swapchain_image_count_ = Settings::kHeadlessImageCount;
+  vk_buffers_ = std::unique_ptr<SwapchainBuffers>(
+      new SwapchainBuffers[vk_swapchain_image_count_]);
+
+  const vk::ImageCreateInfo image_info = vk::ImageCreateInfo()
+      .imageType(vk::ImageType::e2D)
+      .format(vk_surface_format_)
+      .extent(vk::Extent3D(framebuffer_size_.x, framebuffer_size_.y, 1))
+      .mipLevels(1)
+      .arrayLayers(1)
+      .samples(vk::SampleCountFlagBits::e1)
+      .tiling(vk::ImageTiling::eOptimal)
+      .usage(vk::ImageUsageFlagBits::eColorAttachment |
+             vk::ImageUsageFlagBits::eTransferSrc);
+
+  for (uint32_t i = 0; i < vk_swapchain_image_count_; i++) {
+    SwapchainBuffers& buffer = vk_buffers()[i];
+    vk::chk(vk_device_.createImage(&image_info, nullptr, &buffer.image));
+
+    buffer.mem = device_allocator_->AllocateImage(
+        buffer.image, vk::ImageTiling::eOptimal, MemoryUsage::kGpuOnly);
+
+    // Same as with the swapchain images, the render loop expects the image to
+    // be in the present layout
+    SetImageLayout(buffer.image, vk::ImageAspectFlagBits::eColor,
+                   vk::ImageLayout::eUndefined, vk_present_layout(),
+                   vk::AccessFlags{});
+
+    vk::ImageViewCreateInfo color_attachment_view = vk::ImageViewCreateInfo()
+        .image(buffer.image)
+        .format(vk_surface_format_)
+        .subresourceRange(vk::ImageSubresourceRange()
+          .aspectMask(vk::ImageAspectFlagBits::eColor)
+          .baseMipLevel(0)
+          .levelCount(1)
+          .baseArrayLayer(0)
+          .layerCount(1)
+        )
+        .viewType(vk::ImageViewType::e2D);
+
+    vk::chk(vk_device_.createImageView(&color_attachment_view, nullptr,
+                                       &buffer.view));
+  }
+
+  vk_current_buffer_ = 0;
+}
+
+
+void VulkanScene::DestroyBuffers() {
+  for (uint32_t i = 0; i < vk_swapchain_image_count_; i++) {
+    vk_device_.destroyImageView(vk_buffers()[i].view, nullptr);
+
+    // The swapchain images are owned by the swapchain, only the offscreen
+    // images have to be destroyed.
+    if (vk_buffers()[i].mem) {
+      vk_device_.destroyImage(vk_buffers()[i].image, nullptr);
+      device_allocator_->Free(vk_buffers()[i].mem);
+    }
+  }
+}
+
+
+/******************************************************
+*                   AcquireNextImage                  *
+*******************************************************/
+VkResult VulkanScene::AcquireNextImage(const vk::Semaphore& semaphore) {
+  if (headless()) {
+    vk_current_buffer_ = (vk_current_buffer_ + 1) % vk_swapchain_image_count_;
+    return VK_SUCCESS;
+  }
+
+  return vk_app_.entry_points.AcquireNextImageKHR(
+      vk_device_, vk_swapchain_, UINT64_MAX, semaphore,
+      (vk::Fence)nullptr, &vk_current_buffer_);
+}
+
+
+/******************************************************
+*                     PresentImage                    *
+*******************************************************/
+VkResult VulkanScene::PresentImage(const vk::Semaphore& wait_semaphore) {
+  uint32_t frame_index = presented_frame_count_++;
+
+  if (!headless()) {
+    vk::PresentInfoKHR present = vk::PresentInfoKHR()
+        .waitSemaphoreCount(wait_semaphore ? 1 : 0)
+        .pWaitSemaphores(&wait_semaphore)
+        .swapchainCount(1)
+        .pSwapchains(&vk_swapchain_)
+        .pImageIndices(&vk_current_buffer_);
+    VkPresentInfoKHR& vkPresent =
+      const_cast<VkPresentInfoKHR&>(
+        static_cast<const VkPresentInfoKHR&>(present));
+
+    // TBD/TODO: SHOULD THE "present" PARAMETER BE "const" IN THE HEADER?
+    return vk_app_.entry_points.QueuePresentKHR(vk_queue_, &vkPresent);
+  }
+
+  if (capture_interval_ != 0 && frame_index % capture_interval_ == 0) {
+    vk::chk(vk_queue_.waitIdle());
+    char file_name[32];
+    std::snprintf(file_name, sizeof(file_name), "frame_%05u.png", frame_index);
+    SaveImage(vk_current_buffer_, capture_directory_ + "/" + file_name);
+  }
+
+  return VK_SUCCESS;
+}
+
+
+/******************************************************
+*                       SaveImage                     *
+*******************************************************/
+void VulkanScene::SaveImage(uint32_t buffer_index, const std::string& path) {
+  if (!headless()) {
+    throw std::runtime_error("Only the offscreen images can be saved.");
+  }
+
+  const uint32_t width = framebuffer_size_.x, height = framebuffer_size_.y;
+  const vk::DeviceSize size = width * height * 4;
+
+  // Copy the image into a host visible buffer
+  const vk::BufferCreateInfo buffer_info = vk::BufferCreateInfo()
+      .size(size)
+      .usage(vk::BufferUsageFlagBits::eTransferDst);
+
+  vk::Buffer buffer;
+  vk::chk(vk_device_.createBuffer(&buffer_info, nullptr, &buffer));
+
+  // Only lives until the end of this function
+  DeviceAllocation mem = device_allocator_->AllocateBuffer(
+      buffer, MemoryUsage::kReadback, DeviceAllocator::Strategy::kLinear);
+
+  const vk::BufferImageCopy region = vk::BufferImageCopy()
+      .imageSubresource(vk::ImageSubresourceLayers()
+        .aspectMask(vk::ImageAspectFlagBits::eColor)
+        .mipLevel(0)
+        .baseArrayLayer(0)
+        .layerCount(1))
+      .imageExtent(vk::Extent3D(width, height, 1));
+
+  const vk::BufferMemoryBarrier host_read_barrier = vk::BufferMemoryBarrier()
+      .srcAccessMask(vk::AccessFlagBits::eTransferWrite)
+      .dstAccessMask(vk::AccessFlagBits::eHostRead)
+      .srcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .dstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+      .buffer(buffer)
+      .size(VK_WHOLE_SIZE);
+
+  BeginSetupCommand();
+  vk_setup_cmd_.copyImageToBuffer(vk_buffers()[buffer_index].image,
+                                  vk_present_layout(), buffer, 1, &region);
+  vk_setup_cmd_.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eHost,
+                                vk::DependencyFlags(), 0, nullptr,
+                                1, &host_read_barrier, 0, nullptr);
+  FlushInitCommand();
+
+  // The image format is eR8G8B8A8Unorm, it can be written out as it is
+  device_allocator_->Invalidate(mem);
+  unsigned error = lodepng::encode(
+      path, static_cast<unsigned char*>(mem.mapped), width, height);
+
+  vk_device_.destroyBuffer(buffer, nullptr);
+  device_allocator_->Free(mem);
+
+  if (error) {
+    std::cerr << "Couldn't save '" << path << "': "
+              << lodepng_error_text(error) << std::endl;
+  }
+}
+
+
 #if VK_VALIDATE
 
 /******************************************************
@@ -3,9 +3,13 @@
 #ifndef ENGINE_VULKAN_SCENE_H_
 #define ENGINE_VULKAN_SCENE_H_
 
+#include <string>
 #include <vulkan/vk_cpp.h>
 
 #include "engine/scene.hpp"
+#include "engine/gpu_profiler.hpp"
+#include "engine/render_thread.hpp"
+#include "engine/device_allocator.hpp"
 
 #include "common/debug_callback.hpp"
 #include "common/vulkan_application.hpp"
@@ -14,7 +18,9 @@ namespace engine {
 
 class VulkanScene : public engine::Scene {
  public:
-  VulkanScene(GLFWwindow *window);
+  // Without a window, the scene renders into offscreen images of
+  // headless_size, and doesn't use VK_KHR_surface or VK_KHR_swapchain.
+  VulkanScene(GLFWwindow *window, glm::ivec2 headless_size = glm::ivec2{});
   ~VulkanScene();
 
   const vk::Queue& vk_queue() const { return vk_queue_; }
@@ -25,12 +31,17 @@ class VulkanScene : public engine::Scene {
   const vk::Format& vk_surface_format() const { return vk_surface_format_; }
   const vk::PhysicalDeviceMemoryProperties& vk_gpu_memory_properties() const { return vk_gpu_memory_properties_; }
   const vk::CommandBuffer& vk_setup_cmd() const { return vk_setup_cmd_; }
-  const vk::CommandBuffer& vk_draw_cmd() const { return vk_draw_cmd_; }
+  // Every swapchain image has its own draw command buffer, so a recorded
+  // command buffer can be submitted again, while it's still valid.
+  const vk::CommandBuffer& vk_draw_cmd() const {
+    return vk_buffers_.get()[vk_current_buffer_].cmd;
+  }
 
   struct SwapchainBuffers {
     vk::Image image;
     vk::CommandBuffer cmd;
     vk::ImageView view;
+    DeviceAllocation mem;  // only for the offscreen images
   };
 
   glm::ivec2 framebuffer_size() const { return framebuffer_size_; }
@@ -41,16 +52,73 @@ class VulkanScene : public engine::Scene {
   SwapchainBuffers* vk_buffers() { return vk_buffers_.get(); }
   uint32_t& vk_current_buffer() { return vk_current_buffer_; }
 
+  // The layout the images have to be in when a frame is done. The offscreen
+  // images aren't presented but copied from, so it's eTransferSrcOptimal then.
+  vk::ImageLayout vk_present_layout() const {
+    return headless() ? vk::ImageLayout::eTransferSrcOptimal
+                      : vk::ImageLayout::ePresentSrcKHR;
+  }
+
+  // Returns the result of vkAcquireNextImageKHR. Headless, it just steps to
+  // the next offscreen image, and doesn't signal the semaphore.
+  VkResult AcquireNextImage(const vk::Semaphore& semaphore);
+  // Returns the result of vkQueuePresentKHR, that waits for the semaphore if
+  // it isn't null. Headless, nothing is presented, but if a frame capture is
+  // due, it waits for the queue, and saves the image.
+  VkResult PresentImage(const vk::Semaphore& wait_semaphore = vk::Semaphore());
+
+  // The swapchain's present mode. Setting it recreates the swapchain. If the
+  // surface doesn't support it, fifo (vsync) is used, that is always there.
+  // F7 cycles through the modes.
+  vk::PresentModeKHR present_mode() const { return present_mode_; }
+  void set_present_mode(vk::PresentModeKHR mode);
+
+  // The names are "immediate", "mailbox", "fifo" and "fifo_relaxed".
+  static bool ParsePresentMode(const std::string& name,
+                               vk::PresentModeKHR& mode);
+  static const char* PresentModeName(vk::PresentModeKHR mode);
+
+  virtual void KeyAction(int key, int scancode, int action, int mods) override;
+
+  // If it's not null, the frames' Vulkan work runs on it (see RenderThread),
+  // with at most render_queue_depth() frames in flight. Zero means that the
+  // frames are drawn on the main thread.
+  RenderThread* render_thread() { return render_thread_.get(); }
+  size_t render_queue_depth() const {
+    return render_thread_ ? render_thread_->queue_depth() : 0;
+  }
+  void set_render_queue_depth(size_t depth);
+
+  // Waits for the render thread's frames, and reports their errors instead of
+  // throwing them, so it can be called from the destructors too.
+  virtual void FinishRendering() override;
+
+  // Headless only: saves every interval-th frame as a PNG into the directory.
+  void set_frame_capture(const std::string& directory, uint32_t interval) {
+    capture_directory_ = directory;
+    capture_interval_ = interval;
+  }
+
+  // The image has to be in vk_present_layout(), with no pending work.
+  void SaveImage(uint32_t buffer_index, const std::string& path);
+
   struct DepthBuffer {
     vk::Format format;
 
     vk::Image image;
-    vk::DeviceMemory mem;
+    DeviceAllocation mem;
     vk::ImageView view;
   };
 
   const DepthBuffer& vk_depth_buffer() const { return vk_depth_buffer_; }
 
+  // Every buffer and image should get its memory from it.
+  DeviceAllocator& device_allocator() { return *device_allocator_; }
+  const DeviceAllocator& device_allocator() const { return *device_allocator_; }
+
+  GpuProfiler& gpu_profiler() { return *gpu_profiler_; }
+  const GpuProfiler& gpu_profiler() const { return *gpu_profiler_; }
+
   void SetImageLayout(const vk::Image& image,
                       const vk::ImageAspectFlags& aspectMask,
                       const vk::ImageLayout& old_image_layout,
@@ -78,6 +146,8 @@ class VulkanScene : public engine::Scene {
 
   glm::ivec2 framebuffer_size_;
 
+  // The requested one, and the one the swapchain was created with
+  vk::PresentModeKHR requested_present_mode_, present_mode_;
   vk::SwapchainKHR vk_swapchain_;
   uint32_t vk_swapchain_image_count_ = 0;
   std::unique_ptr<SwapchainBuffers> vk_buffers_;
@@ -85,15 +155,22 @@ class VulkanScene : public engine::Scene {
 
   vk::CommandPool vk_cmd_pool_;
   vk::CommandBuffer vk_setup_cmd_;
-  vk::CommandBuffer vk_draw_cmd_;
   DepthBuffer vk_depth_buffer_;
 
+  std::unique_ptr<DeviceAllocator> device_allocator_;
+  std::unique_ptr<GpuProfiler> gpu_profiler_;
+  std::unique_ptr<RenderThread> render_thread_;
+
+  std::string capture_directory_;
+  uint32_t capture_interval_ = 0;
+  uint32_t presented_frame_count_ = 0;
+
 protected:
   virtual void ScreenResizedClean() override;
   virtual void ScreenResized(size_t width, size_t height) override;
 
 private:
-  static vk::Instance CreateInstance(VulkanApplication& app);
+  static vk::Instance CreateInstance(VulkanApplication& app, bool headless);
 
   static vk::PhysicalDevice CreatePhysicalDevice(vk::Instance& instance,
                                                  const VulkanApplication& app);
@@ -105,9 +182,12 @@ private:
                                                const VkSurfaceKHR& surface,
                                                const VulkanApplication& app);
 
+  // The GPU profiler's pipeline statistics need a device feature.
+  static bool UsePipelineStatistics(const vk::PhysicalDevice& gpu);
+
   static vk::Device CreateDevice(const vk::PhysicalDevice& gpu,
                                  uint32_t graphics_queue_node_index,
-                                 VulkanApplication& app);
+                                 VulkanApplication& app, bool headless);
 
   static vk::Queue GetQueue(const vk::Device& device,
                             uint32_t graphics_queue_node_index);
@@ -120,6 +200,12 @@ private:
                                    vk::PhysicalDeviceMemoryProperties& memory_properties);
 
   void PrepareBuffers();
+  void PrepareOffscreenBuffers();
+  void DestroyBuffers();
+  void AllocateDrawCommands();
+  void FreeDrawCommands();
+
+  void BeginSetupCommand();
 
   static DepthBuffer CreateDepthBuffer(GLFWwindow* window,
                                        const vk::Device& vk_device,
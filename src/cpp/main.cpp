@@ -1,16 +1,192 @@
 // Copyright (c) 2016, Tamas Csala
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
 #include <vulkan/vk_cpp.h>
 #include <GLFW/glfw3.h>
 
 #include "engine/game_engine.hpp"
+#include "engine/camera_track.hpp"
+#include "benchmark/benchmark.hpp"
+#include "benchmark/flights.hpp"
 #include "demo_scene.hpp"
 
+namespace {
+
+struct Options {
+  bool headless = false;
+  glm::ivec2 headless_size{1280, 720};
+  size_t frame_limit = 0;
+  std::string capture_directory;
+  uint32_t capture_interval = 0;
+  std::string record_camera_path;
+  std::string replay_camera;
+  double replay_timestep = 1.0 / 60;
+  double max_fps = Settings::kFrameRateLimit;
+  std::string present_mode;
+  size_t render_queue_depth = Settings::kRenderQueueDepth;
+};
+
+// A headless run has no window to close, so it needs a frame limit.
+constexpr size_t kDefaultHeadlessFrameLimit = 600;
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [options]\n"
+    "  --headless             render offscreen, without a window\n"
+    "  --size WxH             size of the offscreen images (default 1280x720)\n"
+    "  --frames N             exit after N frames (headless default: "
+                              << kDefaultHeadlessFrameLimit << ")\n"
+    "  --capture DIR          save the offscreen frames as PNGs into DIR\n"
+    "  --capture-interval N   only save every N-th frame (default 1)\n"
+    "  --record-camera FILE   save the camera's flight on exit\n"
+    "  --replay-camera FLIGHT replay a recorded flight file, or one of the\n"
+    "                         built-in flights (hover, pan, flyby)\n"
+    "  --timestep S           the timestep of the replay (default 1/60 s)\n"
+    "  --max-fps N            limit the frame rate (0 means no limit)\n"
+    "  --present-mode MODE    immediate, mailbox, fifo or fifo_relaxed\n"
+    "  --render-queue N       draw on a render thread, with at most N frames\n"
+    "                         in flight (0: on the main thread)\n"
+    "  --benchmark NAME ...   run a benchmark, 'list' lists them"
+    << std::endl;
+}
+
+bool ParseOptions(int argc, const char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if (!std::strcmp(arg, "--headless")) {
+      options.headless = true;
+    } else if (!std::strcmp(arg, "--size") && value) {
+      if (std::sscanf(value, "%dx%d", &options.headless_size.x,
+                      &options.headless_size.y) != 2 ||
+          options.headless_size.x <= 0 || options.headless_size.y <= 0) {
+        return false;
+      }
+      ++i;
+    } else if (!std::strcmp(arg, "--frames") && value) {
+      options.frame_limit = std::strtoul(value, nullptr, 10);
+      ++i;
+    } else if (!std::strcmp(arg, "--capture") && value) {
+      options.capture_directory = value;
+      ++i;
+    } else if (!std::strcmp(arg, "--capture-interval") && value) {
+      options.capture_interval = std::strtoul(value, nullptr, 10);
+      ++i;
+    } else if (!std::strcmp(arg, "--record-camera") && value) {
+      options.record_camera_path = value;
+      ++i;
+    } else if (!std::strcmp(arg, "--replay-camera") && value) {
+      options.replay_camera = value;
+      ++i;
+    } else if (!std::strcmp(arg, "--timestep") && value) {
+      options.replay_timestep = std::strtod(value, nullptr);
+      if (options.replay_timestep <= 0) {
+        return false;
+      }
+      ++i;
+    } else if (!std::strcmp(arg, "--max-fps") && value) {
+      options.max_fps = std::strtod(value, nullptr);
+      if (options.max_fps < 0) {
+        return false;
+      }
+      ++i;
+    } else if (!std::strcmp(arg, "--present-mode") && value) {
+      vk::PresentModeKHR mode;
+      if (!engine::VulkanScene::ParsePresentMode(value, mode)) {
+        return false;
+      }
+      options.present_mode = value;
+      ++i;
+    } else if (!std::strcmp(arg, "--render-queue") && value) {
+      options.render_queue_depth = std::strtoul(value, nullptr, 10);
+      ++i;
+    } else {
+      return false;
+    }
+  }
+
+  if (!options.capture_directory.empty() && options.capture_interval == 0) {
+    options.capture_interval = 1;
+  }
+  if (!options.capture_directory.empty() && !options.headless) {
+    std::cerr << "--capture only works with --headless." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+}
+
 int main(const int argc, const char *argv[]) {
-  engine::GameEngine engine;
-  engine.LoadScene(std::unique_ptr<engine::Scene>{new DemoScene(engine.window())});
+  if (argc >= 2 && !std::strcmp(argv[1], "--benchmark")) {
+    if (argc == 2 || !std::strcmp(argv[2], "list")) {
+      Benchmark::PrintList(std::cout);
+      return 0;
+    }
+    return Benchmark::Run(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+  }
+
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  engine::CameraTrack replay_track;
+  if (!options.replay_camera.empty() &&
+      !Flights::MakeOrLoad(options.replay_camera, replay_track)) {
+    return 1;
+  }
+
+  // A replay ends with its track, unless a frame limit is given
+  if (options.frame_limit == 0) {
+    if (!replay_track.empty()) {
+      options.frame_limit = replay_track.frame_count(options.replay_timestep);
+    } else if (options.headless) {
+      options.frame_limit = kDefaultHeadlessFrameLimit;
+    }
+  }
+
+  engine::GameEngine engine{options.headless};
+  engine.set_frame_limit(options.frame_limit);
+  engine.frame_limiter().set_max_fps(options.max_fps);
+
+  std::unique_ptr<DemoScene> scene{
+      new DemoScene(engine.window(), options.headless_size)};
+  if (options.capture_interval) {
+    scene->set_frame_capture(options.capture_directory,
+                             options.capture_interval);
+  }
+  if (!options.present_mode.empty()) {
+    vk::PresentModeKHR mode;
+    engine::VulkanScene::ParsePresentMode(options.present_mode, mode);
+    scene->set_present_mode(mode);
+  }
+  scene->set_render_queue_depth(options.render_queue_depth);
+
+  // The replay camera replaces the interactive one. A replay runs one update
+  // per frame, so it shows the same frames at any frame rate.
+  if (!replay_track.empty()) {
+    scene->set_lockstep(true);
+    scene->set_simulation_timestep(options.replay_timestep);
+    engine::Camera* free_fly_camera = scene->camera();
+    free_fly_camera->set_enabled(false);
+    scene->set_camera(scene->AddComponent<engine::ReplayCamera>(
+        free_fly_camera->z_near(), free_fly_camera->z_far(), replay_track,
+        options.replay_timestep));
+  }
+  if (!options.record_camera_path.empty()) {
+    scene->AddComponent<engine::CameraTrackRecorder>(options.record_camera_path);
+  }
+
+  engine.LoadScene(std::move(scene));
   engine.Run();
 
   return 0;
 }
-
@@ -0,0 +1,111 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "shader/shader_cache.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "shader/glsl2spv.hpp"
+#include "common/file_utils.hpp"
+
+// The build puts the precompiled shaders here (see src/CMakeLists.txt)
+static const char* kSpirvDirectory = "src/spv/";
+
+// 64 bit FNV-1a
+static uint64_t Hash(const std::string& str, uint64_t hash = 14695981039346656037ull) {
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static std::string FileName(const std::string& path) {
+  size_t slash = path.find_last_of("/\\");
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static bool ReadSPV(const std::string& path, std::vector<unsigned int>& spirv) {
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::streamsize size = file.tellg();
+  if (size <= 0 || size % sizeof(unsigned int) != 0) {
+    return false;
+  }
+
+  spirv.resize(size / sizeof(unsigned int));
+  file.seekg(0, std::ios::beg);
+  return bool(file.read(reinterpret_cast<char*>(spirv.data()), size));
+}
+
+static void WriteSPV(const std::string& path, const std::vector<unsigned int>& spirv) {
+  std::ofstream file(path.c_str(), std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Couldn't write the shader cache file '" << path << "'" << std::endl;
+    return;
+  }
+  file.write(reinterpret_cast<const char*>(spirv.data()),
+             spirv.size() * sizeof(unsigned int));
+}
+
+static std::string InsertDefines(const std::string& source, const std::string& defines) {
+  if (defines.empty()) {
+    return source;
+  }
+
+  // The #version directive has to stay the first statement
+  size_t version = source.find("#version");
+  size_t insert_pos = version == std::string::npos ? 0 : source.find('\n', version);
+  if (insert_pos == std::string::npos) {
+    return source + "\n" + defines;
+  } else if (version != std::string::npos) {
+    insert_pos++;
+  }
+
+  return source.substr(0, insert_pos) + defines + source.substr(insert_pos);
+}
+
+std::vector<unsigned int> Shader::LoadSPV(const vk::ShaderStageFlagBits shaderType,
+                                          const std::string& glslPath,
+                                          const std::string& defines) {
+  std::vector<unsigned int> spirv;
+  std::string name = FileName(glslPath);
+
+  // The build's binary is stale if the source was edited since the build
+  std::string prebuilt_path = kSpirvDirectory + name + ".spv";
+  if (defines.empty() &&
+      FileUtils::ModificationTime(prebuilt_path) >=
+          FileUtils::ModificationTime(glslPath) &&
+      ReadSPV(prebuilt_path, spirv)) {
+    return spirv;
+  }
+
+  std::string source = InsertDefines(FileUtils::ReadFileToString(glslPath), defines);
+  uint64_t hash = Hash(source, Hash(std::to_string(static_cast<int>(shaderType))));
+
+  char hash_str[17];
+  std::snprintf(hash_str, sizeof(hash_str), "%016llx",
+                static_cast<unsigned long long>(hash));
+  std::string cache_path = kSpirvDirectory + name + "." + hash_str + ".spv";
+
+  if (ReadSPV(cache_path, spirv)) {
+    return spirv;
+  }
+
+  InitializeGlslang();
+  try {
+    spirv = GLSLtoSPV(shaderType, source);
+  } catch (...) {
+    FinalizeGlslang();
+    throw;
+  }
+  FinalizeGlslang();
+
+  WriteSPV(cache_path, spirv);
+  return spirv;
+}
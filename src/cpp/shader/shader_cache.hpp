@@ -0,0 +1,27 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef SHADER_SHADER_CACHE_HPP_
+#define SHADER_SHADER_CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <vulkan/vk_cpp.h>
+
+namespace Shader {
+
+// Returns the SPIR-V code of a GLSL shader, without running glslang if possible.
+//
+// Without defines, the binary compiled at build time (src/spv/<name>.spv) is
+// used, unless the source was modified after it. Otherwise (or if that is
+// missing) the source is compiled at runtime, and the result is saved to the
+// shader cache directory, keyed by the hash of the stage, the defines and the
+// source text, so the next startup can skip the compilation.
+//
+// The defines are inserted after the #version line, for ex. "#define FOO 1\n".
+std::vector<unsigned int> LoadSPV(const vk::ShaderStageFlagBits shaderType,
+                                  const std::string& glslPath,
+                                  const std::string& defines = "");
+
+}
+
+#endif // SHADER_SHADER_CACHE_HPP_
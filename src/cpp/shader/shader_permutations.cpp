@@ -0,0 +1,101 @@
+// Copyright (c) 2016, Tamas Csala
+
+#include "shader/shader_permutations.hpp"
+
+#include <cstring>
+
+#include "shader/shader_cache.hpp"
+#include "common/settings.hpp"
+#include "common/error_checking.hpp"
+
+namespace Shader {
+
+SpecializationConstants& SpecializationConstants::Add(uint32_t constant_id,
+                                                      int32_t value) {
+  Add(constant_id, &value);
+  return *this;
+}
+
+SpecializationConstants& SpecializationConstants::Add(uint32_t constant_id,
+                                                      float value) {
+  Add(constant_id, &value);
+  return *this;
+}
+
+void SpecializationConstants::Add(uint32_t constant_id, const void* value) {
+  uint32_t data;
+  std::memcpy(&data, value, sizeof(data));
+
+  entries_.push_back(vk::SpecializationMapEntry()
+      .constantID(constant_id)
+      .offset(data_.size() * sizeof(uint32_t))
+      .size(sizeof(uint32_t)));
+  data_.push_back(data);
+}
+
+vk::SpecializationInfo SpecializationConstants::info() const {
+  return vk::SpecializationInfo()
+      .mapEntryCount(entries_.size())
+      .pMapEntries(entries_.data())
+      .dataSize(data_.size() * sizeof(uint32_t))
+      .pData(data_.data());
+}
+
+std::string SpecializationConstants::key() const {
+  std::string key;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    uint32_t id = entries_[i].constantID();
+    key.append(reinterpret_cast<const char*>(&id), sizeof(id));
+    key.append(reinterpret_cast<const char*>(&data_[i]), sizeof(data_[i]));
+  }
+  return key;
+}
+
+vk::ShaderModule PermutationCache::GetModule(vk::ShaderStageFlagBits stage,
+                                             const std::string& glsl_path) {
+  auto iter = modules_.find(glsl_path);
+  if (iter != modules_.end()) {
+    return iter->second;
+  }
+
+  std::vector<unsigned int> spirv = LoadSPV(stage, glsl_path);
+
+  vk::ShaderModuleCreateInfo module_create_info;
+  module_create_info.codeSize(spirv.size() * sizeof(spirv[0]));
+  module_create_info.pCode(spirv.data());
+
+  vk::ShaderModule module;
+  vk::chk(device_.createShaderModule(&module_create_info, nullptr, &module));
+  modules_[glsl_path] = module;
+
+  return module;
+}
+
+const vk::PipelineShaderStageCreateInfo& PermutationCache::GetStage(
+    vk::ShaderStageFlagBits stage, const std::string& glsl_path,
+    const SpecializationConstants& constants) {
+  std::string key = glsl_path + '\0' + constants.key();
+  std::unique_ptr<Permutation>& permutation = permutations_[key];
+  if (!permutation) {
+    permutation = make_unique<Permutation>();
+    permutation->constants = constants;
+    permutation->specialization_info = permutation->constants.info();
+    permutation->stage_info = vk::PipelineShaderStageCreateInfo()
+        .stage(stage)
+        .module(GetModule(stage, glsl_path))
+        .pName("main")
+        .pSpecializationInfo(&permutation->specialization_info);
+  }
+
+  return permutation->stage_info;
+}
+
+void PermutationCache::Clear() {
+  for (auto& module : modules_) {
+    device_.destroyShaderModule(module.second, nullptr);
+  }
+  modules_.clear();
+  permutations_.clear();
+}
+
+}
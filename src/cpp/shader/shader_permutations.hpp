@@ -0,0 +1,68 @@
+// Copyright (c) 2016, Tamas Csala
+
+#ifndef SHADER_SHADER_PERMUTATIONS_HPP_
+#define SHADER_SHADER_PERMUTATIONS_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <vulkan/vk_cpp.h>
+
+namespace Shader {
+
+// The values of the specialization constants (layout (constant_id = N)) of a
+// shader. Every constant takes 4 bytes (int, uint, float or bool).
+class SpecializationConstants {
+ public:
+  SpecializationConstants& Add(uint32_t constant_id, int32_t value);
+  SpecializationConstants& Add(uint32_t constant_id, float value);
+
+  // The returned struct points into this object.
+  vk::SpecializationInfo info() const;
+
+  // A byte string that uniquely identifies these values.
+  std::string key() const;
+
+ private:
+  std::vector<vk::SpecializationMapEntry> entries_;
+  std::vector<uint32_t> data_;
+
+  void Add(uint32_t constant_id, const void* value);
+};
+
+// Caches the shader modules by source file, and the shader stages by
+// specialization constant values, so that pipeline variants of the same
+// shader don't load (or compile) the shader code multiple times.
+class PermutationCache {
+ public:
+  explicit PermutationCache(const vk::Device& device) : device_(device) {}
+  ~PermutationCache() { Clear(); }
+
+  // The returned struct stays valid until Clear() is called.
+  const vk::PipelineShaderStageCreateInfo& GetStage(
+      vk::ShaderStageFlagBits stage, const std::string& glsl_path,
+      const SpecializationConstants& constants = SpecializationConstants{});
+
+  // Destroys all the shader modules.
+  void Clear();
+
+ private:
+  struct Permutation {
+    SpecializationConstants constants;
+    vk::SpecializationInfo specialization_info;
+    vk::PipelineShaderStageCreateInfo stage_info;
+  };
+
+  vk::Device device_;
+  std::map<std::string, vk::ShaderModule> modules_;
+  std::map<std::string, std::unique_ptr<Permutation>> permutations_;
+
+  vk::ShaderModule GetModule(vk::ShaderStageFlagBits stage,
+                             const std::string& glsl_path);
+};
+
+}
+
+#endif // SHADER_SHADER_PERMUTATIONS_HPP_
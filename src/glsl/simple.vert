@@ -8,16 +8,26 @@
 layout (location = 0) in ivec2 aPos;
 layout (location = 1) in vec4 aRenderData;
 
+// The size of the lod table, see CdlodLodTable::kMaxLevelCount
+const int kMaxLodLevelCount = 16;
+
 layout (std140, binding = 1) uniform bufferVals {
   mat4 mvp;
   vec3 cameraPos;
-  float terrainSmallestGeometryLodDistance;
-  float terrainSphereRadius;
-  float faceSize;
-  float heightScale;
-  int terrainMaxLoadLevel;
+  // x: morph start, y: morph end, z: scale (2^level)
+  vec4 lodLevels[kMaxLodLevelCount];
 } uniforms;
 
+// The terrain settings don't change at runtime, so they are specialization
+// constants, that the driver can fold into the code.
+layout (constant_id = 1) const float kTerrainSphereRadius = 32768.0;
+layout (constant_id = 2) const float kFaceSize = 65536.0;
+layout (constant_id = 3) const float kHeightScale = 1.0;
+layout (constant_id = 4) const int kTerrainMaxLodLevel = 12;
+// If it isn't negative, the pipeline only draws this face, and the face
+// switches below are resolved at pipeline creation time.
+layout (constant_id = 5) const int kTerrainFace = -1;
+
 uniform sampler2D heightmap[6];
 
 // out variables
@@ -29,11 +39,11 @@ out gl_PerVertex {
 };
 
 // constants and aliases
-const float kMorphEnd = 0.95, kMorphStart = 0.65;
 vec2 terrainOffset = aRenderData.xy;
 float terrainLevel = aRenderData.z;
-float terrainScale = pow(2, terrainLevel);
-int terrainFace = int(aRenderData.w);
+vec4 terrainLod = uniforms.lodLevels[int(terrainLevel)];
+float terrainScale = terrainLod.z;
+int terrainFace = kTerrainFace >= 0 ? kTerrainFace : int(aRenderData.w);
 
 /* Cube 2 Sphere */
 
@@ -57,7 +67,7 @@ vec3 Spherify(vec3 p) {
 }
 
 float Radius() {
-  return uniforms.terrainSphereRadius;
+  return kTerrainSphereRadius;
 }
 
 vec3 WorldPos(vec3 pos) {
@@ -77,11 +87,11 @@ vec3 WorldPos(vec3 pos) {
 /* Cube 2 Sphere */
 
 vec2 GetTexcoord(vec2 pos) {
-  return (pos / uniforms.faceSize + vec2(3.0 / 262.0)) * vec2(256.0 / 262.0);
+  return (pos / kFaceSize + vec2(3.0 / 262.0)) * vec2(256.0 / 262.0);
 }
 
 float GetHeight(vec2 pos) {
-  return texture(heightmap[terrainFace], GetTexcoord(pos)).r * uniforms.heightScale;
+  return texture(heightmap[terrainFace], GetTexcoord(pos)).r * kHeightScale;
 }
 
 vec2 MorphVertex(vec2 vertex, float morph) {
@@ -104,11 +114,8 @@ vec3 ModelPos(vec2 m_pos) {
   float dist = EstimateDistance(pos);
   float morph = 0;
 
-  if (terrainLevel < uniforms.terrainMaxLoadLevel) {
-    float nextLevelSize = 2 * terrainScale * uniforms.terrainSmallestGeometryLodDistance;
-    float maxDist = kMorphEnd * nextLevelSize;
-    float startDist = kMorphStart * nextLevelSize;
-    morph = smoothstep(startDist, maxDist, dist);
+  if (terrainLevel < kTerrainMaxLodLevel) {
+    morph = smoothstep(terrainLod.x, terrainLod.y, dist);
 
     vec2 morphed_pos = MorphVertex(m_pos, morph);
     pos = NodeLocal2Global(morphed_pos);